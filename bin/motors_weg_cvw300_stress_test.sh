@@ -21,16 +21,23 @@ usage()
     echo "   TOTAL_RUN_TIME: total time to run the test in seconds (i.e. 3600)"
 }
 
+# The commands of the control cycle go through a daemon that keeps the serial
+# port and the driver open, instead of re-opening them for each command
+ctl()
+{
+    motors_weg_cvw300_ctl --socket $socket "$@"
+}
+
 control_cycle() {
     deadline=$(($(date +%s) + $time_between_estop_reset))
     echo
     echo "Enabling propulsion"
     echo 1 > $propulsion_enable_gpio/value
 
-    fault_before_reset=$(motors_weg_cvw300_ctl $uri $id fault-state | grep "Current Fault: " | cut -d' ' -f3)
+    fault_before_reset=$(ctl fault-state | grep "Current Fault: " | cut -d' ' -f3)
     echo "Trying to reset fault: $fault_before_reset"
-    motors_weg_cvw300_ctl $uri $id prepare
-    fault_after_reset=$(motors_weg_cvw300_ctl $uri $id fault-state | grep "Current Fault: " | cut -d' ' -f3)
+    ctl prepare
+    fault_after_reset=$(ctl fault-state | grep "Current Fault: " | cut -d' ' -f3)
 
     if [ $fault_after_reset -ne 0 ]
     then
@@ -41,13 +48,13 @@ control_cycle() {
     echo "Enabling motor speed command: $speed"
     while [ $(date +%s) -lt $deadline ]
     do
-       motors_weg_cvw300_ctl $uri $id speed $speed 0.5
+       ctl speed $speed 0.5
     done
 
     echo "Disabling propulsion"
-    motors_weg_cvw300_ctl $uri $id speed 0 0.5
+    ctl speed 0 0.5
     echo 0 > $propulsion_enable_gpio/value
-    fault_after_disable=$(motors_weg_cvw300_ctl $uri $id fault-state | grep "Current Fault: " | cut -d' ' -f3)
+    fault_after_disable=$(ctl fault-state | grep "Current Fault: " | cut -d' ' -f3)
     echo "Fault after disabling propulsion: $fault_after_disable"
 
     disabled_deadline=$(($(date +%s) + $time_disabled))
@@ -70,6 +77,20 @@ fi
 
 motors_weg_cvw300_ctl $uri $id setup
 
+socket=$(mktemp -u /tmp/motors_weg_cvw300_stress_test.XXXXXX)
+motors_weg_cvw300_ctl $uri $id serve $socket &
+daemon_pid=$!
+trap 'kill $daemon_pid' EXIT
+while [ ! -S $socket ]
+do
+    if ! kill -0 $daemon_pid 2>/dev/null
+    then
+        echo "Failed to start the motors_weg_cvw300_ctl daemon"
+        exit 1
+    fi
+    sleep 0.1
+done
+
 program_deadline=$(($(date +%s) + $total_run_time))
 while [ $(date +%s) -lt $program_deadline ]
 do
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <motors_weg_cvw300/Driver.hpp>
+#include <motors_weg_cvw300/Simulator.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace base;
+using namespace std;
+using namespace motors_weg_cvw300;
+
+/** A Driver operation to benchmark */
+struct Operation {
+    string name;
+    function<void(Driver&)> run;
+};
+
+struct Result {
+    string name;
+    int baud_rate = 0;
+    Time interframe_delay;
+    int iterations = 0;
+    int errors = 0;
+
+    /** Average number of frames (requests) per operation */
+    double frames = 0;
+    /** Average number of bytes on the line per operation, both directions */
+    double bytes = 0;
+    /** Cost estimated by the driver's bus cost model, if there is one */
+    Time estimated_cost;
+
+    Time latency_p50;
+    Time latency_p99;
+    Time latency_mean;
+
+    /** Number of operations per second that can be done back-to-back */
+    double getRate() const {
+        return latency_mean.isNull() ? 0 : 1 / latency_mean.toSeconds();
+    }
+};
+
+struct BenchmarkSettings {
+    vector<int> baud_rates = { 19200, 57600 };
+    vector<Time> interframe_delays = { Time::fromMilliseconds(20),
+                                       Time::fromMilliseconds(10),
+                                       Time::fromMilliseconds(5) };
+    int iterations = 50;
+    Time response_delay = Time::fromMilliseconds(2);
+    bool json = false;
+};
+
+vector<Operation> operations()
+{
+    configuration::Ramps ramps;
+    ramps.acceleration_time = Time::fromSeconds(4);
+    ramps.deceleration_time = Time::fromSeconds(4);
+    JointLimitRange limits = JointLimitRange::Speed(-100, 100);
+
+    return {
+        { "readCurrentState",
+          [](Driver& driver) { driver.readCurrentState(); } },
+        { "readCurrentState(encoder)",
+          [](Driver& driver) {
+              driver.setUseEncoderFeedback(true);
+              driver.readCurrentState();
+              driver.setUseEncoderFeedback(false);
+          } },
+        { "readCurrentState(speed)",
+          [](Driver& driver) {
+              driver.setTelemetryProfile(TELEMETRY_PROFILE_SPEED);
+              driver.readCurrentState();
+              driver.setTelemetryProfile(TELEMETRY_PROFILE_FULL);
+          } },
+        { "readSnapshot", [](Driver& driver) { driver.readSnapshot(); } },
+        { "readTemperatures", [](Driver& driver) { driver.readTemperatures(); } },
+        { "readCurrentAlarm", [](Driver& driver) { driver.readCurrentAlarm(); } },
+        { "readFaultState", [](Driver& driver) { driver.readFaultState(); } },
+        { "readMotorRatings", [](Driver& driver) { driver.readMotorRatings(); } },
+        { "readConfigurationRegisters",
+          [](Driver& driver) { driver.readConfigurationRegisters(); } },
+        { "prepare",
+          [](Driver& driver) {
+              driver.clearConfigurationRegisters();
+              driver.prepare();
+          } },
+        { "resetFault", [](Driver& driver) { driver.resetFault(); } },
+        { "enable", [](Driver& driver) { driver.enable(); } },
+        { "enable(command)", [](Driver& driver) { driver.enable(1); } },
+        { "disable", [](Driver& driver) { driver.disable(); } },
+        { "writeSpeedCommand", [](Driver& driver) { driver.writeSpeedCommand(1); } },
+        { "writeRampConfiguration",
+          [ramps](Driver& driver) {
+              driver.clearConfigurationRegisters();
+              driver.writeRampConfiguration(ramps);
+          } },
+        { "writeJointLimits",
+          [limits](Driver& driver) {
+              driver.clearConfigurationRegisters();
+              driver.writeJointLimits(limits);
+          } },
+        { "writeSerialWatchdog",
+          [](Driver& driver) {
+              driver.clearConfigurationRegisters();
+              driver.writeSerialWatchdog(Time::fromSeconds(5));
+          } },
+        { "writeControlType",
+          [](Driver& driver) {
+              driver.clearConfigurationRegisters();
+              driver.writeControlType(configuration::CONTROL_ENCODER);
+          } },
+        { "control cycle",
+          [](Driver& driver) {
+              driver.writeSpeedCommand(1);
+              driver.readCurrentState();
+          } }
+    };
+}
+
+static Time percentile(vector<Time> sorted, double p)
+{
+    if (sorted.empty()) {
+        return Time();
+    }
+    size_t index = min(sorted.size() - 1,
+                       static_cast<size_t>(p * (sorted.size() - 1) + 0.5));
+    return sorted[index];
+}
+
+static unsigned int lineBytes(Driver& driver)
+{
+    auto status = driver.getStatus();
+    return status.tx + status.good_rx + status.bad_rx;
+}
+
+Result benchmark(Operation const& operation, Driver& driver, Simulator& simulator,
+                 int iterations)
+{
+    Result result;
+    result.name = operation.name;
+    result.iterations = iterations;
+
+    vector<Time> latencies;
+    auto stats_before = simulator.getStatistics();
+    unsigned int bytes_before = lineBytes(driver);
+    for (int i = 0; i < iterations; ++i) {
+        Time start = Time::now();
+        try {
+            operation.run(driver);
+        }
+        catch (std::exception const&) {
+            result.errors++;
+            continue;
+        }
+        latencies.push_back(Time::now() - start);
+    }
+    auto stats_after = simulator.getStatistics();
+
+    result.frames =
+        static_cast<double>(stats_after.requests - stats_before.requests) / iterations;
+    result.bytes = static_cast<double>(lineBytes(driver) - bytes_before) / iterations;
+
+    sort(latencies.begin(), latencies.end());
+    result.latency_p50 = percentile(latencies, 0.5);
+    result.latency_p99 = percentile(latencies, 0.99);
+    Time total;
+    for (auto const& latency : latencies) {
+        total += latency;
+    }
+    if (!latencies.empty()) {
+        result.latency_mean = Time::fromMicroseconds(
+            total.toMicroseconds() / static_cast<int64_t>(latencies.size())
+        );
+    }
+    return result;
+}
+
+vector<Result> benchmark(BenchmarkSettings const& settings, int baud_rate,
+                         Time const& interframe_delay)
+{
+    SimulatorSettings simulator_settings;
+    simulator_settings.baud_rate = baud_rate;
+    simulator_settings.response_delay = settings.response_delay;
+    Simulator simulator(simulator_settings);
+    simulator.start();
+
+    Driver driver(simulator_settings.address);
+    driver.openURI("serial://" + simulator.getPTYPath() + ":" + to_string(baud_rate));
+    driver.setBaudRate(baud_rate);
+    driver.setInterframeDelay(interframe_delay);
+    driver.readMotorRatings();
+
+    vector<Result> results;
+    for (auto const& operation : operations()) {
+        auto result = benchmark(operation, driver, simulator, settings.iterations);
+        result.baud_rate = baud_rate;
+        result.interframe_delay = interframe_delay;
+        if (operation.name == "readCurrentState") {
+            result.estimated_cost = driver.estimateCurrentStateReadCost();
+        }
+        results.push_back(result);
+    }
+
+    // Leave the simulated drive disabled
+    driver.disable();
+    simulator.stop();
+    return results;
+}
+
+void writeJSON(ostream& out, vector<Result> const& results)
+{
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto const& r = results[i];
+        out << "  { \"operation\": \"" << r.name << "\""
+            << ", \"baud_rate\": " << r.baud_rate
+            << ", \"interframe_delay_us\": " << r.interframe_delay.toMicroseconds()
+            << ", \"iterations\": " << r.iterations
+            << ", \"errors\": " << r.errors
+            << ", \"frames\": " << r.frames
+            << ", \"bytes\": " << r.bytes
+            << ", \"estimated_cost_us\": " << r.estimated_cost.toMicroseconds()
+            << ", \"latency_p50_us\": " << r.latency_p50.toMicroseconds()
+            << ", \"latency_p99_us\": " << r.latency_p99.toMicroseconds()
+            << ", \"latency_mean_us\": " << r.latency_mean.toMicroseconds()
+            << ", \"rate_hz\": " << r.getRate() << " }"
+            << (i + 1 == results.size() ? "\n" : ",\n");
+    }
+    out << "]" << endl;
+}
+
+void writeTable(ostream& out, vector<Result> const& results)
+{
+    out << left << setw(28) << "Operation" << right << setw(7) << "Baud"
+        << setw(8) << "IFD(ms)" << setw(8) << "Frames" << setw(8) << "Bytes"
+        << setw(10) << "p50(ms)" << setw(10) << "p99(ms)" << setw(10) << "Rate(Hz)"
+        << setw(8) << "Errors" << "\n";
+    out << fixed;
+    for (auto const& r : results) {
+        out << left << setw(28) << r.name << right << setw(7) << r.baud_rate
+            << setw(8) << setprecision(1) << r.interframe_delay.toSeconds() * 1000
+            << setw(8) << setprecision(1) << r.frames
+            << setw(8) << setprecision(1) << r.bytes
+            << setw(10) << setprecision(2) << r.latency_p50.toSeconds() * 1000
+            << setw(10) << setprecision(2) << r.latency_p99.toSeconds() * 1000
+            << setw(10) << setprecision(1) << r.getRate()
+            << setw(8) << r.errors << "\n";
+    }
+    out << flush;
+}
+
+void usage(ostream& stream)
+{
+    stream << "usage: motors_weg_cvw300_bench [OPTIONS]\n"
+           << "Runs the Driver operations against a simulated controller, and "
+              "reports their bus cost and latency\n"
+           << "\n"
+           << "Options\n"
+           << "  --baud RATES: comma-separated list of baud rates (19200,57600)\n"
+           << "  --delay MS: comma-separated list of interframe delays (20,10,5)\n"
+           << "  --iterations N: number of times each operation is run (50)\n"
+           << "  --response-delay MS: processing time of the simulated "
+              "controller (2)\n"
+           << "  --json: output the results in JSON\n"
+           << endl;
+}
+
+template<typename T>
+vector<T> parseList(string const& arg, function<T(string const&)> parse)
+{
+    vector<T> result;
+    stringstream stream(arg);
+    string item;
+    while (getline(stream, item, ',')) {
+        result.push_back(parse(item));
+    }
+    return result;
+}
+
+Time parseMilliseconds(string const& arg)
+{
+    return Time::fromMicroseconds(stof(arg) * 1000);
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--help" || option == "-h") {
+            usage(cout);
+            return 0;
+        }
+        else if (option == "--json") {
+            settings.json = true;
+            continue;
+        }
+        else if (i + 1 == argc) {
+            cerr << "missing value for option " << option << "\n" << endl;
+            usage(cerr);
+            return 1;
+        }
+
+        string value = argv[++i];
+        if (option == "--baud") {
+            settings.baud_rates = parseList<int>(
+                value, [](string const& s) { return stoi(s); }
+            );
+        }
+        else if (option == "--delay") {
+            settings.interframe_delays = parseList<Time>(value, parseMilliseconds);
+        }
+        else if (option == "--iterations") {
+            settings.iterations = stoi(value);
+        }
+        else if (option == "--response-delay") {
+            settings.response_delay = parseMilliseconds(value);
+        }
+        else {
+            cerr << "unknown option " << option << "\n" << endl;
+            usage(cerr);
+            return 1;
+        }
+    }
+
+    vector<Result> results;
+    for (int baud_rate : settings.baud_rates) {
+        for (auto const& delay : settings.interframe_delays) {
+            auto partial = benchmark(settings, baud_rate, delay);
+            results.insert(results.end(), partial.begin(), partial.end());
+        }
+    }
+
+    if (settings.json) {
+        writeJSON(cout, results);
+    }
+    else {
+        writeTable(cout, results);
+    }
+
+    for (auto const& r : results) {
+        if (r.errors) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include <motors_weg_cvw300/BusScheduler.hpp>
+
+using namespace std;
+using namespace base;
+using namespace motors_weg_cvw300;
+
+static float computeRate(int count, Time const& first, Time const& last) {
+    if (count < 2 || last <= first) {
+        return 0;
+    }
+    return (count - 1) / (last - first).toSeconds();
+}
+
+float BusScheduler::DriveStatistics::getCommandRate() const {
+    return computeRate(commands, first_command, last_command);
+}
+
+float BusScheduler::DriveStatistics::getStateUpdateRate() const {
+    return computeRate(state_updates, first_state_update, last_state_update);
+}
+
+BusScheduler::BusScheduler() {
+    setInterframeDelay(Time::fromMilliseconds(20));
+}
+
+void BusScheduler::checkNotPolling(char const* method) const {
+    for (auto const& drive : m_drives) {
+        drive.driver->checkNotPolling(method);
+    }
+}
+
+void BusScheduler::setInterframeDelay(Time const& delay) {
+    checkNotPolling("setInterframeDelay");
+    modbus::Master::setInterframeDelay(delay);
+    m_interframe_delay = delay;
+    for (auto& drive : m_drives) {
+        drive.driver->syncInterframeDelay(delay);
+    }
+}
+
+void BusScheduler::setBaudRate(int baud_rate) {
+    checkNotPolling("setBaudRate");
+    m_baud_rate = baud_rate;
+    for (auto& drive : m_drives) {
+        drive.driver->setBaudRate(baud_rate);
+    }
+}
+
+size_t BusScheduler::addDrive(int address) {
+    Drive drive;
+    drive.driver.reset(new motors_weg_cvw300::Driver(*this, m_bus_mutex, address));
+    drive.driver->syncInterframeDelay(m_interframe_delay);
+    drive.driver->setBaudRate(m_baud_rate);
+    m_drives.push_back(move(drive));
+    return m_drives.size() - 1;
+}
+
+size_t BusScheduler::getDriveCount() const {
+    return m_drives.size();
+}
+
+BusScheduler::Drive& BusScheduler::getDriveEntry(size_t index) {
+    if (index >= m_drives.size()) {
+        throw std::out_of_range("BusScheduler: invalid drive index");
+    }
+    return m_drives[index];
+}
+
+BusScheduler::Drive const& BusScheduler::getDriveEntry(size_t index) const {
+    if (index >= m_drives.size()) {
+        throw std::out_of_range("BusScheduler: invalid drive index");
+    }
+    return m_drives[index];
+}
+
+motors_weg_cvw300::Driver& BusScheduler::getDrive(size_t index) {
+    return *getDriveEntry(index).driver;
+}
+
+void BusScheduler::setCycleBudget(Time const& budget) {
+    m_cycle_budget = budget;
+}
+
+Time BusScheduler::estimateFullCycleCost() const {
+    Time cost;
+    for (auto const& drive : m_drives) {
+        auto model = drive.driver->getBusCostModel();
+        cost += model.writeFrameCost() +
+                drive.driver->estimateCurrentStateReadCost();
+    }
+    return cost;
+}
+
+void BusScheduler::setSpeedCommand(size_t index, float command) {
+    lock_guard<mutex> lock(m_data_mutex);
+    Drive& drive = getDriveEntry(index);
+    drive.has_command = true;
+    drive.command = command;
+}
+
+void BusScheduler::clearSpeedCommand(size_t index) {
+    lock_guard<mutex> lock(m_data_mutex);
+    getDriveEntry(index).has_command = false;
+}
+
+CurrentState BusScheduler::getState(size_t index) const {
+    lock_guard<mutex> lock(m_data_mutex);
+    return getDriveEntry(index).state;
+}
+
+BusScheduler::DriveStatistics BusScheduler::getStatistics(size_t index) const {
+    lock_guard<mutex> lock(m_data_mutex);
+    return getDriveEntry(index).statistics;
+}
+
+void BusScheduler::resetStatistics() {
+    lock_guard<mutex> lock(m_data_mutex);
+    for (auto& drive : m_drives) {
+        drive.statistics = DriveStatistics();
+    }
+}
+
+bool BusScheduler::sendCommand(Drive& drive, float command) {
+    try {
+        if (!drive.driver->writeSpeedCommand(command)) {
+            return false;
+        }
+    }
+    catch (std::logic_error const&) {
+        // Refused by the driver before anything was sent
+        lock_guard<mutex> lock(m_data_mutex);
+        drive.statistics.errors++;
+        return false;
+    }
+    catch (std::runtime_error const&) {
+        // The request went on the bus, but got no valid reply
+        lock_guard<mutex> lock(m_data_mutex);
+        drive.statistics.errors++;
+        return true;
+    }
+
+    lock_guard<mutex> lock(m_data_mutex);
+    auto& stats = drive.statistics;
+    stats.last_command = Time::now();
+    if (stats.commands == 0) {
+        stats.first_command = stats.last_command;
+    }
+    stats.commands++;
+    return true;
+}
+
+bool BusScheduler::readState(Drive& drive) {
+    CurrentState state;
+    try {
+        state = drive.driver->readCurrentState();
+    }
+    catch (std::runtime_error const&) {
+        lock_guard<mutex> lock(m_data_mutex);
+        drive.statistics.errors++;
+        return false;
+    }
+
+    lock_guard<mutex> lock(m_data_mutex);
+    drive.state = state;
+    auto& stats = drive.statistics;
+    stats.last_state_update = Time::now();
+    if (stats.state_updates == 0) {
+        stats.first_state_update = stats.last_state_update;
+    }
+    stats.state_updates++;
+    return true;
+}
+
+int BusScheduler::runCycle() {
+    Time spent;
+    for (auto& drive : m_drives) {
+        bool has_command;
+        float command;
+        {
+            lock_guard<mutex> lock(m_data_mutex);
+            has_command = drive.has_command;
+            command = drive.command;
+        }
+        if (has_command && sendCommand(drive, command)) {
+            spent += drive.driver->getBusCostModel().writeFrameCost();
+        }
+    }
+
+    int read_count = 0;
+    for (size_t i = 0; i < m_drives.size(); ++i) {
+        Drive& drive = m_drives[m_next_state_read];
+        Time cost = drive.driver->estimateCurrentStateReadCost();
+        // Always read at least one state per cycle, otherwise a budget
+        // smaller than the commands would starve the telemetry completely
+        if (!m_cycle_budget.isNull() && read_count > 0 &&
+            spent + cost > m_cycle_budget) {
+            break;
+        }
+
+        readState(drive);
+        spent += cost;
+        read_count++;
+        m_next_state_read = (m_next_state_read + 1) % m_drives.size();
+    }
+    return read_count;
+}
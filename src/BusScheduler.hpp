@@ -0,0 +1,164 @@
+#ifndef MOTORS_WEG_CVW300_BUSSCHEDULER_HPP
+#define MOTORS_WEG_CVW300_BUSSCHEDULER_HPP
+
+#include <memory>
+#include <modbus/Master.hpp>
+#include <mutex>
+#include <motors_weg_cvw300/Driver.hpp>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Scheduling of multiple CVW300 controllers sharing the same serial line
+     *
+     * The scheduler owns the bus, and one Driver object per controller. Each
+     * call to @c runCycle sends the speed commands of all drives that have
+     * one, and then uses the remaining cycle budget to read the current state
+     * of the drives in a round-robin fashion.
+     *
+     * If speed command suppression is enabled on the drives (see
+     * Driver::setSpeedCommandSuppression), the bus time of suppressed
+     * commands is used for state reads.
+     *
+     * The drivers share the bus lock, so their methods and pollers may be
+     * used concurrently with @c runCycle. The commands, states and
+     * statistics of the scheduler are protected by a lock as well, so that
+     * they can be accessed from other threads while @c runCycle is running.
+     * Adding drives and configuring the bus must be done before.
+     */
+    class BusScheduler : public modbus::Master {
+    public:
+        /** Achieved update statistics for a single drive */
+        struct DriveStatistics {
+            /** Number of speed commands acknowledged by the controller
+             *
+             * Suppressed and failed commands are not counted
+             */
+            int commands = 0;
+            base::Time first_command;
+            base::Time last_command;
+
+            int state_updates = 0;
+            base::Time first_state_update;
+            base::Time last_state_update;
+
+            /** Number of transactions that failed */
+            int errors = 0;
+
+            /** Average rate of the speed commands, in Hz */
+            float getCommandRate() const;
+            /** Average rate of the state updates, in Hz */
+            float getStateUpdateRate() const;
+        };
+
+    private:
+        struct Drive {
+            std::unique_ptr<motors_weg_cvw300::Driver> driver;
+            bool has_command = false;
+            float command = 0;
+            CurrentState state;
+            DriveStatistics statistics;
+        };
+        /** Lock of the bus, shared by all the drivers
+         *
+         * It must outlive the drivers, as their destructor stops their
+         * poller
+         */
+        std::mutex m_bus_mutex;
+        std::vector<Drive> m_drives;
+
+        /** Protects the command, state and statistics of the drives
+         *
+         * It is not held during the bus transactions
+         */
+        mutable std::mutex m_data_mutex;
+
+        base::Time m_interframe_delay;
+        int m_baud_rate = 19200;
+        base::Time m_cycle_budget;
+        size_t m_next_state_read = 0;
+
+        Drive& getDriveEntry(size_t index);
+        Drive const& getDriveEntry(size_t index) const;
+        /** Send the drive's speed command
+         *
+         * Only the commands that the controller acknowledged are counted in
+         * the statistics. Failures are counted as errors.
+         *
+         * @return whether a frame was sent on the bus. Commands suppressed
+         *   by the driver, or refused before being sent (e.g. because the
+         *   rated speed is unknown), do not use any bus time
+         */
+        bool sendCommand(Drive& drive, float command);
+        bool readState(Drive& drive);
+        /** Throw if any of the drives is polling */
+        void checkNotPolling(char const* method) const;
+
+    public:
+        BusScheduler();
+
+        /** Set the delay between two frames on the bus
+         *
+         * It throws std::logic_error if any drive is polling
+         */
+        void setInterframeDelay(base::Time const& delay);
+
+        /** Declare the baud rate of the bus
+         *
+         * @see Driver::setBaudRate
+         */
+        void setBaudRate(int baud_rate);
+
+        /** Add a controller on the bus
+         *
+         * @return the index of the drive in this scheduler
+         */
+        size_t addDrive(int address);
+
+        /** Number of drives handled by this scheduler */
+        size_t getDriveCount() const;
+
+        /** Access the driver of a given drive, e.g. to configure it */
+        motors_weg_cvw300::Driver& getDrive(size_t index);
+
+        /** Set the estimated bus time allocated to each cycle
+         *
+         * The commands are always sent. State reads are done in the
+         * remaining time, starting where the previous cycle stopped. A null
+         * budget (the default) means that all states are read at each cycle.
+         */
+        void setCycleBudget(base::Time const& budget);
+
+        /** Estimated bus time needed to send the commands and read the states
+         * of all drives
+         */
+        base::Time estimateFullCycleCost() const;
+
+        /** Set the speed command that should be sent to a drive at each
+         * cycle
+         */
+        void setSpeedCommand(size_t index, float command);
+
+        /** Stop sending speed commands to a drive */
+        void clearSpeedCommand(size_t index);
+
+        /** The last state read from a drive */
+        CurrentState getState(size_t index) const;
+
+        /** The update statistics of a drive */
+        DriveStatistics getStatistics(size_t index) const;
+
+        /** Reset the update statistics of all drives */
+        void resetStatistics();
+
+        /** Run a single cycle
+         *
+         * Transaction errors are counted in the drive statistics, and do not
+         * interrupt the cycle
+         *
+         * @return the number of state reads that have been attempted
+         */
+        int runCycle();
+    };
+}
+
+#endif
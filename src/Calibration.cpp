@@ -0,0 +1,10 @@
+#include <motors_weg_cvw300/Calibration.hpp>
+
+using namespace motors_weg_cvw300;
+
+float InterframeDelayCalibrationStep::getErrorRate() const {
+    if (transactions == 0) {
+        return 0;
+    }
+    return static_cast<float>(timeouts + errors) / transactions;
+}
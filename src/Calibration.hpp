@@ -0,0 +1,63 @@
+#ifndef MOTORS_WEG_CVW300_CALIBRATION_HPP
+#define MOTORS_WEG_CVW300_CALIBRATION_HPP
+
+#include <base/Time.hpp>
+#include <vector>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Parameters of the interframe delay calibration
+     *
+     * @see Driver::calibrateInterframeDelay
+     */
+    struct InterframeDelayCalibrationSettings {
+        /** Delay the calibration starts from */
+        base::Time start = base::Time::fromMilliseconds(20);
+        /** Amount by which the delay is decreased at each step */
+        base::Time step = base::Time::fromMilliseconds(1);
+        /** Lowest delay that will be tested */
+        base::Time min = base::Time::fromMilliseconds(1);
+        /** Number of transactions done at each step */
+        int transactions_per_step = 50;
+        /** Ratio of failed transactions above which a delay is deemed unsafe */
+        float max_error_rate = 0;
+        /** Margin added to the smallest safe delay to get the recommended one */
+        base::Time margin = base::Time::fromMilliseconds(2);
+    };
+
+    /** Result of a single calibration step */
+    struct InterframeDelayCalibrationStep {
+        base::Time delay;
+        int transactions = 0;
+        /** Transactions that failed because of a timeout */
+        int timeouts = 0;
+        /** Transactions that failed for any other reason (CRC, exception
+         * reply, unexpected reply)
+         */
+        int errors = 0;
+
+        float getErrorRate() const;
+    };
+
+    /** Result of the interframe delay calibration */
+    struct InterframeDelayCalibrationResult {
+        std::vector<InterframeDelayCalibrationStep> steps;
+
+        /** Smallest delay that was tested without errors above the threshold
+         *
+         * Null if even the start delay was unsafe
+         */
+        base::Time smallest_safe;
+
+        /** Smallest safe delay plus the calibration margin
+         *
+         * Null if even the start delay was unsafe
+         */
+        base::Time recommended;
+
+        /** Whether a safe delay was found */
+        bool success = false;
+    };
+}
+
+#endif
@@ -0,0 +1,151 @@
+#include <motors_weg_cvw300/ControlLoop.hpp>
+#include <motors_weg_cvw300/Driver.hpp>
+#include <motors_weg_cvw300/PeriodicSchedule.hpp>
+#include <base/Float.hpp>
+#include <alloca.h>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace std;
+using namespace base;
+using namespace motors_weg_cvw300;
+
+static void applySchedulingSettings(ControlLoopSettings const& settings) {
+    if (settings.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(settings.cpu, &cpus);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (ret != 0) {
+            throw std::runtime_error("ControlLoop: cannot pin the loop to CPU " +
+                                     to_string(settings.cpu) + ": " + strerror(ret));
+        }
+    }
+
+    if (settings.priority > 0) {
+        sched_param param = {};
+        param.sched_priority = settings.priority;
+        int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret != 0) {
+            throw std::runtime_error("ControlLoop: cannot set the SCHED_FIFO priority "
+                                     "to " + to_string(settings.priority) + ": " +
+                                     strerror(ret));
+        }
+    }
+}
+
+/** Touch the stack pages that the loop will use
+ *
+ * Not inlined, so that the allocation is released when it returns
+ */
+__attribute__((noinline)) static void prefaultStack(size_t size) {
+    volatile uint8_t* stack = static_cast<volatile uint8_t*>(alloca(size));
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < size; i += page_size) {
+        stack[i] = 0;
+    }
+}
+
+ControlLoop::ControlLoop(Driver& driver)
+    : m_driver(driver)
+    , m_quit(false) {
+}
+
+ControlLoop::~ControlLoop() {
+    stop();
+}
+
+void ControlLoop::start(Callback callback, ControlLoopSettings const& settings) {
+    if (m_thread.joinable()) {
+        throw std::logic_error("ControlLoop::start: already running");
+    }
+    if (settings.period <= Time()) {
+        throw std::invalid_argument("ControlLoop::start: the period must be positive");
+    }
+
+    m_quit = false;
+    m_statistics.write(ControlLoopStatistics());
+    promise<void> started;
+    auto result = started.get_future();
+    m_thread = thread(&ControlLoop::loop, this, settings, callback, &started);
+    try {
+        result.get();
+    }
+    catch (...) {
+        m_thread.join();
+        throw;
+    }
+}
+
+void ControlLoop::requestStop() {
+    m_quit = true;
+}
+
+void ControlLoop::stop() {
+    requestStop();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+bool ControlLoop::isRunning() const {
+    return m_thread.joinable();
+}
+
+ControlLoopStatistics ControlLoop::getStatistics() {
+    return m_statistics.read();
+}
+
+void ControlLoop::loop(ControlLoopSettings settings, Callback callback,
+                       promise<void>* started) {
+    try {
+        applySchedulingSettings(settings);
+        prefaultStack(settings.stack_prefault_size);
+    }
+    catch (...) {
+        started->set_exception(current_exception());
+        return;
+    }
+    // 'started' is invalid once the promise has been fulfilled
+    started->set_value();
+
+    ControlLoopStatistics statistics;
+    PeriodicSchedule schedule(settings.period);
+    int64_t last_wakeup = schedule.getStart();
+    while (!m_quit) {
+        int64_t deadline = schedule.getDeadline();
+        int64_t wakeup = schedule.waitDeadline();
+        statistics.jitter.add(PeriodicSchedule::toTime(wakeup - deadline));
+        if (schedule.getCycle() > 0) {
+            statistics.period.add(PeriodicSchedule::toTime(wakeup - last_wakeup));
+        }
+        last_wakeup = wakeup;
+
+        try {
+            CurrentState state = m_driver.readCurrentState();
+            float command = callback(state);
+            if (!base::isUnknown(command)) {
+                m_driver.writeSpeedCommand(command);
+            }
+        }
+        catch (std::runtime_error const&) {
+            statistics.errors++;
+        }
+        catch (...) {
+            // Anything else is a bug or a resource exhaustion. Stop instead
+            // of letting it terminate the process
+            statistics.errors++;
+            statistics.aborted = true;
+            m_quit = true;
+        }
+
+        int64_t end = PeriodicSchedule::now();
+        statistics.cycles++;
+        statistics.duration.add(PeriodicSchedule::toTime(end - wakeup));
+        statistics.missed_deadlines += schedule.next(end);
+        m_statistics.write(statistics);
+    }
+}
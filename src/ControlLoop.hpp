@@ -0,0 +1,148 @@
+#ifndef MOTORS_WEG_CVW300_CONTROLLOOP_HPP
+#define MOTORS_WEG_CVW300_CONTROLLOOP_HPP
+
+#include <base/Time.hpp>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <motors_weg_cvw300/CurrentState.hpp>
+#include <motors_weg_cvw300/Statistics.hpp>
+#include <motors_weg_cvw300/TripleBuffer.hpp>
+#include <thread>
+
+namespace motors_weg_cvw300 {
+    class Driver;
+
+    /** @see ControlLoop::start */
+    struct ControlLoopSettings {
+        base::Time period = base::Time::fromMilliseconds(50);
+
+        /** SCHED_FIFO priority of the loop thread
+         *
+         * Zero keeps the default scheduling policy. Real-time priorities
+         * usually require CAP_SYS_NICE or an adequate RLIMIT_RTPRIO
+         */
+        int priority = 0;
+
+        /** CPU the loop thread is pinned to, -1 to let it run on any CPU */
+        int cpu = -1;
+
+        /** Size of the stack that is touched before the loop starts
+         *
+         * This avoids page faults on the first cycles. It is only a
+         * guarantee for the rest of the run if the application locks its
+         * memory with mlockall(MCL_CURRENT | MCL_FUTURE)
+         */
+        size_t stack_prefault_size = 64 * 1024;
+    };
+
+    /** Timing of a control loop */
+    struct ControlLoopStatistics {
+        /** Number of cycles executed */
+        uint64_t cycles = 0;
+
+        /** Number of cycles that were skipped because the previous one ended
+         * after their deadline
+         */
+        uint64_t missed_deadlines = 0;
+
+        /** Number of cycles in which the driver or the callback failed */
+        uint64_t errors = 0;
+
+        /** Whether the loop stopped because the driver or the callback threw
+         * something else than a std::runtime_error
+         */
+        bool aborted = false;
+
+        /** Time between the wakeups of two consecutive cycles */
+        LatencyHistogram period;
+
+        /** Delay between the deadline of a cycle and its actual wakeup */
+        LatencyHistogram jitter;
+
+        /** Duration of the cycles, from wakeup to the end of the command
+         * write
+         */
+        LatencyHistogram duration;
+    };
+
+    /**
+     * Periodic execution of a control callback on a driver
+     *
+     * Each cycle reads the motor state with Driver::readCurrentState, passes
+     * it to the callback and writes the speed command it returns with
+     * Driver::writeSpeedCommand. The cycles are scheduled on absolute
+     * deadlines of the monotonic clock, so that the period does not drift
+     * with the time spent on the bus. A cycle whose deadline has passed
+     * when the previous one ends is skipped.
+     *
+     * The loop runs in its own thread. The driver must not be used by
+     * other threads for anything that changes its configuration while the
+     * loop is running.
+     */
+    class ControlLoop {
+    public:
+        /** The control callback
+         *
+         * It receives the motor state read at the beginning of the cycle,
+         * and returns the speed command in rad/s. Return base::unknown<float>()
+         * to skip the command write.
+         *
+         * Errors are reported by throwing std::runtime_error. They are
+         * counted in ControlLoopStatistics::errors and the loop continues
+         * with the next cycle. Any other exception is counted as well, but
+         * stops the loop and sets ControlLoopStatistics::aborted. The loop
+         * may be stopped from the callback with @c requestStop
+         */
+        typedef std::function<float(CurrentState const& state)> Callback;
+
+    private:
+        Driver& m_driver;
+        std::thread m_thread;
+        std::atomic<bool> m_quit;
+        TripleBuffer<ControlLoopStatistics> m_statistics;
+
+        void loop(ControlLoopSettings settings, Callback callback,
+                  std::promise<void>* started);
+
+    public:
+        explicit ControlLoop(Driver& driver);
+        ~ControlLoop();
+
+        /** Start the loop thread
+         *
+         * The scheduling settings are applied before this method returns
+         *
+         * @throw std::logic_error if the loop is already running
+         * @throw std::runtime_error if the priority or affinity could not
+         *   be set. The loop is not running in this case
+         */
+        void start(Callback callback,
+                   ControlLoopSettings const& settings = ControlLoopSettings());
+
+        /** Make the loop stop at the end of the current cycle
+         *
+         * Unlike @c stop, it does not wait for the thread to finish, and can
+         * therefore be called from the callback
+         */
+        void requestStop();
+
+        /** Stop the loop and wait for its thread to finish */
+        void stop();
+
+        /** Whether the loop thread has been started and not yet stopped
+         *
+         * The loop may have finished after a call to @c requestStop
+         */
+        bool isRunning() const;
+
+        /** The statistics of the current or last run
+         *
+         * It can only be called from a single thread at a time
+         */
+        ControlLoopStatistics getStatistics();
+    };
+}
+
+#endif
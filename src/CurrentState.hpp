@@ -2,23 +2,131 @@
 #define MOTORS_WEG_CVW300_CURRENTSTATE_HPP
 
 #include <motors_weg_cvw300/InverterStatus.hpp>
+#include <base/Float.hpp>
 #include <base/JointState.hpp>
+#include <base/Time.hpp>
+#include <cstdint>
 
 namespace motors_weg_cvw300 {
+    /**
+     * Groups of CurrentState fields, to be combined in a telemetry profile
+     *
+     * The profile selects which registers Driver::readCurrentState reads.
+     * The fields that are not part of it are left unknown (or
+     * STATUS_UNKNOWN for the inverter status).
+     *
+     * @see Driver::setTelemetryProfile
+     */
+    enum TelemetryField {
+        /** motor.speed, as well as the encoder fields when the driver uses
+         * the encoder feedback
+         *
+         * The direction of the speed is derived from the signs of the current
+         * and torque, which are therefore always read with it
+         */
+        TELEMETRY_SPEED = 0x01,
+        /** motor.raw */
+        TELEMETRY_CURRENT = 0x02,
+        /** motor.effort */
+        TELEMETRY_TORQUE = 0x04,
+        /** battery_voltage, inverter_output_voltage and
+         * inverter_output_frequency
+         */
+        TELEMETRY_ELECTRICAL = 0x08,
+        /** inverter_status */
+        TELEMETRY_STATUS = 0x10,
+        /** motor_overload_ratio */
+        TELEMETRY_OVERLOAD = 0x20,
+        /** current_fault and current_alarm
+         *
+         * Not part of the predefined profiles. Add it to the profile to
+         * monitor the faults without separate reads (see FaultMonitor)
+         */
+        TELEMETRY_FAULT = 0x40,
+
+        /** Speed only, the smallest read */
+        TELEMETRY_PROFILE_SPEED = TELEMETRY_SPEED,
+        /** Speed, current and torque. Costs the same as the speed alone */
+        TELEMETRY_PROFILE_MOTION = TELEMETRY_SPEED | TELEMETRY_CURRENT |
+                                   TELEMETRY_TORQUE,
+        /** Everything except the motor overload, which needs a second frame
+         * at low baud rates
+         */
+        TELEMETRY_PROFILE_ELECTRICAL = TELEMETRY_PROFILE_MOTION |
+                                       TELEMETRY_ELECTRICAL | TELEMETRY_STATUS,
+        /** All the fields except TELEMETRY_FAULT (the default) */
+        TELEMETRY_PROFILE_FULL = TELEMETRY_PROFILE_ELECTRICAL | TELEMETRY_OVERLOAD
+    };
+
     /**
      * Current parameters of the motor and inverter
      */
     struct CurrentState {
+        /** Estimated time at which the controller sampled the motor state
+         *
+         * This is the midpoint between @c request_time and @c reply_time of
+         * the frame that contains the motor speed. Use it rather than the
+         * time at which the state is received to compensate for the
+         * transport delay
+         */
+        base::Time time;
+
+        /** Time at which the first request of the read was sent */
+        base::Time request_time;
+
+        /** Time at which the last reply of the read was received */
+        base::Time reply_time;
+
+        /** Incremented by the driver on each state read
+         *
+         * A gap in the sequence means that a read failed
+         */
+        uint64_t sequence = 0;
+
         base::JointState motor;
 
-        float battery_voltage;
-        float inverter_output_voltage;
-        float inverter_output_frequency;
+        /** Encoder tick count, unwrapped across the 16-bit counter overflows
+         *
+         * Only updated when the driver uses the encoder feedback
+         */
+        int64_t encoder_ticks = 0;
+
+        /** Multi-turn encoder position in radians
+         *
+         * Unknown if the driver does not use the encoder feedback, or if the
+         * encoder scale is zero
+         */
+        double encoder_position = base::unknown<double>();
+
+        /** Encoder velocity in rad/s, estimated from the tick count
+         * difference between the last two reads
+         *
+         * This has a much finer resolution than motor.speed, which is
+         * reported by the controller in rpm. Unknown until two states have
+         * been read with the encoder feedback, or if the encoder scale is zero
+         */
+        float encoder_velocity = base::unknown<float>();
+
+        float battery_voltage = base::unknown<float>();
+        float inverter_output_voltage = base::unknown<float>();
+        float inverter_output_frequency = base::unknown<float>();
 
         /** Motor overload in percent (between 0 and 1) */
-        float motor_overload_ratio;
+        float motor_overload_ratio = base::unknown<float>();
+
+        InverterStatus inverter_status = STATUS_UNKNOWN;
+
+        /** Code of the current fault, zero if there is none
+         *
+         * -1 if TELEMETRY_FAULT is not part of the telemetry profile
+         */
+        int current_fault = -1;
 
-        InverterStatus inverter_status;
+        /** Code of the current alarm, zero if there is none
+         *
+         * -1 if TELEMETRY_FAULT is not part of the telemetry profile
+         */
+        int current_alarm = -1;
     };
 }
 
@@ -1,24 +1,289 @@
 #include <motors_weg_cvw300/Driver.hpp>
 #include <base/Angle.hpp>
 #include <modbus/RTU.hpp>
+#include <iodrivers_base/Exceptions.hpp>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
 
 using namespace std;
 using namespace base;
 using namespace motors_weg_cvw300;
+using namespace motors_weg_cvw300::registers;
 
 Driver::Driver(int address)
-    : m_address(address) {
+    : m_bus(*this)
+    , m_address(address)
+    , m_bus_mutex(m_own_bus_mutex) {
     // default of 7ms is too low for the weg controller at 57600
     setInterframeDelay(base::Time::fromMilliseconds(20));
 }
 
-MotorRatings Driver::readMotorRatings() {
+Driver::Driver(modbus::Master& bus, mutex& bus_mutex, int address)
+    : m_bus(bus)
+    , m_address(address)
+    , m_bus_mutex(bus_mutex) {
+}
+
+Driver::~Driver() {
+    stopPolling();
+}
+
+int Driver::getAddress() const {
+    return m_address;
+}
+
+void Driver::openURI(string const& uri) {
+    checkOwnsBus("openURI");
+    modbus::Master::openURI(uri);
+}
+
+template<typename T>
+uint16_t encodeRegister(T value);
+
+template<> uint16_t encodeRegister(uint16_t value) {
+    return value;
+}
+
+template<> uint16_t encodeRegister(int16_t value) {
+    return reinterpret_cast<uint16_t&>(value);
+}
+
+template<> uint16_t encodeRegister(float value) {
+    return encodeRegister<int16_t>(value);
+}
+
+class Driver::OperationScope {
+    Driver& m_driver;
+    DriverOperation m_operation;
+    bool m_active;
+    Time m_start;
+    int m_uncaught_exceptions;
+    OperationScope* m_previous;
+
+    /** Innermost active scope of the calling thread */
+    static thread_local OperationScope* s_current;
+
+public:
+    /** Start an operation
+     *
+     * The scope does nothing if it is nested in another scope of the same
+     * driver, so that e.g. the transactions of readCurrentAlarm are
+     * attributed to calibrateInterframeDelay when it calls it
+     */
+    OperationScope(Driver& driver, DriverOperation operation)
+        : m_driver(driver)
+        , m_operation(operation)
+        , m_active(current(driver) == OPERATION_COUNT)
+        , m_start(Time::now())
+        , m_uncaught_exceptions(uncaught_exceptions())
+        , m_previous(s_current) {
+        if (m_active) {
+            s_current = this;
+        }
+    }
+
+    ~OperationScope() {
+        if (!m_active) {
+            return;
+        }
+        s_current = m_previous;
+        bool failed = uncaught_exceptions() > m_uncaught_exceptions;
+        m_driver.m_statistics.recordCall(m_operation, failed, Time::now() - m_start);
+    }
+
+    /** The operation being executed by the calling thread on a driver
+     *
+     * @return the operation, or OPERATION_COUNT if there is none
+     */
+    static DriverOperation current(Driver const& driver) {
+        for (auto scope = s_current; scope; scope = scope->m_previous) {
+            if (&scope->m_driver == &driver) {
+                return scope->m_operation;
+            }
+        }
+        return OPERATION_COUNT;
+    }
+};
+
+thread_local Driver::OperationScope* Driver::OperationScope::s_current = nullptr;
+
+template<typename F>
+void Driver::transaction(bool write, int start, int length, F f, bool retry) {
+    DriverOperation operation = OperationScope::current(*this);
+    lock_guard<mutex> lock(m_bus_mutex);
+    Time start_time = Time::now();
+    auto record = [&](StatisticsRecorder::Outcome outcome) {
+        m_statistics.recordTransaction(operation, write, start, length, outcome,
+                                       Time::now() - start_time, retry);
+    };
+
+    try {
+        f();
+    }
+    catch (iodrivers_base::TimeoutError const&) {
+        record(StatisticsRecorder::TIMEOUT);
+        throw;
+    }
+    catch (modbus::RTU::InvalidCRC const&) {
+        record(StatisticsRecorder::CRC_ERROR);
+        throw;
+    }
+    catch (modbus::RequestException const&) {
+        record(StatisticsRecorder::EXCEPTION);
+        throw;
+    }
+    catch (...) {
+        record(StatisticsRecorder::OTHER_ERROR);
+        throw;
+    }
+    record(StatisticsRecorder::SUCCESS);
+}
+
+DriverStatistics Driver::getStatistics() const {
+    return m_statistics.get();
+}
+
+void Driver::resetStatistics() {
+    m_statistics.reset();
+}
+
+bool Driver::isBusShared() const {
+    return &m_bus != this;
+}
+
+void Driver::checkOwnsBus(char const* method) const {
+    if (isBusShared()) {
+        throw std::logic_error(string(method) + ": the bus is shared, its "
+                               "configuration is handled by the BusScheduler");
+    }
+}
+
+void Driver::checkNotPolling(char const* method) const {
+    if (isPolling()) {
+        throw std::logic_error(string(method) + ": cannot change the driver "
+                               "configuration while polling");
+    }
+}
+
+void Driver::setInterframeDelay(base::Time const& delay) {
+    checkOwnsBus("setInterframeDelay");
+    checkNotPolling("setInterframeDelay");
+    m_bus.setInterframeDelay(delay);
+    m_cost_model.interframe_delay = delay;
+}
+
+void Driver::syncInterframeDelay(base::Time const& delay) {
+    checkNotPolling("setInterframeDelay");
+    m_cost_model.interframe_delay = delay;
+}
+
+void Driver::setBaudRate(int baud_rate) {
+    checkNotPolling("setBaudRate");
+    m_cost_model.baud_rate = baud_rate;
+}
+
+BusCostModel Driver::getBusCostModel() const {
+    return m_cost_model;
+}
+
+InterframeDelayCalibrationResult Driver::calibrateInterframeDelay(
+    InterframeDelayCalibrationSettings const& settings
+) {
+    checkOwnsBus("calibrateInterframeDelay");
+    checkNotPolling("calibrateInterframeDelay");
+    OperationScope scope(*this, OPERATION_CALIBRATE_INTERFRAME_DELAY);
+    Time previous_delay = m_cost_model.interframe_delay;
+    InterframeDelayCalibrationResult result;
+    for (Time delay = settings.start; delay >= settings.min;
+         delay = delay - settings.step) {
+        setInterframeDelay(delay);
+
+        InterframeDelayCalibrationStep step;
+        step.delay = delay;
+        for (int i = 0; i < settings.transactions_per_step; ++i) {
+            step.transactions++;
+            try {
+                readCurrentAlarm();
+            }
+            catch (iodrivers_base::TimeoutError const&) {
+                step.timeouts++;
+            }
+            catch (std::runtime_error const&) {
+                step.errors++;
+            }
+        }
+        result.steps.push_back(step);
+
+        if (step.getErrorRate() > settings.max_error_rate) {
+            break;
+        }
+        result.smallest_safe = delay;
+        if (settings.step.isNull()) {
+            break;
+        }
+    }
+
+    // Even the start delay failed, so none of the tested delays can be used
+    if (result.smallest_safe.isNull()) {
+        setInterframeDelay(previous_delay);
+        return result;
+    }
+
+    result.success = true;
+    result.recommended = result.smallest_safe + settings.margin;
+    setInterframeDelay(result.recommended);
+    return result;
+}
+
+Time Driver::estimateCurrentStateReadCost() const {
+    ReadPlan plan;
+    addCurrentStateRegisters(plan);
+    compile(plan);
+    return plan.estimateCost(m_cost_model);
+}
+
+void Driver::excludeRegisters(int start, int length) {
+    checkNotPolling("excludeRegisters");
+    m_excluded_registers.push_back(ReadPlan::Block{ start, length });
+}
+
+void Driver::compile(ReadPlan& plan) const {
+    for (auto const& range : m_excluded_registers) {
+        plan.exclude(range.start, range.length);
+    }
+    plan.compile(m_cost_model);
+}
+
+void Driver::read(ReadPlan& plan) {
+    compile(plan);
+    for (auto const& block : plan.getBlocks()) {
+        ReadPlan::Timing timing;
+        transaction(false, block.start, block.length, [&] {
+            timing.request = Time::now();
+            m_bus.readRegisters(plan.getBlockBuffer(block), m_address, false,
+                                block.start, block.length);
+            timing.reply = Time::now();
+        });
+        plan.setTiming(block, timing);
+    }
+}
+
+void Driver::addMotorRatingsRegisters(ReadPlan& plan) const {
+    plan.add(MOTOR_NOMINAL_CURRENT.id);
+    plan.add(MOTOR_NOMINAL_SPEED.id);
+    plan.add(MOTOR_NOMINAL_POWER.id);
+    plan.add(ENCODER_COUNT.id);
+}
+
+MotorRatings Driver::decodeMotorRatings(ReadPlan const& plan) const {
     MotorRatings ratings = m_ratings;
-    ratings.encoder_count = readSingleRegister<uint16_t>(R_ENCODER_COUNT);
-    ratings.current = readSingleRegister<float>(R_MOTOR_NOMINAL_CURRENT) / 10;
-    ratings.speed =
-        readSingleRegister<float>(R_MOTOR_NOMINAL_SPEED) * 2 * M_PI / 60;
-    int rated_power_i = readSingleRegister<uint16_t>(R_MOTOR_NOMINAL_POWER);
+    ratings.encoder_count = decode<uint16_t>(ENCODER_COUNT, plan);
+    ratings.current = decode(MOTOR_NOMINAL_CURRENT, plan);
+    ratings.speed = decode(MOTOR_NOMINAL_SPEED, plan);
+    int rated_power_i = decode<int>(MOTOR_NOMINAL_POWER, plan);
     if (rated_power_i == 0) {
         ratings.power = 3000;
     }
@@ -34,11 +299,107 @@ MotorRatings Driver::readMotorRatings() {
     }
 
     ratings.torque = ratings.power / ratings.speed;
-    m_ratings = ratings;
     return ratings;
 }
 
+MotorRatings Driver::readMotorRatings() {
+    checkNotPolling("readMotorRatings");
+    OperationScope scope(*this, OPERATION_READ_MOTOR_RATINGS);
+    ReadPlan plan;
+    addMotorRatingsRegisters(plan);
+    read(plan);
+
+    m_ratings = decodeMotorRatings(plan);
+    return m_ratings;
+}
+
+/** Fill the blocks of a compiled plan from a ratings cache
+ *
+ * The cache is a text file made of the time at which it was written in
+ * microseconds, followed by one "REGISTER VALUE" pair per line.
+ *
+ * @return false if the cache does not exist, is older than max_age or does not
+ *   contain all the registers of the plan
+ */
+static bool loadMotorRatingsCache(string const& path, Time const& max_age,
+                                  ReadPlan& plan) {
+    ifstream in(path);
+    int64_t time_us;
+    if (!(in >> time_us)) {
+        return false;
+    }
+    Time age = Time::now() - Time::fromMicroseconds(time_us);
+    if (age < Time() || age > max_age) {
+        return false;
+    }
+
+    map<int, uint16_t> values;
+    int register_id;
+    uint16_t value;
+    while (in >> register_id >> value) {
+        values[register_id] = value;
+    }
+    for (auto const& block : plan.getBlocks()) {
+        uint16_t* buffer = plan.getBlockBuffer(block);
+        for (int i = 0; i < block.length; ++i) {
+            auto it = values.find(block.start + i);
+            if (it == values.end()) {
+                return false;
+            }
+            buffer[i] = it->second;
+        }
+    }
+    return true;
+}
+
+static void saveMotorRatingsCache(string const& path, ReadPlan& plan) {
+    error_code ec;
+    filesystem::create_directories(filesystem::path(path).parent_path(), ec);
+
+    // Write then rename, so that a concurrent reader never sees a partial file
+    string tmp_path = path + ".tmp";
+    {
+        ofstream out(tmp_path);
+        out << Time::now().toMicroseconds() << "\n";
+        for (auto const& block : plan.getBlocks()) {
+            uint16_t const* buffer = plan.getBlockBuffer(block);
+            for (int i = 0; i < block.length; ++i) {
+                out << block.start + i << " " << buffer[i] << "\n";
+            }
+        }
+        if (!out.flush()) {
+            filesystem::remove(tmp_path, ec);
+            return;
+        }
+    }
+    filesystem::rename(tmp_path, path, ec);
+}
+
+MotorRatings Driver::readMotorRatings(string const& cache_path, Time const& max_age) {
+    checkNotPolling("readMotorRatings");
+    OperationScope scope(*this, OPERATION_READ_MOTOR_RATINGS);
+    ReadPlan plan;
+    addMotorRatingsRegisters(plan);
+    compile(plan);
+    // A cache that cannot be decoded is handled as a miss, and overwritten
+    // with the values read from the controller
+    try {
+        if (loadMotorRatingsCache(cache_path, max_age, plan)) {
+            m_ratings = decodeMotorRatings(plan);
+            return m_ratings;
+        }
+    }
+    catch (std::exception const&) {
+    }
+
+    read(plan);
+    m_ratings = decodeMotorRatings(plan);
+    saveMotorRatingsCache(cache_path, plan);
+    return m_ratings;
+}
+
 void Driver::setEncoderScale(uint16_t scale) {
+    checkNotPolling("setEncoderScale");
     m_ratings.encoder_scale = scale;
 }
 
@@ -47,48 +408,60 @@ MotorRatings Driver::getMotorRatings() const {
 }
 
 void Driver::setMotorRatings(MotorRatings const& ratings) {
+    checkNotPolling("setMotorRatings");
     m_ratings = ratings;
 }
 
 void Driver::setUseEncoderFeedback(bool use) {
+    checkNotPolling("setUseEncoderFeedback");
+    if (use && !m_use_encoder_feedback) {
+        resetEncoderTracking();
+    }
     m_use_encoder_feedback = use;
 }
 
+void Driver::resetEncoderTracking() {
+    lock_guard<mutex> lock(m_encoder_mutex);
+    m_encoder_tracker.reset();
+}
+
 bool Driver::getUseEncoderFeedback() const {
     return m_use_encoder_feedback;
 }
 
 void Driver::prepare() {
-    writeSingleRegister<int16_t>(R_REM_REFERENCE_SELECTION,
-                                 configuration::REFERENCE_SERIAL);
-    writeSingleRegister<int16_t>(R_REM_DIRECTION_SELECTION,
-                                 configuration::DIRECTION_SERIAL_CW);
-    writeSingleRegister<int16_t>(R_REM_RUN_STOP_SELECTION,
-                                 configuration::RUN_STOP_SERIAL);
-    writeSingleRegister<int16_t>(R_REM_JOG_SELECTION, 0);
-    writeSingleRegister<int16_t>(R_SERIAL_REFERENCE_SPEED, 0);
-    writeSingleRegister<int16_t>(
-        R_SERIAL_STATUS_WORD,
+    OperationScope scope(*this, OPERATION_PREPARE);
+    writeConfigurationRegister(REM_REFERENCE_SELECTION,
+                               configuration::REFERENCE_SERIAL);
+    writeConfigurationRegister(REM_DIRECTION_SELECTION,
+                               configuration::DIRECTION_SERIAL_CW);
+    writeConfigurationRegister(REM_RUN_STOP_SELECTION,
+                               configuration::RUN_STOP_SERIAL);
+    writeConfigurationRegister(REM_JOG_SELECTION, 0);
+    writeControlAndReference(
         configuration::SERIAL_MODE_REMOTE |
-        configuration::SERIAL_RESET_FAULT
+        configuration::SERIAL_RESET_FAULT,
+        0
     );
 }
 
 void Driver::resetFault() {
-    writeSingleRegister<int16_t>(
-        R_SERIAL_STATUS_WORD,
+    OperationScope scope(*this, OPERATION_RESET_FAULT);
+    writeRegister(
+        SERIAL_STATUS_WORD,
         configuration::SERIAL_MODE_REMOTE |
         configuration::SERIAL_RESET_FAULT
     );
-    writeSingleRegister<int16_t>(
-        R_SERIAL_STATUS_WORD,
+    writeRegister(
+        SERIAL_STATUS_WORD,
         configuration::SERIAL_MODE_REMOTE
     );
 }
 
 void Driver::enable() {
-    writeSingleRegister<int16_t>(
-        R_SERIAL_STATUS_WORD,
+    OperationScope scope(*this, OPERATION_ENABLE);
+    writeRegister(
+        SERIAL_STATUS_WORD,
         configuration::SERIAL_CONTROL_ON |
         configuration::SERIAL_GENERAL |
         configuration::SERIAL_DIRECTION_POSITIVE |
@@ -96,26 +469,82 @@ void Driver::enable() {
     );
 }
 
-void Driver::disable() {
-    writeSingleRegister<int16_t>(R_SERIAL_REFERENCE_SPEED, 0);
-    writeSingleRegister<int16_t>(
-        R_SERIAL_STATUS_WORD,
-        configuration::SERIAL_MODE_REMOTE
+void Driver::enable(float command) {
+    OperationScope scope(*this, OPERATION_ENABLE);
+    writeControlAndReference(
+        configuration::SERIAL_CONTROL_ON |
+        configuration::SERIAL_GENERAL |
+        configuration::SERIAL_DIRECTION_POSITIVE |
+        configuration::SERIAL_MODE_REMOTE,
+        scaleSpeedCommand(command)
     );
 }
 
+void Driver::disable() {
+    OperationScope scope(*this, OPERATION_DISABLE);
+    writeControlAndReference(configuration::SERIAL_MODE_REMOTE, 0);
+}
+
+void Driver::writeControlAndReference(uint16_t control, int16_t reference) {
+    vector<uint16_t> values = { control, encodeRegister<int16_t>(reference) };
+    m_last_reference_known = false;
+    transaction(true, SERIAL_STATUS_WORD.id, values.size(), [&] {
+        m_bus.writeRegisters(m_address, SERIAL_STATUS_WORD.id, values);
+    });
+    setLastReference(reference);
+}
+
+void Driver::setLastReference(int16_t reference) {
+    m_last_reference_known = true;
+    m_last_reference = reference;
+    m_last_reference_time = Time::now();
+}
+
+bool Driver::needsReferenceWrite(int16_t reference) const {
+    if (!m_speed_command_suppression || !m_serial_watchdog_known ||
+        !m_last_reference_known || m_last_reference != reference) {
+        return true;
+    }
+    else if (m_serial_watchdog.isNull()) {
+        return false;
+    }
+
+    Time keepalive = m_serial_watchdog - m_speed_command_keepalive_margin;
+    return Time::now() - m_last_reference_time >= keepalive;
+}
+
+void Driver::setSpeedCommandSuppression(bool enable, Time const& margin) {
+    m_speed_command_suppression = enable;
+    m_speed_command_keepalive_margin = margin;
+}
+
+uint64_t Driver::getSuppressedSpeedCommandCount() const {
+    return m_suppressed_speed_commands;
+}
+
 void Driver::writeSerialWatchdog(base::Time const& time,
                                  configuration::CommunicationErrorAction action) {
-    writeSingleRegister<uint16_t>(R_SERIAL_ERROR_ACTION, action);
-    writeSingleRegister<float>(R_SERIAL_WATCHDOG, time.toSeconds() * 10);
+    OperationScope scope(*this, OPERATION_WRITE_SERIAL_WATCHDOG);
+    m_serial_watchdog_known = false;
+    writeConfigurationRegister(SERIAL_ERROR_ACTION, action);
+    writeConfigurationRegister(SERIAL_WATCHDOG, time.toSeconds());
+    m_serial_watchdog_known = true;
+    m_serial_watchdog =
+        (action == configuration::INACTIVE) ? base::Time() : time;
 }
 
 void Driver::configSave() {
+    OperationScope scope(*this, OPERATION_CONFIG_SAVE);
     for (int i = 0; i < 3; ++i) {
         // Writing this causes an invalid CRC, and then re-reading it fails as
         // well. Write it three times blindly :(
+        //
+        // The CRC errors are expected, but are still counted in the
+        // statistics, and the two last writes are counted as retries
         try {
-            modbus::Master::writeSingleRegister(m_address, R_CONFIG_SAVE, 1);
+            transaction(true, CONFIG_SAVE.id, 1, [&] {
+                m_bus.writeSingleRegister(m_address, CONFIG_SAVE.id, 1);
+            }, i > 0);
         }
         catch (modbus::RTU::InvalidCRC const&) {
         }
@@ -124,52 +553,104 @@ void Driver::configSave() {
 }
 
 template<typename T>
-uint16_t encodeRegister(T value);
-
-template<> uint16_t encodeRegister(uint16_t value) {
-    return value;
+void Driver::writeSingleRegister(int register_id, T value) {
+    OperationScope scope(*this, OPERATION_WRITE_SINGLE_REGISTER);
+    uint16_t raw = encodeRegister<T>(value);
+    // The register value is unknown until the write succeeds
+    m_shadow_registers.erase(register_id);
+    transaction(true, register_id, 1, [&] {
+        m_bus.writeSingleRegister(m_address, register_id, raw);
+    });
+    if (isShadowRegister(register_id)) {
+        m_shadow_registers[register_id] = raw;
+    }
 }
 
-template<> uint16_t encodeRegister(int16_t value) {
-    return reinterpret_cast<uint16_t&>(value);
+template void Driver::writeSingleRegister<uint16_t>(int, uint16_t);
+
+void Driver::writeRegisters(int start, vector<uint16_t> const& values) {
+    OperationScope scope(*this, OPERATION_WRITE_REGISTERS);
+    int length = values.size();
+    for (int id = start; id < start + length; ++id) {
+        m_shadow_registers.erase(id);
+    }
+    transaction(true, start, length, [&] {
+        m_bus.writeRegisters(m_address, start, values);
+    });
+    for (int i = 0; i < length; ++i) {
+        if (isShadowRegister(start + i)) {
+            m_shadow_registers[start + i] = values[i];
+        }
+    }
 }
 
-template<> uint16_t encodeRegister(float value) {
-    return encodeRegister<int16_t>(value);
+void Driver::readRegisters(uint16_t* values, int start, int length) {
+    OperationScope scope(*this, OPERATION_READ_REGISTERS);
+    transaction(false, start, length, [&] {
+        m_bus.readRegisters(values, m_address, false, start, length);
+    });
 }
 
-template<typename T>
-T decodeRegister(uint16_t value);
+void Driver::writeRegister(Register const& r, double value) {
+    writeSingleRegister<uint16_t>(r.id, encode(r, value));
+}
 
-template<> uint16_t decodeRegister(uint16_t value) {
-    return value;
+void Driver::writeConfigurationRegister(Register const& r, double value) {
+    auto shadow = m_shadow_registers.find(r.id);
+    if (shadow != m_shadow_registers.end() &&
+        shadow->second == encode(r, value)) {
+        m_skipped_configuration_writes++;
+        return;
+    }
+    writeRegister(r, value);
 }
 
-template<> int16_t decodeRegister(uint16_t value) {
-    return reinterpret_cast<int16_t&>(value);
+const int Driver::SHADOW_REGISTERS[] = {
+    RAMP_ACCELERATION_TIME.id, RAMP_DECELERATION_TIME.id, RAMP_TYPE.id,
+    MAX_SPEED_REFERENCE.id, MAX_FORWARD_TORQUE.id, MAX_REVERSE_TORQUE.id,
+    CONTROL_TYPE.id, REM_REFERENCE_SELECTION.id, REM_DIRECTION_SELECTION.id,
+    REM_RUN_STOP_SELECTION.id, REM_JOG_SELECTION.id, SERIAL_ERROR_ACTION.id,
+    SERIAL_WATCHDOG.id
+};
+
+bool Driver::isShadowRegister(int register_id) const {
+    return m_shadow_registers_valid &&
+           find(begin(SHADOW_REGISTERS), end(SHADOW_REGISTERS), register_id) !=
+               end(SHADOW_REGISTERS);
 }
 
-template<> float decodeRegister(uint16_t value) {
-    return static_cast<float>(decodeRegister<int16_t>(value));
+void Driver::readConfigurationRegisters() {
+    OperationScope scope(*this, OPERATION_READ_CONFIGURATION_REGISTERS);
+    ReadPlan plan;
+    for (int register_id : SHADOW_REGISTERS) {
+        plan.add(register_id);
+    }
+    m_shadow_registers_valid = false;
+    m_shadow_registers.clear();
+    read(plan);
+
+    for (int register_id : SHADOW_REGISTERS) {
+        m_shadow_registers[register_id] = plan.get(register_id);
+    }
+    m_shadow_registers_valid = true;
 }
 
-template<typename T>
-T Driver::readSingleRegister(int register_id) {
-    uint16_t value = modbus::Master::readSingleRegister(m_address, false, register_id);
-    return decodeRegister<T>(value);
+void Driver::clearConfigurationRegisters() {
+    m_shadow_registers_valid = false;
+    m_shadow_registers.clear();
 }
 
-template<typename T>
-void Driver::writeSingleRegister(int register_id, T value) {
-    uint16_t raw = encodeRegister<T>(value);
-    modbus::Master::writeSingleRegister(m_address, register_id, raw);
+uint64_t Driver::getSkippedConfigurationWriteCount() const {
+    return m_skipped_configuration_writes;
 }
 
 void Driver::writeControlType(configuration::ControlType type) {
-    writeSingleRegister<int16_t>(R_CONTROL_TYPE, type);
+    OperationScope scope(*this, OPERATION_WRITE_CONTROL_TYPE);
+    writeConfigurationRegister(CONTROL_TYPE, type);
 }
 
 void Driver::writeJointLimits(base::JointLimitRange const& limits) {
+    OperationScope scope(*this, OPERATION_WRITE_JOINT_LIMITS);
     m_limits = limits;
 
     auto max = limits.max;
@@ -195,28 +676,40 @@ void Driver::writeJointLimits(base::JointLimitRange const& limits) {
                                         "having different limits for positive and "
                                         "negative movements");
         }
-        writeSingleRegister<uint16_t>(R_MAX_SPEED_REFERENCE,
-                                      max.speed * 60 / 2 / M_PI);
+        writeConfigurationRegister(MAX_SPEED_REFERENCE, max.speed);
     }
 
     if (max.hasEffort()) {
-        writeJointTorqueLimit(max.effort, R_MAX_FORWARD_TORQUE);
+        writeJointTorqueLimit(max.effort, MAX_FORWARD_TORQUE);
     }
     if (min.hasEffort()) {
-        writeJointTorqueLimit(min.effort, R_MAX_REVERSE_TORQUE);
+        writeJointTorqueLimit(min.effort, MAX_REVERSE_TORQUE);
     }
 }
 
-void Driver::writeSpeedCommand(float command) {
+int16_t Driver::scaleSpeedCommand(float command) const {
     if (base::isUnset(m_ratings.speed)) {
         throw std::invalid_argument("writeSpeedCommand: define the rated speed before "
                                     "attempting to send a speed command");
     }
-    int16_t scaled_command = 8192 * command / m_ratings.speed;
-    writeSingleRegister(R_SERIAL_REFERENCE_SPEED, scaled_command);
+    return 8192 * command / m_ratings.speed;
 }
 
-void Driver::writeJointTorqueLimit(float limit, int register_id) {
+bool Driver::writeSpeedCommand(float command) {
+    OperationScope scope(*this, OPERATION_WRITE_SPEED_COMMAND);
+    int16_t reference = scaleSpeedCommand(command);
+    if (!needsReferenceWrite(reference)) {
+        m_suppressed_speed_commands++;
+        return false;
+    }
+
+    m_last_reference_known = false;
+    writeSingleRegister(SERIAL_REFERENCE_SPEED.id, reference);
+    setLastReference(reference);
+    return true;
+}
+
+void Driver::writeJointTorqueLimit(float limit, Register const& r) {
     if (base::isUnknown(limit)) {
         return;
     }
@@ -225,106 +718,442 @@ void Driver::writeJointTorqueLimit(float limit, int register_id) {
                                     "before you can set a torque limit");
     }
 
-    writeSingleRegister<uint16_t>(register_id, std::abs(limit) / m_ratings.torque * 1000);
+    writeConfigurationRegister(r, std::abs(limit) / m_ratings.torque);
 }
 
 void Driver::writeRampConfiguration(configuration::Ramps const& ramps) {
-    writeSingleRegister<float>(R_RAMP_ACCELERATION_TIME,
+    OperationScope scope(*this, OPERATION_WRITE_RAMP_CONFIGURATION);
+    writeConfigurationRegister(RAMP_ACCELERATION_TIME,
                                ramps.acceleration_time.toSeconds());
-    writeSingleRegister<float>(R_RAMP_DECELERATION_TIME,
+    writeConfigurationRegister(RAMP_DECELERATION_TIME,
                                ramps.deceleration_time.toSeconds());
-    writeSingleRegister<uint16_t>(R_RAMP_TYPE, ramps.type);
+    writeConfigurationRegister(RAMP_TYPE, ramps.type);
 }
 
-CurrentState Driver::readCurrentState() {
-    uint16_t values[R_ENCODER_SPEED + 2];
+void Driver::addCurrentStateRegisters(ReadPlan& plan) const {
+    int profile = m_telemetry_profile;
+    if (profile & TELEMETRY_SPEED) {
+        plan.add(MOTOR_SPEED.id);
+        if (m_use_encoder_feedback) {
+            plan.add(ENCODER_SPEED.id);
+            plan.add(ENCODER_PULSE_COUNTER.id);
+        }
+    }
+    // The current and torque are needed to know the direction of the speed
+    if (profile & (TELEMETRY_SPEED | TELEMETRY_CURRENT)) {
+        plan.add(INVERTER_OUTPUT_CURRENT.id);
+    }
+    if (profile & (TELEMETRY_SPEED | TELEMETRY_TORQUE)) {
+        plan.add(MOTOR_TORQUE.id);
+    }
+    if (profile & TELEMETRY_ELECTRICAL) {
+        plan.add(BATTERY_VOLTAGE.id);
+        plan.add(INVERTER_OUTPUT_FREQUENCY.id);
+        plan.add(INVERTER_OUTPUT_VOLTAGE.id);
+    }
+    if (profile & TELEMETRY_STATUS) {
+        plan.add(INVERTER_STATUS.id);
+    }
+    if (profile & TELEMETRY_OVERLOAD) {
+        plan.add(MOTOR_OVERLOAD.id);
+    }
+    if (profile & TELEMETRY_FAULT) {
+        plan.add(CURRENT_ALARM.id);
+        plan.add(CURRENT_FAULT.id);
+    }
+}
 
-    readRegisters(values + R_MOTOR_SPEED, m_address, false, R_MOTOR_SPEED, 8);
-    readRegisters(values + R_MOTOR_OVERLOAD, m_address, false, R_MOTOR_OVERLOAD,
-                  m_use_encoder_feedback ? 3 : 1);
+void Driver::setTelemetryProfile(int profile) {
+    checkNotPolling("setTelemetryProfile");
+    int fields = profile & (TELEMETRY_PROFILE_FULL | TELEMETRY_FAULT);
+    if (!fields) {
+        throw std::invalid_argument("setTelemetryProfile: empty profile");
+    }
+    m_telemetry_profile = fields;
+}
+
+int Driver::getTelemetryProfile() const {
+    return m_telemetry_profile;
+}
+
+CurrentState Driver::readCurrentState() {
+    OperationScope scope(*this, OPERATION_READ_CURRENT_STATE);
+    ReadPlan plan;
+    addCurrentStateRegisters(plan);
+    read(plan);
+    return decodeCurrentState(plan);
+}
 
+CurrentState Driver::decodeCurrentState(ReadPlan const& plan) {
     CurrentState state;
-    if (m_use_encoder_feedback) {
-        state.motor.speed = decodeRegister<float>(
-            values[R_ENCODER_SPEED]) * 2 * M_PI / 60;
-        if (m_ratings.encoder_scale) {
-            uint32_t ticks_per_turn = m_ratings.encoder_count * m_ratings.encoder_scale;
-            float position = static_cast<float>(
-                values[R_ENCODER_PULSE_COUNTER] % ticks_per_turn
-            ) / ticks_per_turn * 2 * M_PI;
+    int profile = m_telemetry_profile;
+    bool has_speed = profile & TELEMETRY_SPEED;
+    Register const& speed = m_use_encoder_feedback ? ENCODER_SPEED : MOTOR_SPEED;
+    state.time = has_speed ? plan.getTiming(speed.id).midpoint()
+                           : plan.getTiming().midpoint();
+    state.request_time = plan.getTiming().request;
+    state.reply_time = plan.getTiming().reply;
+    state.sequence = ++m_state_sequence;
+
+    if (has_speed && m_use_encoder_feedback) {
+        state.motor.speed = decode(ENCODER_SPEED, plan);
+
+        bool has_velocity;
+        double velocity;
+        {
+            lock_guard<mutex> lock(m_encoder_mutex);
+            m_encoder_tracker.update(
+                decode<uint16_t>(ENCODER_PULSE_COUNTER, plan),
+                plan.getTiming(ENCODER_PULSE_COUNTER.id).midpoint()
+            );
+            state.encoder_ticks = m_encoder_tracker.getTicks();
+            has_velocity = m_encoder_tracker.hasVelocity();
+            velocity = m_encoder_tracker.getVelocity();
+        }
+
+        int64_t ticks_per_turn =
+            static_cast<int64_t>(m_ratings.encoder_count) * m_ratings.encoder_scale;
+        if (ticks_per_turn) {
+            int64_t turn_ticks =
+                (state.encoder_ticks % ticks_per_turn + ticks_per_turn) % ticks_per_turn;
+            float position = static_cast<float>(turn_ticks) / ticks_per_turn * 2 * M_PI;
             state.motor.position = base::Angle::normalizeRad(position);
+            state.encoder_position =
+                static_cast<double>(state.encoder_ticks) / ticks_per_turn * 2 * M_PI;
+            if (has_velocity) {
+                state.encoder_velocity = velocity / ticks_per_turn * 2 * M_PI;
+            }
         }
     }
-    else {
-        state.motor.speed = decodeRegister<float>(
-            values[R_MOTOR_SPEED]) * 2 * M_PI / 60;
-    }
-    state.motor_overload_ratio = decodeRegister<float>(values[R_MOTOR_OVERLOAD]) / 100;
-    state.motor.raw = decodeRegister<float>(
-        values[R_INVERTER_OUTPUT_CURRENT]) / 10;
-    state.battery_voltage = decodeRegister<float>(
-        values[R_BATTERY_VOLTAGE]) / 10;
-    state.inverter_output_frequency = decodeRegister<float>(
-        values[R_INVERTER_OUTPUT_FREQUENCY]) / 10;
-    state.inverter_status = static_cast<InverterStatus>(
-        values[R_INVERTER_STATUS]
-    );
-    state.inverter_output_voltage = decodeRegister<float>(
-        values[R_INVERTER_OUTPUT_VOLTAGE]) / 10;
-    state.motor.effort  = decodeRegister<float>(
-        values[R_MOTOR_TORQUE]) / 1000 * m_ratings.torque;
+    else if (has_speed) {
+        state.motor.speed = decode(MOTOR_SPEED, plan);
+    }
 
-    if (state.motor.raw * state.motor.effort < 0) {
-        state.motor.speed *= -1;
+    if (profile & TELEMETRY_OVERLOAD) {
+        state.motor_overload_ratio = decode(MOTOR_OVERLOAD, plan);
+    }
+    if (profile & TELEMETRY_ELECTRICAL) {
+        state.battery_voltage = decode(BATTERY_VOLTAGE, plan);
+        state.inverter_output_frequency = decode(INVERTER_OUTPUT_FREQUENCY, plan);
+        state.inverter_output_voltage = decode(INVERTER_OUTPUT_VOLTAGE, plan);
+    }
+    if (profile & TELEMETRY_STATUS) {
+        state.inverter_status = static_cast<InverterStatus>(
+            decode<int>(INVERTER_STATUS, plan)
+        );
+    }
+    if (profile & TELEMETRY_FAULT) {
+        state.current_alarm = decode<int>(CURRENT_ALARM, plan);
+        state.current_fault = decode<int>(CURRENT_FAULT, plan);
     }
 
+    float current = base::unknown<float>();
+    if (profile & (TELEMETRY_SPEED | TELEMETRY_CURRENT)) {
+        current = decode(INVERTER_OUTPUT_CURRENT, plan);
+    }
+    float torque = base::unknown<float>();
+    if (profile & (TELEMETRY_SPEED | TELEMETRY_TORQUE)) {
+        torque = decode(MOTOR_TORQUE, plan) * m_ratings.torque;
+    }
+    if (has_speed && current * torque < 0) {
+        state.motor.speed *= -1;
+    }
+    if (profile & TELEMETRY_CURRENT) {
+        state.motor.raw = current;
+    }
+    if (profile & TELEMETRY_TORQUE) {
+        state.motor.effort = torque;
+    }
     return state;
 }
 
 int Driver::readCurrentAlarm() {
-    uint16_t value;
-    readRegisters(&value, m_address, false, R_CURRENT_ALARM, 1);
-    return value;
+    OperationScope scope(*this, OPERATION_READ_CURRENT_ALARM);
+    ReadPlan plan;
+    plan.add(CURRENT_ALARM.id);
+    read(plan);
+    return decode<int>(CURRENT_ALARM, plan);
 }
 
-FaultState Driver::readFaultState() {
-    uint16_t values[R_LAST_FAULT_CURRENT + 6];
-    readRegisters(values + R_CURRENT_FAULT, m_address, false, R_CURRENT_FAULT, 1);
+/** Data saved by the controller about the last fault */
+static constexpr Span LAST_FAULT_DATA_SPAN = spanOf({
+    LAST_FAULT_CURRENT, LAST_FAULT_BATTERY_VOLTAGE, LAST_FAULT_SPEED,
+    LAST_FAULT_COMMAND, LAST_FAULT_INVERTER_OUTPUT_FREQUENCY,
+    LAST_FAULT_INVERTER_OUTPUT_VOLTAGE
+});
+static_assert(fitsInFrame(spanOf({ CURRENT_FAULT, LAST_FAULT_INVERTER_OUTPUT_VOLTAGE })),
+              "fault registers need more than one frame");
+
+void Driver::addFaultStateRegisters(ReadPlan& plan) const {
+    plan.add(CURRENT_FAULT.id);
     for (int i = 0; i < 5; ++i) {
-        readRegisters(values + R_LAST_FAULT + 4 * i, m_address, false,
-                      R_LAST_FAULT + 4 * i, 1);
+        plan.add(LAST_FAULT.id + FAULT_HISTORY_STRIDE * i);
     }
-    readRegisters(values + R_LAST_FAULT_CURRENT,
-                  m_address, false, R_LAST_FAULT_CURRENT, 6);
+    plan.add(LAST_FAULT_DATA_SPAN.start, LAST_FAULT_DATA_SPAN.length);
+}
 
+FaultState Driver::decodeFaultState(ReadPlan const& plan) const {
     FaultState state;
-    state.time = base::Time::now();
-    state.current_fault = values[R_CURRENT_FAULT];
+    state.time = plan.getTiming(CURRENT_FAULT.id).midpoint();
+    state.current_fault = decode<int>(CURRENT_FAULT, plan);
     for (int i = 0; i < 5; ++i) {
-        state.fault_history[i] = values[R_LAST_FAULT + 4 * i];
-    }
-    state.current = decodeRegister<float>(
-        values[R_LAST_FAULT_CURRENT]) / 10;
-    state.battery_voltage = decodeRegister<float>(
-        values[R_LAST_FAULT_BATTERY_VOLTAGE]) / 10;
-    state.speed = decodeRegister<float>(
-        values[R_LAST_FAULT_SPEED]) * 2 * M_PI / 60;
-    state.command = decodeRegister<float>(
-        values[R_LAST_FAULT_COMMAND]) * 2 * M_PI / 60;
-    state.inverter_output_frequency = decodeRegister<float>(
-        values[R_LAST_FAULT_INVERTER_OUTPUT_FREQUENCY]) / 10;
-    state.inverter_output_voltage = decodeRegister<float>(
-        values[R_LAST_FAULT_INVERTER_OUTPUT_VOLTAGE]) / 10;
+        state.fault_history[i] = plan.get(LAST_FAULT.id + FAULT_HISTORY_STRIDE * i);
+    }
+    state.current = decode(LAST_FAULT_CURRENT, plan);
+    state.battery_voltage = decode(LAST_FAULT_BATTERY_VOLTAGE, plan);
+    state.speed = decode(LAST_FAULT_SPEED, plan);
+    state.command = decode(LAST_FAULT_COMMAND, plan);
+    state.inverter_output_frequency =
+        decode(LAST_FAULT_INVERTER_OUTPUT_FREQUENCY, plan);
+    state.inverter_output_voltage =
+        decode(LAST_FAULT_INVERTER_OUTPUT_VOLTAGE, plan);
     return state;
 }
 
+FaultState Driver::readFaultState() {
+    OperationScope scope(*this, OPERATION_READ_FAULT_STATE);
+    ReadPlan plan;
+    addFaultStateRegisters(plan);
+    read(plan);
+    return decodeFaultState(plan);
+}
+
+void Driver::addTemperatureRegisters(ReadPlan& plan) const {
+    plan.add(TEMPERATURE_MOSFET.id);
+    plan.add(TEMPERATURE_AIR.id);
+}
+
 InverterTemperatures Driver::readTemperatures() {
+    OperationScope scope(*this, OPERATION_READ_TEMPERATURES);
+    ReadPlan plan;
+    addTemperatureRegisters(plan);
+    read(plan);
+    return decodeTemperatures(plan);
+}
+
+InverterTemperatures Driver::decodeTemperatures(ReadPlan const& plan) const {
     InverterTemperatures temperatures;
     temperatures.mosfet = Temperature::fromCelsius(
-        readSingleRegister<float>(R_TEMPERATURE_MOSFET) / 10
+        decode(TEMPERATURE_MOSFET, plan)
     );
     temperatures.air = Temperature::fromCelsius(
-        readSingleRegister<float>(R_TEMPERATURE_AIR) / 10
+        decode(TEMPERATURE_AIR, plan)
     );
     return temperatures;
 }
+
+StateSnapshot Driver::readSnapshot() {
+    OperationScope scope(*this, OPERATION_READ_SNAPSHOT);
+    ReadPlan plan;
+    addCurrentStateRegisters(plan);
+    addTemperatureRegisters(plan);
+    plan.add(CURRENT_ALARM.id);
+    read(plan);
+
+    StateSnapshot snapshot;
+    snapshot.state = decodeCurrentState(plan);
+    snapshot.temperatures = decodeTemperatures(plan);
+    snapshot.alarm = decode<int>(CURRENT_ALARM, plan);
+    return snapshot;
+}
+
+void Driver::startPolling(PollingSettings const& settings) {
+    if (m_poller.joinable()) {
+        throw std::logic_error("startPolling: already polling");
+    }
+
+    {
+        lock_guard<mutex> lock(m_poller_mutex);
+        m_poller_quit = false;
+        m_polled_sequence = 0;
+    }
+    m_polled_state.write(PolledState());
+    m_poller = thread(&Driver::pollerLoop, this, settings);
+}
+
+void Driver::stopPolling() {
+    if (!m_poller.joinable()) {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_poller_mutex);
+        m_poller_quit = true;
+    }
+    m_poller_signal.notify_all();
+    m_poller.join();
+}
+
+bool Driver::isPolling() const {
+    return m_poller.joinable();
+}
+
+PolledState Driver::getPolledState() {
+    return m_polled_state.read();
+}
+
+PolledState Driver::waitPolledState(uint64_t sequence, Time const& timeout) {
+    unique_lock<mutex> lock(m_poller_mutex);
+    m_polled_signal.wait_for(
+        lock, chrono::microseconds(timeout.toMicroseconds()),
+        [&] { return m_polled_sequence > sequence; }
+    );
+    lock.unlock();
+    return m_polled_state.read();
+}
+
+void Driver::addPollGroupRegisters(ReadPlan& plan, PollGroup group) const {
+    switch (group) {
+        case POLL_GROUP_STATE:
+            addCurrentStateRegisters(plan);
+            break;
+        case POLL_GROUP_TEMPERATURES:
+            addTemperatureRegisters(plan);
+            break;
+        case POLL_GROUP_ALARM:
+            plan.add(CURRENT_ALARM.id);
+            break;
+        case POLL_GROUP_FAULT_STATE:
+            addFaultStateRegisters(plan);
+            break;
+        case POLL_GROUP_RATINGS:
+            addMotorRatingsRegisters(plan);
+            break;
+        default:
+            break;
+    }
+}
+
+void Driver::decodePollGroup(ReadPlan const& plan, PollGroup group,
+                             PolledState& polled) {
+    Time time = plan.getTiming().midpoint();
+    switch (group) {
+        case POLL_GROUP_STATE:
+            polled.state = decodeCurrentState(plan);
+            polled.state_time = polled.state.time;
+            break;
+        case POLL_GROUP_TEMPERATURES:
+            polled.temperatures = decodeTemperatures(plan);
+            polled.temperatures_time = time;
+            break;
+        case POLL_GROUP_ALARM:
+            polled.alarm = decode<int>(CURRENT_ALARM, plan);
+            polled.alarm_time = time;
+            break;
+        case POLL_GROUP_FAULT_STATE:
+            polled.fault_state = decodeFaultState(plan);
+            polled.fault_state_time = polled.fault_state.time;
+            break;
+        case POLL_GROUP_RATINGS:
+            polled.ratings = decodeMotorRatings(plan);
+            polled.ratings_time = time;
+            break;
+        default:
+            break;
+    }
+}
+
+void Driver::pollerLoop(PollingSettings settings) {
+    PolledState polled;
+    Time state_deadline = Time::now();
+    // Time at which each group is due
+    Time due[POLL_GROUP_COUNT];
+    for (auto& time : due) {
+        time = state_deadline;
+    }
+
+    while (true) {
+        Time now = Time::now();
+        // The state reads follow an absolute schedule. If the cycle is late,
+        // the deadlines that have already passed are skipped
+        Time next_deadline = state_deadline + settings.state_period;
+        if (next_deadline < now) {
+            next_deadline = now + settings.state_period;
+        }
+
+        ReadPlan plan;
+        addCurrentStateRegisters(plan);
+        compile(plan);
+        bool read_group[POLL_GROUP_COUNT] = { true };
+
+        // Add the due groups, the most overdue first, as long as the cycle
+        // ends before the next state deadline. A group that is overdue by
+        // more than its own period is added anyway, so that a state period
+        // too short for the bus does not starve the other groups
+        vector<PollGroup> due_groups;
+        for (int i = POLL_GROUP_STATE + 1; i < POLL_GROUP_COUNT; ++i) {
+            auto group = static_cast<PollGroup>(i);
+            bool enabled = !settings.getPeriod(group).isNull() ||
+                           group == POLL_GROUP_TEMPERATURES ||
+                           group == POLL_GROUP_ALARM;
+            if (enabled && now >= due[i]) {
+                due_groups.push_back(group);
+            }
+        }
+        stable_sort(due_groups.begin(), due_groups.end(),
+                    [&](PollGroup a, PollGroup b) { return due[a] < due[b]; });
+        for (auto group : due_groups) {
+            ReadPlan candidate = plan;
+            addPollGroupRegisters(candidate, group);
+            compile(candidate);
+            bool fits = now + candidate.estimateCost(m_cost_model) <= next_deadline;
+            // A null period means as often as possible, not that the group
+            // is always late
+            Time period = settings.getPeriod(group);
+            bool starved = !period.isNull() && now - due[group] >= period;
+            if (fits || starved) {
+                plan = candidate;
+                read_group[group] = true;
+            }
+            else {
+                polled.deferrals[group]++;
+            }
+        }
+
+        // Nothing may escape the thread, as it would terminate the process
+        bool read_ok = true;
+        try {
+            OperationScope scope(*this, OPERATION_POLL);
+            read(plan);
+        }
+        catch (std::exception const&) {
+            polled.errors++;
+            read_ok = false;
+        }
+
+        // A group is only rescheduled once it has been read, so that a failed
+        // read is retried on the next cycle. Data that was read but is
+        // invalid (e.g. an unknown rated power code) is not retried before
+        // the next period, as it would most likely still be invalid
+        for (int i = 0; read_ok && i < POLL_GROUP_COUNT; ++i) {
+            if (!read_group[i]) {
+                continue;
+            }
+            auto group = static_cast<PollGroup>(i);
+            due[i] = now + settings.getPeriod(group);
+            try {
+                decodePollGroup(plan, group, polled);
+            }
+            catch (std::exception const&) {
+                polled.errors++;
+            }
+        }
+        polled.sequence++;
+        m_polled_state.write(polled);
+
+        state_deadline = next_deadline;
+        Time sleep_time = state_deadline - Time::now();
+        unique_lock<mutex> lock(m_poller_mutex);
+        m_polled_sequence = polled.sequence;
+        m_polled_signal.notify_all();
+        if (sleep_time > Time()) {
+            m_poller_signal.wait_for(
+                lock, chrono::microseconds(sleep_time.toMicroseconds()),
+                [this] { return m_poller_quit; }
+            );
+        }
+        if (m_poller_quit) {
+            return;
+        }
+    }
+}
@@ -3,95 +3,296 @@
 
 #include <base/Float.hpp>
 #include <base/JointLimitRange.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <map>
 #include <modbus/Master.hpp>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <motors_weg_cvw300/Calibration.hpp>
 #include <motors_weg_cvw300/Configuration.hpp>
 #include <motors_weg_cvw300/InverterTemperatures.hpp>
 #include <motors_weg_cvw300/CurrentState.hpp>
+#include <motors_weg_cvw300/EncoderTracker.hpp>
 #include <motors_weg_cvw300/FaultState.hpp>
 #include <motors_weg_cvw300/MotorRatings.hpp>
+#include <motors_weg_cvw300/PolledState.hpp>
+#include <motors_weg_cvw300/ReadPlan.hpp>
+#include <motors_weg_cvw300/Registers.hpp>
+#include <motors_weg_cvw300/StateSnapshot.hpp>
+#include <motors_weg_cvw300/Statistics.hpp>
+#include <motors_weg_cvw300/TripleBuffer.hpp>
 
 namespace motors_weg_cvw300 {
     /**
      * Driver for the WEG CVW300 controller
+     *
+     * The driver is the modbus::Master of its serial line, unless it has
+     * been created on a shared bus. The register accesses of modbus::Master
+     * are hidden by the driver's own, which go to the right bus, hold the
+     * bus lock and are recorded in the statistics.
      */
     class Driver : public modbus::Master {
+        friend class BusScheduler;
+
+        /** Hidden, use the driver's reads instead */
+        using modbus::Master::readSingleRegister;
+
+        /** The bus used for communication
+         *
+         * This is the driver itself unless it has been created with the
+         * constructor that shares an existing bus
+         */
+        modbus::Master& m_bus;
         int m_address;
 
         MotorRatings m_ratings;
         bool m_use_encoder_feedback = false;
+        int m_telemetry_profile = TELEMETRY_PROFILE_FULL;
 
         base::JointLimitRange m_limits;
 
-        enum Registers {
-            R_MOTOR_SPEED = 2,
-            R_INVERTER_OUTPUT_CURRENT = 3,
-            R_BATTERY_VOLTAGE = 4,
-            R_INVERTER_OUTPUT_FREQUENCY = 5,
-            R_INVERTER_STATUS = 6,
-            R_INVERTER_OUTPUT_VOLTAGE = 7,
-            R_MOTOR_TORQUE = 9,
-            R_TEMPERATURE_MOSFET = 30,
-            R_TEMPERATURE_AIR = 34,
-            R_MOTOR_OVERLOAD = 37,
-            R_ENCODER_SPEED = 38,
-            R_ENCODER_PULSE_COUNTER = 39,
-
-            R_CURRENT_ALARM = 48,
-            R_CURRENT_FAULT = 49,
-
-            R_LAST_FAULT = 50,
-            R_LAST_FAULT_CURRENT = 90,
-            R_LAST_FAULT_BATTERY_VOLTAGE = 91,
-            R_LAST_FAULT_SPEED = 92,
-            R_LAST_FAULT_COMMAND = 93,
-            R_LAST_FAULT_INVERTER_OUTPUT_FREQUENCY = 94,
-            R_LAST_FAULT_INVERTER_OUTPUT_VOLTAGE = 95,
-
-            R_RAMP_ACCELERATION_TIME = 100,
-            R_RAMP_DECELERATION_TIME = 101,
-            R_RAMP_TYPE = 104,
-            R_MAX_SPEED_REFERENCE = 134,
-            R_MAX_SPEED_ABSOLUTE = 134,
-
-            R_GAIN_SPEED_P = 161,
-            R_GAIN_SPEED_I = 162,
-            R_GAIN_SPEED_D = 166,
-            R_GAIN_CURRENT_P = 167,
-            R_GAIN_CURRENT_I = 168,
-            R_MAX_FORWARD_TORQUE = 169,
-            R_MAX_REVERSE_TORQUE = 170,
-            R_GAIN_FLUX_P = 175,
-            R_GAIN_FLUX_I = 176,
-            R_FLUX_NOMINAL = 178,
-            R_FLUX_MAXIMAL = 179,
-
-            R_CONTROL_TYPE = 202,
-            R_REM_REFERENCE_SELECTION = 222,
-            R_REM_DIRECTION_SELECTION = 226,
-            R_REM_RUN_STOP_SELECTION = 227,
-            R_REM_JOG_SELECTION = 228,
-
-            R_CONFIG_SAVE = 303,
-            R_SERIAL_ERROR_ACTION = 313,
-            R_SERIAL_WATCHDOG = 314,
-
-            R_MOTOR_NOMINAL_CURRENT = 401,
-            R_MOTOR_NOMINAL_SPEED = 402,
-            R_MOTOR_NOMINAL_POWER = 404,
-            R_ENCODER_COUNT = 405,
-
-            R_SERIAL_STATUS_WORD = 682,
-            R_SERIAL_REFERENCE_SPEED = 683
-        };
+        BusCostModel m_cost_model;
 
-        template<typename T>
-        T readSingleRegister(int register_id);
+        /** Registers that the reads must not cover, see excludeRegisters */
+        std::vector<ReadPlan::Block> m_excluded_registers;
+
+        /** Serial watchdog as last written by writeSerialWatchdog
+         *
+         * Unknown (i.e. not written by this driver) if m_serial_watchdog_known
+         * is false
+         */
+        bool m_serial_watchdog_known = false;
+        base::Time m_serial_watchdog;
+
+        bool m_speed_command_suppression = false;
+        base::Time m_speed_command_keepalive_margin;
+        bool m_last_reference_known = false;
+        int16_t m_last_reference = 0;
+        base::Time m_last_reference_time;
+        uint64_t m_suppressed_speed_commands = 0;
+
+        /** Configuration registers whose value is cached in
+         * m_shadow_registers
+         */
+        static const int SHADOW_REGISTERS[13];
+
+        /** Known value of the configuration registers, indexed by register ID
+         *
+         * Filled by readConfigurationRegisters, and kept up to date by the
+         * writes
+         */
+        std::map<int, uint16_t> m_shadow_registers;
+        bool m_shadow_registers_valid = false;
+        uint64_t m_skipped_configuration_writes = 0;
+
+        bool isShadowRegister(int register_id) const;
+
+        /** Write a register, converting the value from SI units */
+        void writeRegister(registers::Register const& r, double value);
+
+        /** Write a configuration register, unless the shadow copy says that
+         * the controller already has this value
+         */
+        void writeConfigurationRegister(registers::Register const& r, double value);
+
+        /** Whether the driver communicates through a bus shared with other
+         * drivers, see BusScheduler
+         */
+        bool isBusShared() const;
+
+        /** Throw if the bus is shared
+         *
+         * The bus configuration of a shared bus is owned by the BusScheduler
+         */
+        void checkOwnsBus(char const* method) const;
+
+        /** Throw if the poller is running
+         *
+         * The poller reads the driver configuration without locking. It
+         * must therefore not change while polling
+         */
+        void checkNotPolling(char const* method) const;
+
+        /** Update the cost model after the interframe delay of a shared bus
+         * has been changed by the BusScheduler
+         */
+        void syncInterframeDelay(base::Time const& delay);
+
+        void setLastReference(int16_t reference);
+        bool needsReferenceWrite(int16_t reference) const;
+
+        /** Lock of the bus when the driver owns it */
+        std::mutex m_own_bus_mutex;
+
+        /** Serializes the bus transactions
+         *
+         * This is m_own_bus_mutex, unless the bus is shared, in which case
+         * it is the lock of the shared bus. It serializes the transactions
+         * of the poller and of the callers, and those of all the drivers on
+         * a shared bus
+         */
+        std::mutex& m_bus_mutex;
+
+        std::thread m_poller;
+        std::mutex m_poller_mutex;
+        std::condition_variable m_poller_signal;
+        bool m_poller_quit = false;
+        TripleBuffer<PolledState> m_polled_state;
+        /** Signalled each time the poller publishes a state
+         *
+         * @c m_polled_sequence is protected by @c m_poller_mutex
+         */
+        std::condition_variable m_polled_signal;
+        uint64_t m_polled_sequence = 0;
+
+        void pollerLoop(PollingSettings settings);
+        void addPollGroupRegisters(ReadPlan& plan, PollGroup group) const;
+        void decodePollGroup(ReadPlan const& plan, PollGroup group,
+                             PolledState& polled);
+
+        std::mutex m_encoder_mutex;
+        EncoderTracker m_encoder_tracker;
+
+        /** Sequence number of the last CurrentState read */
+        std::atomic<uint64_t> m_state_sequence{0};
 
-        void writeJointTorqueLimit(float limit, int register_id);
+        StatisticsRecorder m_statistics;
+
+        /** Attributes the transactions done in a public method to it, and
+         * records the call in the statistics
+         */
+        class OperationScope;
+
+        /** Do a bus transaction and record it in the statistics
+         *
+         * @param f the function that does the transaction on m_bus
+         * @param retry whether this re-sends an earlier request
+         */
+        template<typename F>
+        void transaction(bool write, int start, int length, F f, bool retry = false);
+
+        /** Compile a plan with the driver's cost model and excluded registers */
+        void compile(ReadPlan& plan) const;
+
+        /** Read all the blocks of a plan, compiling it if needed
+         *
+         * The time at which each block has been read is stored in the plan
+         */
+        void read(ReadPlan& plan);
+
+        void addMotorRatingsRegisters(ReadPlan& plan) const;
+
+        /** Decode the motor ratings, keeping the encoder scale currently set */
+        MotorRatings decodeMotorRatings(ReadPlan const& plan) const;
+
+        void addCurrentStateRegisters(ReadPlan& plan) const;
+
+        /** Decode the motor state, and stamp it with the plan's timing and
+         * the next sequence number
+         */
+        CurrentState decodeCurrentState(ReadPlan const& plan);
+        void addTemperatureRegisters(ReadPlan& plan) const;
+        InverterTemperatures decodeTemperatures(ReadPlan const& plan) const;
+        void addFaultStateRegisters(ReadPlan& plan) const;
+        FaultState decodeFaultState(ReadPlan const& plan) const;
+
+        void writeJointTorqueLimit(float limit, registers::Register const& r);
+
+        /** Convert a speed command in rad/s into the reference register value */
+        int16_t scaleSpeedCommand(float command) const;
+
+        /** Write the serial status word and speed reference in a single frame
+         *
+         * The two registers are contiguous, so this uses Write Multiple
+         * Registers instead of two separate frames
+         */
+        void writeControlAndReference(uint16_t control, int16_t reference);
 
     public:
         Driver(int address);
 
+        /** Create a driver that communicates through an existing bus
+         *
+         * This is meant to share a single serial line between multiple
+         * controllers, see BusScheduler. The driver does not change the
+         * bus configuration: @c setInterframeDelay and
+         * @c calibrateInterframeDelay throw. The scheduler keeps the
+         * driver's cost model in sync with the bus
+         *
+         * @param bus_mutex the lock of the shared bus. All the drivers of a
+         *   bus must use the same, so that their transactions (including the
+         *   ones of their pollers) do not interleave
+         */
+        Driver(modbus::Master& bus, std::mutex& bus_mutex, int address);
+
+        ~Driver();
+
+        /** The address of the controller on the bus */
+        int getAddress() const;
+
+        /** Open the serial line
+         *
+         * @throw std::logic_error if the bus is shared. The line is then
+         *   opened through the BusScheduler
+         */
+        void openURI(std::string const& uri);
+
+        /** Set the delay between two frames
+         *
+         * This shadows modbus::Master's to keep the bus cost model in sync
+         *
+         * @throw std::logic_error if the bus is shared. Use
+         *   BusScheduler::setInterframeDelay instead
+         */
+        void setInterframeDelay(base::Time const& delay);
+
+        /** Declare the baud rate of the serial line
+         *
+         * This does not change the line configuration. It is only used to
+         * estimate the cost of transactions, to decide how registers should
+         * be grouped into frames. The default is the controller's factory
+         * default (19200)
+         */
+        void setBaudRate(int baud_rate);
+
+        /** The model used to estimate the cost of bus transactions */
+        BusCostModel getBusCostModel() const;
+
+        /** Declare registers that the controller does not answer to
+         *
+         * The reads are grouped in frames that may cover registers the driver
+         * does not need. Such frames never cover the excluded registers,
+         * e.g. the invalid parameters reported by cfg-dump. It throws
+         * std::logic_error while polling.
+         */
+        void excludeRegisters(int start, int length = 1);
+
+        /** Estimated time needed by @c readCurrentState */
+        base::Time estimateCurrentStateReadCost() const;
+
+        /** Find the smallest interframe delay the controller can handle
+         *
+         * The delay is stepped down from @c settings.start, and a series of
+         * reads of the current alarm are done at each step while counting
+         * timeouts and errors. The calibration stops at the first step whose
+         * error rate is above @c settings.max_error_rate.
+         *
+         * On return, the driver's interframe delay is set to the recommended
+         * value (smallest safe delay plus margin). If no safe delay was found,
+         * the result's @c success flag is false and the delay the driver had
+         * before the calibration is restored.
+         *
+         * @throw std::logic_error if the bus is shared, as changing the delay
+         *   would affect all the drives on the bus
+         */
+        InterframeDelayCalibrationResult calibrateInterframeDelay(
+            InterframeDelayCalibrationSettings const& settings =
+                InterframeDelayCalibrationSettings()
+        );
+
         /** Save current configuration */
         void configSave();
 
@@ -111,6 +312,24 @@ namespace motors_weg_cvw300 {
          */
         MotorRatings readMotorRatings();
 
+        /** Read the motor ratings, using a cache file to avoid the bus access
+         *
+         * The cache holds the raw values of the rating registers and the time
+         * at which they were read. If it is younger than @a max_age, the
+         * ratings are decoded from it and the controller is not accessed at
+         * all. Otherwise, or if the cache is invalid (e.g. it holds an
+         * unknown rated power code), the registers are read (in a single
+         * block) and the cache is rewritten.
+         *
+         * The cache must be keyed by port and address by the caller, and
+         * removed when the rating parameters of the controller are modified.
+         * Failing to write it is not an error.
+         *
+         * @see getMotorRatings setMotorRatings
+         */
+        MotorRatings readMotorRatings(std::string const& cache_path,
+                                      base::Time const& max_age);
+
         /** Get the motor ratings currently used by this class for conversions
          *
          * Motor ratings can either be set explicitely (@c setMotorRatings) or
@@ -144,6 +363,32 @@ namespace motors_weg_cvw300 {
          */
         bool getUseEncoderFeedback() const;
 
+        /** Select the CurrentState fields read by @c readCurrentState
+         *
+         * The driver reads only the registers needed for these fields, which
+         * makes the read shorter, and may save a whole frame. The profile is
+         * also used by @c readSnapshot and the background poller. It cannot
+         * be changed while polling (std::logic_error).
+         *
+         * @param profile a combination of TelemetryField values
+         * @throw std::invalid_argument if the profile is empty
+         */
+        void setTelemetryProfile(int profile);
+
+        /** The telemetry profile
+         *
+         * @see setTelemetryProfile
+         */
+        int getTelemetryProfile() const;
+
+        /** Restart the encoder tick count
+         *
+         * The tick count is unwrapped assuming that the encoder moves by less
+         * than 32768 ticks between two state reads. Call this if the states
+         * have not been read for a while.
+         */
+        void resetEncoderTracking();
+
         /** Prepare the unit to receive control from the driver w/o enabling power */
         void prepare();
 
@@ -153,9 +398,19 @@ namespace motors_weg_cvw300 {
         /** Enable the motor control, and give control to the serial interface */
         void enable();
 
+        /** Enable the motor control and send the first speed command
+         *
+         * The status word and the speed reference are written in a single
+         * frame
+         */
+        void enable(float command);
+
         /**
          * Disable the motor control, and give control away from to the serial
          * interface
+         *
+         * The status word and the zero speed reference are written in a single
+         * frame, which makes it the fastest way to stop the motor
          */
         void disable();
 
@@ -170,22 +425,152 @@ namespace motors_weg_cvw300 {
         /** Configure the limits */
         void writeJointLimits(base::JointLimitRange const& limits);
 
-        /** Send a speed command */
-        void writeSpeedCommand(float command);
+        /** Send a speed command
+         *
+         * @return false if the command was suppressed because it was a
+         *   repetition of the last one (see setSpeedCommandSuppression),
+         *   true if it was sent
+         */
+        bool writeSpeedCommand(float command);
+
+        /** Skip speed commands that repeat the last written reference
+         *
+         * When enabled, writeSpeedCommand does not send a command whose
+         * scaled value is equal to the one last written to the controller.
+         * It is re-sent only when needed to keep the serial watchdog from
+         * triggering, that is when the time since the last write is greater
+         * than the watchdog period minus @c margin.
+         *
+         * The watchdog period is only known if it was set through
+         * writeSerialWatchdog on this driver. Commands are never suppressed
+         * if it is unknown.
+         */
+        void setSpeedCommandSuppression(
+            bool enable, base::Time const& margin = base::Time::fromMilliseconds(500)
+        );
+
+        /** Number of speed commands that were not sent because of the
+         * speed command suppression
+         */
+        uint64_t getSuppressedSpeedCommandCount() const;
 
         /** Change the ramp configuration */
         void writeRampConfiguration(configuration::Ramps const& ramps);
 
+        /** Read the configuration registers in a local shadow copy
+         *
+         * Once the shadow copy is filled, the configuration methods (prepare,
+         * writeRampConfiguration, writeJointLimits, writeControlType and
+         * writeSerialWatchdog) only write the registers whose value differ
+         * from the controller's. Call this again after a reconnection,
+         * or if the configuration may have been changed by other means.
+         */
+        void readConfigurationRegisters();
+
+        /** Clear the shadow copy, to go back to always writing the
+         * configuration registers
+         */
+        void clearConfigurationRegisters();
+
+        /** Number of configuration register writes that were skipped because
+         * the controller already had the value
+         */
+        uint64_t getSkippedConfigurationWriteCount() const;
+
         /** Write the value into register */
         template<typename T>
         void writeSingleRegister(int register_id, T value);
 
+        /** Write raw values into contiguous registers, in a single Write
+         * Multiple Registers frame
+         */
+        void writeRegisters(int start, std::vector<uint16_t> const& values);
+
+        /** Read the raw values of contiguous registers in a single frame
+         *
+         * Like all the driver's bus accesses, and unlike the ones done
+         * directly on the modbus::Master, it is serialized with the poller
+         * and the other drivers of a shared bus, and recorded in the
+         * statistics
+         */
+        void readRegisters(uint16_t* values, int start, int length);
+
         CurrentState readCurrentState();
 
         int readCurrentAlarm();
         FaultState readFaultState();
 
         InverterTemperatures readTemperatures();
+
+        /** Read the current state, temperatures and alarm
+         *
+         * The registers are read together, which takes one or two frames
+         * instead of the five needed by the separate read methods
+         */
+        StateSnapshot readSnapshot();
+
+        /** Start refreshing the state, temperatures and alarm, and
+         * optionally the fault state and motor ratings, in a background
+         * thread
+         *
+         * The state is read on a fixed schedule. The other groups are added
+         * to the state reads when they are due, provided that the read still
+         * ends before the next state deadline. Otherwise they are postponed
+         * to the next cycle (see PolledState::deferrals), unless they are
+         * already late by a whole period, in which case they are read even
+         * if it delays the state (see PollingSettings). A group whose read
+         * fails is retried on the next cycle. Errors, including data that
+         * cannot be decoded, are counted in PolledState::errors and never
+         * stop the poller.
+         *
+         * The data is then available with @c getPolledState. Other methods
+         * can still be called while polling. Their transactions are
+         * interleaved with the poller's.
+         *
+         * The driver configuration (motor ratings, encoder feedback and
+         * scale, telemetry profile, excluded registers, baud rate and
+         * interframe delay) is used by the poller without locking. The
+         * methods that change it, including @c readMotorRatings, throw
+         * std::logic_error while polling.
+         */
+        void startPolling(PollingSettings const& settings = PollingSettings());
+
+        /** Stop the background poller started with @c startPolling */
+        void stopPolling();
+
+        /** Whether the background poller is running */
+        bool isPolling() const;
+
+        /** The latest data acquired by the background poller
+         *
+         * This is wait-free, but must be called from a single thread
+         */
+        PolledState getPolledState();
+
+        /** Wait for the poller to publish a state newer than @c sequence
+         *
+         * Like @c getPolledState, it must be called from a single thread
+         *
+         * @return the latest polled state. Its sequence is not greater than
+         *   @c sequence if the timeout expired first
+         */
+        PolledState waitPolledState(uint64_t sequence, base::Time const& timeout);
+
+        /** Bus statistics since the driver was created or the last call to
+         * @c resetStatistics
+         *
+         * The transactions are counted globally, per operation (public
+         * method) and per register block. This can be called at any time,
+         * including while polling.
+         */
+        DriverStatistics getStatistics() const;
+
+        /** Zero the statistics
+         *
+         * This must not be called while polling, or concurrently with
+         * another method
+         */
+        void resetStatistics();
     };
 }
 
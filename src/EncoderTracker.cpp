@@ -0,0 +1,49 @@
+#include <motors_weg_cvw300/EncoderTracker.hpp>
+
+using namespace base;
+using namespace motors_weg_cvw300;
+
+void EncoderTracker::reset() {
+    m_initialized = false;
+    m_has_velocity = false;
+    m_velocity = 0;
+}
+
+bool EncoderTracker::update(uint16_t counter, Time const& time) {
+    if (!m_initialized) {
+        m_initialized = true;
+        m_ticks = counter;
+        m_last_counter = counter;
+        m_last_time = time;
+        return true;
+    }
+    else if (time <= m_last_time) {
+        return false;
+    }
+
+    int16_t delta = static_cast<int16_t>(
+        static_cast<uint16_t>(counter - m_last_counter)
+    );
+    m_ticks += delta;
+    m_velocity = delta / (time - m_last_time).toSeconds();
+    m_has_velocity = true;
+    m_last_counter = counter;
+    m_last_time = time;
+    return true;
+}
+
+bool EncoderTracker::isInitialized() const {
+    return m_initialized;
+}
+
+int64_t EncoderTracker::getTicks() const {
+    return m_ticks;
+}
+
+bool EncoderTracker::hasVelocity() const {
+    return m_has_velocity;
+}
+
+double EncoderTracker::getVelocity() const {
+    return m_velocity;
+}
@@ -0,0 +1,61 @@
+#ifndef MOTORS_WEG_CVW300_ENCODERTRACKER_HPP
+#define MOTORS_WEG_CVW300_ENCODERTRACKER_HPP
+
+#include <base/Time.hpp>
+#include <cstdint>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Tracks the encoder pulse counter across wraparounds
+     *
+     * The controller reports the encoder position as a 16-bit counter. This
+     * class unwraps the successive readings into a 64-bit tick count, and
+     * estimates the velocity from the tick delta over the time between the
+     * two readings.
+     *
+     * The unwrapping assumes that the encoder moves by less than half the
+     * counter range (32768 ticks) between two readings
+     */
+    class EncoderTracker {
+        bool m_initialized = false;
+        uint16_t m_last_counter = 0;
+        base::Time m_last_time;
+        int64_t m_ticks = 0;
+        double m_velocity = 0;
+        bool m_has_velocity = false;
+
+    public:
+        /** Forget the previous readings
+         *
+         * The next call to @c update restarts the tick count at the counter
+         * value
+         */
+        void reset();
+
+        /** Process a new counter reading
+         *
+         * @param counter the value of the pulse counter register
+         * @param time the time at which the counter was sampled
+         * @return false if the reading was older than the last one, in which
+         *   case it is ignored
+         */
+        bool update(uint16_t counter, base::Time const& time);
+
+        /** Whether at least one reading has been processed */
+        bool isInitialized() const;
+
+        /** The unwrapped tick count */
+        int64_t getTicks() const;
+
+        /** Whether a velocity estimate is available
+         *
+         * It requires two readings
+         */
+        bool hasVelocity() const;
+
+        /** Velocity in ticks per second, estimated from the last two readings */
+        double getVelocity() const;
+    };
+}
+
+#endif
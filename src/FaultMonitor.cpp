@@ -0,0 +1,47 @@
+#include <motors_weg_cvw300/FaultMonitor.hpp>
+#include <motors_weg_cvw300/Driver.hpp>
+#include <stdexcept>
+
+using namespace std;
+using namespace motors_weg_cvw300;
+
+FaultMonitor::FaultMonitor(Driver& driver)
+    : m_driver(driver) {
+}
+
+bool FaultMonitor::update(CurrentState const& state) {
+    if (state.current_fault < 0) {
+        throw std::invalid_argument("FaultMonitor::update: the state does not "
+                                    "contain the fault code, add TELEMETRY_FAULT "
+                                    "to the telemetry profile");
+    }
+
+    bool changed = !m_initialized || state.current_fault != m_fault ||
+                   state.inverter_status != m_status;
+    if (!changed) {
+        return false;
+    }
+
+    m_fault_state = m_driver.readFaultState();
+    m_fault_state_reads++;
+    m_fault = state.current_fault;
+    m_status = state.inverter_status;
+    m_initialized = true;
+    return true;
+}
+
+void FaultMonitor::reset() {
+    m_initialized = false;
+}
+
+bool FaultMonitor::hasFaultState() const {
+    return m_fault_state_reads > 0;
+}
+
+FaultState const& FaultMonitor::getFaultState() const {
+    return m_fault_state;
+}
+
+uint64_t FaultMonitor::getFaultStateReadCount() const {
+    return m_fault_state_reads;
+}
@@ -0,0 +1,66 @@
+#ifndef MOTORS_WEG_CVW300_FAULTMONITOR_HPP
+#define MOTORS_WEG_CVW300_FAULTMONITOR_HPP
+
+#include <motors_weg_cvw300/CurrentState.hpp>
+#include <motors_weg_cvw300/FaultState.hpp>
+#include <motors_weg_cvw300/InverterStatus.hpp>
+#include <cstdint>
+
+namespace motors_weg_cvw300 {
+    class Driver;
+
+    /**
+     * Change-triggered acquisition of the fault state
+     *
+     * Instead of calling Driver::readFaultState periodically, add
+     * TELEMETRY_FAULT to the driver's telemetry profile so that the fault
+     * and alarm codes are read along with the state, and pass each state to
+     * @c update. The full fault state (history and data at the point of the
+     * last fault) is only read when the fault code or the inverter status
+     * changes, which in steady state costs nothing beyond the two registers
+     * added to the state reads.
+     *
+     * The status is only used if TELEMETRY_STATUS is part of the profile.
+     */
+    class FaultMonitor {
+        Driver& m_driver;
+        bool m_initialized = false;
+        int m_fault = 0;
+        InverterStatus m_status = STATUS_UNKNOWN;
+        FaultState m_fault_state;
+        uint64_t m_fault_state_reads = 0;
+
+    public:
+        explicit FaultMonitor(Driver& driver);
+
+        /** Process a state read, and read the fault state if needed
+         *
+         * The fault state is read on the first call, and then each time the
+         * fault code or the inverter status differ from the last call that
+         * succeeded. If the read fails, the exception is passed through and
+         * the read is attempted again on the next call.
+         *
+         * @return true if the fault state has been read
+         * @throw std::invalid_argument if the state was read without
+         *   TELEMETRY_FAULT in the profile
+         */
+        bool update(CurrentState const& state);
+
+        /** Forget the last fault code and status
+         *
+         * The fault state will be read on the next call to @c update
+         */
+        void reset();
+
+        /** Whether the fault state has been read at least once */
+        bool hasFaultState() const;
+
+        /** The last fault state read by @c update */
+        FaultState const& getFaultState() const;
+
+        /** Number of times @c update read the fault state */
+        uint64_t getFaultStateReadCount() const;
+    };
+}
+
+#endif
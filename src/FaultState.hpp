@@ -13,6 +13,7 @@ namespace motors_weg_cvw300 {
      * readings to analyze why the fault actually happened
      */
     struct FaultState {
+        /** Estimated time at which the controller sampled the fault registers */
         base::Time time;
 
         uint16_t current_fault = 0;
@@ -1,8 +1,24 @@
 #include <base/Angle.hpp>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <motors_weg_cvw300/Driver.hpp>
+#include <motors_weg_cvw300/Parameters.hpp>
+#include <motors_weg_cvw300/PeriodicSchedule.hpp>
+#include <motors_weg_cvw300/SpeedProfile.hpp>
+#include <motors_weg_cvw300/Trace.hpp>
+#include <memory>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 using namespace base;
 using namespace std;
@@ -58,6 +74,92 @@ struct SetupArguments {
     }
 };
 
+/** Path to the file in which per-controller data is saved
+ *
+ * The file name is built from the URI and the controller ID, so that the
+ * data of controllers on different ports or addresses do not collide
+ */
+string controllerFilePath(string const& uri, int id, string const& suffix)
+{
+    char const* home = getenv("HOME");
+    string dir = string(home ? home : ".") + "/.config/motors_weg_cvw300";
+
+    string key = uri;
+    for (auto& c : key) {
+        if (!isalnum(c)) {
+            c = '_';
+        }
+    }
+    return dir + "/" + key + "-" + to_string(id) + "." + suffix;
+}
+
+/** Extract the baud rate of a serial URI (serial:///dev/ttyS0:57600)
+ *
+ * Returns zero if the URI does not specify one
+ */
+int baudRateFromURI(string const& uri)
+{
+    if (uri.find("serial://") != 0) {
+        return 0;
+    }
+    auto sep = uri.rfind(':');
+    string rate = uri.substr(sep + 1);
+    if (rate.empty() || rate.find_first_not_of("0123456789") != string::npos) {
+        return 0;
+    }
+    return stoi(rate);
+}
+
+/** Capture of the frames, if enabled with MOTORS_WEG_CVW300_TRACE */
+static unique_ptr<trace::Writer> frame_trace;
+
+/** Open the driver, applying the saved interframe delay calibration if there
+ * is one
+ *
+ * If the MOTORS_WEG_CVW300_TRACE environment variable is set, the frames
+ * are appended to the trace file it names
+ */
+void openDriver(Driver& driver, string const& uri, int id)
+{
+    char const* trace_path = getenv("MOTORS_WEG_CVW300_TRACE");
+    if (trace_path && *trace_path) {
+        frame_trace.reset(new trace::Writer(trace_path));
+        driver.addListener(frame_trace.get());
+    }
+
+    driver.openURI(uri);
+    int baud_rate = baudRateFromURI(uri);
+    if (baud_rate) {
+        driver.setBaudRate(baud_rate);
+    }
+
+    ifstream calibration(controllerFilePath(uri, id, "interframe_delay"));
+    int64_t delay_us;
+    if (calibration >> delay_us) {
+        driver.setInterframeDelay(Time::fromMicroseconds(delay_us));
+    }
+}
+
+/** Read the motor ratings through the per-controller ratings cache
+ *
+ * The cache is considered fresh for 5 minutes, a delay that can be changed
+ * with the MOTORS_WEG_CVW300_RATINGS_CACHE_MAX_AGE environment variable (in
+ * seconds, 0 disables the cache)
+ */
+MotorRatings readMotorRatings(Driver& driver, string const& uri, int id)
+{
+    double max_age = 300;
+    char const* max_age_env = getenv("MOTORS_WEG_CVW300_RATINGS_CACHE_MAX_AGE");
+    if (max_age_env && *max_age_env) {
+        max_age = stod(max_age_env);
+    }
+    if (max_age <= 0) {
+        return driver.readMotorRatings();
+    }
+    return driver.readMotorRatings(controllerFilePath(uri, id, "motor_ratings"),
+                                   Time::fromMicroseconds(max_age * 1e6));
+}
+
 SetupArguments processSetupArguments(int argc, char** argv)
 {
     if (argc > 4 && argc > 12) {
@@ -95,23 +197,586 @@ SetupArguments processSetupArguments(int argc, char** argv)
     return args;
 }
 
+static double toMilliseconds(Time const& time)
+{
+    return time.toMicroseconds() / 1000.0;
+}
+
+void printTransactionStatistics(ostream& out, TransactionStatistics const& stats)
+{
+    out << setw(8) << stats.frames << " " << setw(7) << stats.retries << " "
+        << setw(8) << stats.timeouts << " " << setw(4) << stats.crc_errors << " "
+        << setw(10) << stats.exceptions << " " << setw(6) << stats.errors << " "
+        << setw(8) << toMilliseconds(stats.latency.getPercentile(0.5)) << " "
+        << setw(8) << toMilliseconds(stats.latency.getPercentile(0.99));
+}
+
+void printStatistics(ostream& out, DriverStatistics const& stats)
+{
+    string const header =
+        "  Frames; Retries; Timeouts; CRC; Exceptions; Errors; p50 (ms); p99 (ms)";
+
+    out << fixed << setprecision(1);
+    out << "Operation;                    Calls; Failures;" << header << "\n";
+    for (auto const& op : stats.operations) {
+        out << left << setw(30) << getOperationName(op.operation) << right << " "
+            << setw(5) << op.calls << " " << setw(9) << op.failures << " ";
+        printTransactionStatistics(out, op.transactions);
+        out << "\n";
+    }
+
+    out << "\nBlock;      " << header << "\n";
+    for (auto const& block : stats.blocks) {
+        string name = string(block.write ? "W " : "R ") + to_string(block.start) +
+                      "-" + to_string(block.start + block.length - 1);
+        out << left << setw(12) << name << right << " ";
+        printTransactionStatistics(out, block.transactions);
+        out << "\n";
+    }
+    if (stats.untracked_block_transactions) {
+        out << "(" << stats.untracked_block_transactions
+            << " transactions on other blocks)\n";
+    }
+
+    out << "\nTotal       " << " ";
+    printTransactionStatistics(out, stats.total);
+    out << endl;
+}
+
+void printRatings(ostream& out, MotorRatings const& ratings)
+{
+    out << "Ratings:\n"
+        << "Power: " << ratings.power << " W\n"
+        << "Current: " << ratings.current << " A\n"
+        << "Speed: " << ratings.speed / 2 / M_PI * 180 << " deg/s "
+        << "(" << ratings.speed / 2 / M_PI * 60 << " rpm)\n"
+        << "Torque: " << ratings.torque << " N.m\n"
+        << "Encoder Count: " << ratings.encoder_count << " ticks p. turn\n";
+}
+
+void printStatus(ostream& out, Driver& driver)
+{
+    out << "\n\nState:\n";
+    auto snapshot = driver.readSnapshot();
+    auto const& state = snapshot.state;
+    auto fault_state = driver.readFaultState();
+    out << "Battery Voltage: " << state.battery_voltage << " V\n"
+        << "Inverter Output Voltage: " << state.inverter_output_voltage << " V\n"
+        << "Inverter Output Frequency: " << state.inverter_output_frequency
+        << " Hz\n"
+        << "Status: " << statusToString(state.inverter_status) << "\n"
+        << "  Current fault: " << fault_state.current_fault << "\n"
+        << "Position: " << base::Angle::fromRad(state.motor.position).getDeg()
+        << " deg\n"
+        << "Speed: " << state.motor.speed / 2 / M_PI << "\n"
+        << "Torque: " << state.motor.effort << "\n"
+        << "Current: " << state.motor.raw << "\n";
+
+    out << "\n\nTemperatures:\n";
+    auto const& temperatures = snapshot.temperatures;
+    out << "Air: " << temperatures.air << "\n"
+        << "Mosfet: " << temperatures.mosfet << "\n";
+}
+
+void printFaultState(ostream& out, FaultState const& state)
+{
+    out << "Current Fault: " << state.current_fault << "\n"
+        << "Fault History:";
+    for (int i = 0; i < 5; ++i) {
+        out << " " << state.fault_history[i];
+    }
+    out << "\n"
+        << "State at point of last fault:\n"
+        << "Current: " << state.current << " A\n"
+        << "Battery Voltage: " << state.battery_voltage << " V\n"
+        << "Speed: " << static_cast<int>(state.speed / 2 / M_PI * 60) << " RPM\n"
+        << "Command: " << static_cast<int>(state.command / 2 / M_PI * 60) << " RPM\n"
+        << "Inverter Output Frequency: " << state.inverter_output_frequency
+        << " Hz\n"
+        << "Inverter Output Voltage: " << state.inverter_output_voltage << " V"
+        << endl;
+}
+
+/** Set by the daemon's SIGINT and SIGTERM handler */
+static volatile sig_atomic_t quit_daemon = 0;
+
+static void handleDaemonSignal(int)
+{
+    quit_daemon = 1;
+}
+
+/** Enable the drive with a speed command, and keep sending the command for
+ * the given time in seconds
+ *
+ * The daemon holds its speed commands with HeldSpeedCommand instead, so that
+ * it can still receive commands
+ */
+void holdSpeedCommand(Driver& driver, float command, float keep_command_time)
+{
+    auto deadline = Time::now() + Time::fromMicroseconds(keep_command_time * 1e6);
+    driver.enable(command);
+    usleep(50000);
+    while (Time::now() < deadline) {
+        driver.writeSpeedCommand(command);
+        usleep(50000);
+    }
+}
+
+/** Send a speed profile on an absolute-time schedule
+ *
+ * The command of cycle N is sent at start + N * period, regardless of the
+ * time the previous commands took. A cycle whose deadline has passed when
+ * the previous one finishes is skipped and counted as missed.
+ *
+ * One line is displayed per cycle, followed by a summary of the wakeup
+ * jitter and of the command durations
+ */
+int runSpeedProfile(Driver& driver, SpeedProfile const& profile, Time const& period)
+{
+    int64_t cycle_count = profile.getDuration().toMicroseconds() /
+                          period.toMicroseconds() + 1;
+
+    LatencyHistogram jitter;
+    LatencyHistogram durations;
+    int64_t missed = 0;
+    int64_t failed = 0;
+    cout << "Time (s); Command (rad/s); Jitter (us); Duration (us)\n";
+    PeriodicSchedule schedule(period);
+    while (schedule.getCycle() < cycle_count) {
+        int64_t cycle = schedule.getCycle();
+        int64_t deadline = schedule.getDeadline();
+        int64_t wakeup = schedule.waitDeadline();
+        float command = profile.getSpeed(
+            Time::fromMicroseconds(cycle * period.toMicroseconds()));
+        try {
+            if (cycle == 0) {
+                driver.enable(command);
+            }
+            else {
+                driver.writeSpeedCommand(command);
+            }
+        }
+        catch (std::runtime_error const& e) {
+            cerr << "cycle " << cycle << ": " << e.what() << endl;
+            failed++;
+        }
+        int64_t end = PeriodicSchedule::now();
+
+        jitter.add(PeriodicSchedule::toTime(wakeup - deadline));
+        durations.add(PeriodicSchedule::toTime(end - wakeup));
+        cout << fixed << setprecision(3) << (wakeup - schedule.getStart()) / 1e9
+             << " " << command << " " << (wakeup - deadline) / 1000 << " "
+             << (end - wakeup) / 1000 << "\n";
+
+        missed += schedule.next(end);
+    }
+
+    auto ms = [](Time const& time) { return time.toMicroseconds() / 1000.0; };
+    cout << setprecision(1) << "\nCycles: " << cycle_count << "\n"
+         << "Missed deadlines: " << missed << "\n"
+         << "Failed commands: " << failed << "\n"
+         << "Jitter p50/p99/max: " << ms(jitter.getPercentile(0.5)) << "/"
+         << ms(jitter.getPercentile(0.99)) << "/" << ms(jitter.getPercentile(1))
+         << " ms\n"
+         << "Duration p50/p99/max: " << ms(durations.getPercentile(0.5)) << "/"
+         << ms(durations.getPercentile(0.99)) << "/" << ms(durations.getPercentile(1))
+         << " ms" << endl;
+    return failed ? 1 : 0;
+}
+
+
+/** Period at which the daemon re-sends a held speed command */
+static const Time DAEMON_HOLD_PERIOD = Time::fromMilliseconds(50);
+
+/** Speed command that the daemon keeps sending between client commands */
+struct HeldSpeedCommand {
+    bool active = false;
+    float command = 0;
+    Time deadline;
+    Time next_write;
+};
+
+/** Send the held speed command if it is due, and release it when its time
+ * ran out or it failed
+ */
+static void refreshHeldSpeedCommand(Driver& driver, HeldSpeedCommand& held)
+{
+    Time now = Time::now();
+    if (!held.active || now < held.next_write) {
+        return;
+    }
+    else if (now >= held.deadline) {
+        held.active = false;
+        return;
+    }
+
+    held.next_write = now + DAEMON_HOLD_PERIOD;
+    try {
+        driver.writeSpeedCommand(held.command);
+    }
+    catch (std::exception const& e) {
+        cerr << "failed to send the held speed command, releasing it: "
+             << e.what() << endl;
+        held.active = false;
+    }
+}
+
+/** Time until the held speed command must be sent again, in milliseconds
+ *
+ * @return -1 if there is no held command
+ */
+static int timeToHeldSpeedCommand(HeldSpeedCommand const& held)
+{
+    if (!held.active) {
+        return -1;
+    }
+    Time remaining = held.next_write - Time::now();
+    return max<int64_t>(0, (remaining.toMicroseconds() + 999) / 1000);
+}
+
+/** Run a command received by the daemon
+ *
+ * The motor ratings have been read when the daemon started. The speed
+ * command returns as soon as the drive is enabled, and is held by the
+ * daemon until its time runs out, or another speed or stop command
+ * replaces it
+ *
+ * @return the command's exit code
+ */
+int runDaemonCommand(Driver& driver, vector<string> const& args, ostream& out,
+                     HeldSpeedCommand& held)
+{
+    string cmd = args.empty() ? "" : args[0];
+    if (cmd == "status" && args.size() <= 2) {
+        driver.setUseEncoderFeedback(args.size() == 2 && args[1] == "--encoder");
+        printRatings(out, driver.getMotorRatings());
+        printStatus(out, driver);
+    }
+    else if (cmd == "fault-state" && args.size() == 1) {
+        printFaultState(out, driver.readFaultState());
+    }
+    else if (cmd == "prepare" && args.size() == 1) {
+        driver.prepare();
+    }
+    else if (cmd == "speed" && (args.size() == 2 || args.size() == 3)) {
+        float command = stof(args[1]);
+        float keep_command_time = args.size() == 3 ? stof(args[2]) : 0;
+        held.active = false;
+        driver.enable(command);
+
+        Time now = Time::now();
+        held.active = keep_command_time > 0;
+        held.command = command;
+        held.deadline = now + Time::fromMicroseconds(keep_command_time * 1e6);
+        held.next_write = now + DAEMON_HOLD_PERIOD;
+    }
+    else if (cmd == "stop" && args.size() == 1) {
+        held.active = false;
+        driver.disable();
+    }
+    else {
+        out << "invalid command, the daemon accepts status [--encoder], fault-state, "
+               "prepare, speed SPEED [KEEP_CMD_TIME] and stop\n";
+        return 1;
+    }
+    return 0;
+}
+
+static bool writeAll(int fd, string const& data)
+{
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t ret = ::write(fd, data.data() + written, data.size() - written);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (ret <= 0) {
+            return false;
+        }
+        written += ret;
+    }
+    return true;
+}
+
+static sockaddr_un unixSocketAddress(string const& path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("socket path too long: " + path);
+    }
+    strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+/** Remove a stale daemon socket
+ *
+ * @return false if the path is not a socket, or if a daemon is still
+ *   listening on it. The path is left untouched in this case
+ */
+static bool removeStaleSocket(string const& path)
+{
+    struct stat info;
+    if (::lstat(path.c_str(), &info) != 0) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        cerr << "cannot access " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        cerr << path << " exists and is not a socket" << endl;
+        return false;
+    }
+
+    auto address = unixSocketAddress(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    bool listening =
+        ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    ::close(fd);
+    if (listening) {
+        cerr << "a daemon is already listening on " << path << endl;
+        return false;
+    }
+    if (::unlink(path.c_str()) != 0) {
+        cerr << "cannot remove " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    return true;
+}
+
+/** Time a client has to send its command, and to read the reply */
+static const int DAEMON_CLIENT_TIMEOUT_SECONDS = 5;
+
+/** Wait for @c fd to be readable, while sending the held speed command
+ *
+ * @return false on timeout or when the daemon is asked to quit
+ */
+static bool waitReadable(int fd, Driver& driver, HeldSpeedCommand& held,
+                         Time const& deadline)
+{
+    while (!quit_daemon) {
+        refreshHeldSpeedCommand(driver, held);
+        int64_t remaining = (deadline - Time::now()).toMilliseconds();
+        if (remaining <= 0) {
+            return false;
+        }
+        int held_timeout = timeToHeldSpeedCommand(held);
+        int timeout = static_cast<int>(
+            held_timeout < 0 ? remaining : min<int64_t>(remaining, held_timeout)
+        );
+
+        pollfd pfd = {};
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        if (::poll(&pfd, 1, timeout) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Read the command line sent by a client
+ *
+ * @return false if the client did not send a full line in time
+ */
+static bool readDaemonRequest(int client, Driver& driver, HeldSpeedCommand& held,
+                              string& request)
+{
+    Time deadline = Time::now() + Time::fromSeconds(DAEMON_CLIENT_TIMEOUT_SECONDS);
+    char buffer[256];
+    while (request.find('\n') == string::npos) {
+        if (!waitReadable(client, driver, held, deadline)) {
+            return false;
+        }
+        ssize_t size = ::read(client, buffer, sizeof(buffer));
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (size <= 0) {
+            return false;
+        }
+        request.append(buffer, size);
+    }
+    request = request.substr(0, request.find('\n'));
+    return true;
+}
+
+/** Keep the driver open and run the commands received on a Unix socket
+ *
+ * Each connection carries a single command, sent as a line with the
+ * arguments separated by spaces. The daemon answers with the command's
+ * output, followed by a last line "exit CODE", and closes the connection.
+ * The commands are run one at a time, in the order the connections are
+ * accepted. A held speed command is sent in the background while the daemon
+ * waits for commands, so that a stop or a new speed command takes effect
+ * immediately.
+ */
+int serve(Driver& driver, string const& socket_path)
+{
+    auto address = unixSocketAddress(socket_path);
+    if (!removeStaleSocket(socket_path)) {
+        return 1;
+    }
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 ||
+        ::bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(server, 16) != 0) {
+        cerr << "cannot listen on " << socket_path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    // No SA_RESTART, so that accept returns on SIGINT and SIGTERM
+    struct sigaction action = {};
+    action.sa_handler = handleDaemonSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    cout << "listening on " << socket_path << endl;
+    HeldSpeedCommand held;
+    while (!quit_daemon) {
+        refreshHeldSpeedCommand(driver, held);
+        pollfd pfd = {};
+        pfd.fd = server;
+        pfd.events = POLLIN;
+        if (::poll(&pfd, 1, timeToHeldSpeedCommand(held)) <= 0) {
+            continue;
+        }
+        int client = ::accept(server, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+
+        // A client that does not send a full line, or does not read the
+        // reply, must not block the daemon
+        timeval timeout = {};
+        timeout.tv_sec = DAEMON_CLIENT_TIMEOUT_SECONDS;
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        string request;
+        if (!readDaemonRequest(client, driver, held, request)) {
+            writeAll(client, "error: incomplete command\nexit 1\n");
+            ::close(client);
+            continue;
+        }
+
+        vector<string> args;
+        istringstream tokens(request);
+        for (string arg; tokens >> arg;) {
+            args.push_back(arg);
+        }
+
+        ostringstream out;
+        int code;
+        try {
+            code = runDaemonCommand(driver, args, out, held);
+        }
+        catch (std::exception const& e) {
+            out << "error: " << e.what() << "\n";
+            code = 1;
+        }
+        out << "exit " << code << "\n";
+        writeAll(client, out.str());
+        ::close(client);
+    }
+
+    ::close(server);
+    ::unlink(socket_path.c_str());
+    return 0;
+}
+
+/** Send a command to a daemon started with 'serve', and display its output
+ *
+ * @return the command's exit code
+ */
+int runClient(string const& socket_path, vector<string> const& args)
+{
+    auto address = unixSocketAddress(socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 ||
+        ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        cerr << "cannot connect to " << socket_path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    string request;
+    for (auto const& arg : args) {
+        request += (request.empty() ? "" : " ") + arg;
+    }
+    if (!writeAll(fd, request + "\n")) {
+        cerr << "failed to send the command to the daemon" << endl;
+        return 1;
+    }
+
+    string reply;
+    char buffer[1024];
+    ssize_t size;
+    while ((size = ::read(fd, buffer, sizeof(buffer))) > 0) {
+        reply.append(buffer, size);
+    }
+    ::close(fd);
+
+    // The last line is the exit code
+    auto last = reply.rfind("exit ");
+    if (last == string::npos || (last > 0 && reply[last - 1] != '\n')) {
+        cerr << reply << "\nthe daemon closed the connection unexpectedly" << endl;
+        return 1;
+    }
+    cout << reply.substr(0, last) << flush;
+    return stoi(reply.substr(last + 5));
+}
+
 void usage(ostream& stream)
 {
     stream << "usage: motors_weg_cvw300_ctl URI ID CMD\n"
+           << "       motors_weg_cvw300_ctl --socket SOCKET CMD\n"
            << "Factory defaults: 19200, ID=1\n"
+           << "Set MOTORS_WEG_CVW300_TRACE to a file path to capture the frames "
+              "(see motors_weg_cvw300_trace)\n"
+           << "The motor ratings are cached for 5 minutes in "
+              "~/.config/motors_weg_cvw300. Set "
+              "MOTORS_WEG_CVW300_RATINGS_CACHE_MAX_AGE to change the delay, in "
+              "seconds (0 disables the cache)\n"
            << "\n"
            << "Available Commands\n"
            << "  status [--encoder]: query the controller status\n"
            << "  poll [--encoder]: repeatedly display the motor state\n"
            << "  prepare: configures the drive and resets failure(s)\n"
            << "  fault-state: read current and historical fault state\n"
-           << "  cfg-dump: output all configuration variables\n"
+           << "  cfg-dump [--reference DUMP | --probe-access]: output all "
+              "configuration variables. The access mode of the parameters the "
+              "driver does not know is taken from the DUMP reference file. "
+              "--probe-access finds it by writing the values back instead, "
+              "which is slow and writes to the controller\n"
            << "  cfg-load: set configuration from a dump file\n"
-           << "  cfg-diff: compare configuration of a file with the controller's\n"
+           << "  cfg-digest: save the digest of a dump file alongside it (as "
+              "DUMP.digest)\n"
+           << "  cfg-diff: compare configuration of a file with the controller's. "
+              "If the file has a digest, only the blocks that differ from the "
+              "digest are compared\n"
            << "  cfg-save: make in-memory configuration permanent\n"
+           << "  calibrate [--save]: find the smallest interframe delay the "
+              "controller can handle. With --save, the result is used by all "
+              "subsequent commands on this URI and ID\n"
            << "  speed SPEED [KEEP_CMD_TIME]: writes a speed command in the controller, "
               "if KEEP_CMD_TIME is passed it maintains the speed command for that amount "
               "of time in seconds\n"
+           << "  profile FILE [PERIOD]: send the speed profile in FILE ('-' for the "
+              "standard input) every PERIOD seconds (default 0.05). FILE has one "
+              "'TIME SPEED' line per point, in seconds and rad/s, the speed being "
+              "interpolated between the points. The profile should end with a zero "
+              "speed, as the last command is kept when it ends\n"
+           << "  serve SOCKET: keep the controller open and run the status, "
+              "fault-state, prepare, speed and stop commands received on the SOCKET "
+              "Unix socket. Send them with motors_weg_cvw300_ctl --socket SOCKET CMD. "
+              "The speed command returns immediately, the daemon keeping the command "
+              "for KEEP_CMD_TIME unless a new speed or stop command replaces it\n"
+           << "  stats [COUNT]: read the state, temperatures and alarm COUNT times "
+              "(100), and display the bus statistics\n"
            << endl;
 }
 
@@ -123,6 +788,10 @@ int main(int argc, char** argv)
         return error;
     }
 
+    if (argv[1] == string("--socket")) {
+        return runClient(argv[2], vector<string>(argv + 3, argv + argc));
+    }
+
     string uri = argv[1];
     int id = std::atoi(argv[2]);
     string cmd = argv[3];
@@ -139,36 +808,10 @@ int main(int argc, char** argv)
         }
 
         Driver driver(id);
-        driver.openURI(uri);
+        openDriver(driver, uri, id);
         driver.setUseEncoderFeedback(encoder);
-        auto ratings = driver.readMotorRatings();
-        cout << "Ratings:\n"
-             << "Power: " << ratings.power << " W\n"
-             << "Current: " << ratings.current << " A\n"
-             << "Speed: " << ratings.speed / 2 / M_PI * 180 << " deg/s "
-             << "(" << ratings.speed / 2 / M_PI * 60 << " rpm)\n"
-             << "Torque: " << ratings.torque << " N.m\n"
-             << "Encoder Count: " << ratings.encoder_count << " ticks p. turn\n";
-
-        cout << "\n\nState:\n";
-        auto state = driver.readCurrentState();
-        auto fault_state = driver.readFaultState();
-        cout << "Battery Voltage: " << state.battery_voltage << " V\n"
-             << "Inverter Output Voltage: " << state.inverter_output_voltage << " V\n"
-             << "Inverter Output Frequency: " << state.inverter_output_frequency
-             << " Hz\n"
-             << "Status: " << statusToString(state.inverter_status) << "\n"
-             << "  Current fault: " << fault_state.current_fault << "\n"
-             << "Position: " << base::Angle::fromRad(state.motor.position).getDeg()
-             << " deg\n"
-             << "Speed: " << state.motor.speed / 2 / M_PI << "\n"
-             << "Torque: " << state.motor.effort << "\n"
-             << "Current: " << state.motor.raw << "\n";
-
-        cout << "\n\nTemperatures:\n";
-        auto temperatures = driver.readTemperatures();
-        cout << "Air: " << temperatures.air << "\n"
-             << "Mosfet: " << temperatures.mosfet << "\n";
+        printRatings(cout, readMotorRatings(driver, uri, id));
+        printStatus(cout, driver);
     }
     else if (cmd == "poll") {
         bool encoder = false;
@@ -182,9 +825,9 @@ int main(int argc, char** argv)
         }
 
         Driver driver(id);
-        driver.openURI(uri);
+        openDriver(driver, uri, id);
         driver.setUseEncoderFeedback(encoder);
-        driver.readMotorRatings();
+        readMotorRatings(driver, uri, id);
         std::cout << "Status; Bat (V); Output (V); Output (Hz); "
                      "Position (deg); Speed (rpm); orque (N.m); Current (A)\n";
 
@@ -202,56 +845,61 @@ int main(int argc, char** argv)
     }
     else if (cmd == "prepare") {
         Driver driver(id);
-        driver.openURI(uri);
+        openDriver(driver, uri, id);
         driver.prepare();
     }
     else if (cmd == "fault-state") {
         Driver driver(id);
-        driver.openURI(uri);
-        driver.readMotorRatings();
-        auto state = driver.readFaultState();
-        cout << "Current Fault: " << state.current_fault << "\n"
-             << "Fault History:";
-        for (int i = 0; i < 5; ++i) {
-            cout << " " << state.fault_history[i];
-        }
-        cout << "\n"
-             << "State at point of last fault:\n"
-             << "Current: " << state.current << " A\n"
-             << "Battery Voltage: " << state.battery_voltage << " V\n"
-             << "Speed: " << static_cast<int>(state.speed / 2 / M_PI * 60) << " RPM\n"
-             << "Command: " << static_cast<int>(state.command / 2 / M_PI * 60) << " RPM\n"
-             << "Inverter Output Frequency: " << state.inverter_output_frequency
-             << " Hz\n"
-             << "Inverter Output Voltage: " << state.inverter_output_voltage << " V"
-             << endl;
+        openDriver(driver, uri, id);
+        readMotorRatings(driver, uri, id);
+        printFaultState(cout, driver.readFaultState());
     }
     else if (cmd == "cfg-dump") {
-        if (argc != 4) {
-            cerr << "too many arguments to 'cfg-dump'\n" << std::endl;
-            usage(cerr);
-            return 1;
+        parameters::DumpSettings settings;
+        if (argc == 5 && argv[4] == string("--probe-access")) {
+            settings.probe_access = true;
         }
-
-        modbus::Master modbus;
-        modbus.openURI(uri);
-
-        for (int i = 1; i < 1060; ++i) {
-            uint16_t value;
+        else if (argc == 6 && argv[4] == string("--reference")) {
+            ifstream in(argv[5]);
+            if (!in) {
+                cerr << "cannot open " << argv[5] << endl;
+                return 1;
+            }
             try {
-                value = modbus.readSingleRegister(id, false, i);
+                settings.reference = parameters::parse(in);
             }
-            catch (modbus::RequestException const&) {
-                continue;
+            catch (std::invalid_argument const& e) {
+                cerr << e.what() << std::endl;
+                return 1;
             }
+        }
+        else if (argc != 4) {
+            cerr << "invalid arguments to 'cfg-dump'\n" << std::endl;
+            usage(cerr);
+            return 1;
+        }
 
-            try {
-                modbus.writeSingleRegister(id, i, value);
-                std::cout << i << " " << value << " rw\n";
+        Driver driver(id);
+        openDriver(driver, uri, id);
+
+        auto result = parameters::dump(driver, settings);
+        for (auto const& param : result.parameters) {
+            std::cout << param.id << " " << param.value << " "
+                      << parameters::accessToString(param.access) << "\n";
+        }
+        if (!result.invalid.empty()) {
+            cerr << "# parameters refused by the controller:";
+            for (int param : result.invalid) {
+                cerr << " " << param;
             }
-            catch (modbus::RequestException const&) {
-                std::cout << i << " " << value << " ro\n";
+            cerr << endl;
+        }
+        if (!result.unclassified.empty()) {
+            cerr << "# parameters of unknown access, recorded as ro:";
+            for (int param : result.unclassified) {
+                cerr << " " << param;
             }
+            cerr << "\n# use --reference or --probe-access to classify them" << endl;
         }
     }
     else if (cmd == "cfg-load") {
@@ -264,30 +912,66 @@ int main(int argc, char** argv)
 
         string dumpfile = string(argv[4]);
         ifstream in(dumpfile);
+        vector<parameters::Parameter> params;
+        try {
+            params = parameters::parse(in);
+        }
+        catch (std::invalid_argument const& e) {
+            cerr << e.what() << std::endl;
+            return 1;
+        }
 
-        modbus::Master modbus;
-        modbus.openURI(uri);
+        Driver driver(id);
+        openDriver(driver, uri, id);
 
-        while (true) {
-            int param;
-            int value;
-            string mode;
-            in >> param >> value >> mode;
-            if (!in) {
-                break;
-            }
+        auto load = parameters::load(driver, params);
+        // The configuration may have changed the motor ratings
+        error_code ec;
+        filesystem::remove(controllerFilePath(uri, id, "motor_ratings"), ec);
+        cout << "wrote " << load.written.size() << " parameters in " << load.frames
+             << " frames" << endl;
+        for (int param : load.refused) {
+            cerr << "controller refused to write param " << param << endl;
+        }
+        for (int param : load.failed) {
+            cerr << "could not write param " << param << ": no valid reply" << endl;
+        }
 
-            if (mode != "rw" && mode != "ro") {
-                cerr << "unexpected mode '" << mode << "' for param " << param
-                     << std::endl;
-                return 1;
-            }
+        auto verify = parameters::verify(driver, params);
+        for (auto const& mismatch : verify.mismatches) {
+            cerr << "Param: " << mismatch.id << "\n"
+                 << "  controller: " << mismatch.actual << "\n"
+                 << "  file: " << mismatch.expected << endl;
+        }
+        for (int param : verify.invalid) {
+            cerr << "could not read back param " << param << endl;
+        }
+        if (!load.refused.empty() || !load.failed.empty() ||
+            !verify.mismatches.empty() || !verify.invalid.empty()) {
+            return 1;
+        }
+    }
+    else if (cmd == "cfg-digest") {
+        if (argc != 5) {
+            cerr << "too " << (argc < 5 ? "few" : "many")
+                 << " arguments to 'cfg-digest'\n" << std::endl;
+            usage(cerr);
+            return 1;
+        }
 
-            if (mode == "rw") {
-                cout << param << ": " << value << endl;
-                modbus.writeSingleRegister(id, param, value);
-            }
+        string dumpfile = string(argv[4]);
+        ifstream in(dumpfile);
+        vector<parameters::Parameter> params;
+        try {
+            params = parameters::parse(in);
+        }
+        catch (std::invalid_argument const& e) {
+            cerr << e.what() << std::endl;
+            return 1;
         }
+
+        ofstream out(dumpfile + ".digest");
+        parameters::writeDigest(out, parameters::computeDigest(params));
     }
     else if (cmd == "cfg-diff") {
         if (argc != 5) {
@@ -299,38 +983,51 @@ int main(int argc, char** argv)
 
         string dumpfile = string(argv[4]);
         ifstream in(dumpfile);
+        vector<parameters::Parameter> params;
+        vector<parameters::BlockDigest> digest;
+        try {
+            params = parameters::parse(in);
+            ifstream digest_in(dumpfile + ".digest");
+            digest = parameters::parseDigest(digest_in);
+        }
+        catch (std::invalid_argument const& e) {
+            cerr << e.what() << std::endl;
+            return 1;
+        }
 
-        modbus::Master modbus;
-        modbus.openURI(uri);
-
-        while (true) {
-            int param;
-            int expected;
-            string mode;
-            in >> param >> expected >> mode;
-            if (!in) {
-                break;
-            }
+        Driver driver(id);
+        openDriver(driver, uri, id);
 
-            if (mode != "rw" && mode != "ro") {
-                cerr << "unexpected mode '" << mode << "' for param " << param
-                     << std::endl;
-                return 1;
-            }
+        vector<parameters::Mismatch> mismatches;
+        vector<int> invalid;
+        if (digest.empty()) {
+            auto result = parameters::verify(driver, params);
+            mismatches = result.mismatches;
+            invalid = result.invalid;
+        }
+        else {
+            auto result = parameters::diff(driver, params, digest);
+            mismatches = result.mismatches;
+            invalid = result.invalid;
+            cerr << result.changed_blocks.size() << " of " << digest.size()
+                 << " blocks differ (" << result.frames << " frames)" << endl;
+        }
 
-            if (mode == "rw") {
-                uint16_t current = modbus.readSingleRegister(id, false, param);
-                if (current != expected) {
-                    cout << "Param: " << param << "\n"
-                         << "  controller: " << current << "\n"
-                         << "  file: " << expected << endl;
-                }
-            }
+        for (auto const& mismatch : mismatches) {
+            cout << "Param: " << mismatch.id << "\n"
+                 << "  controller: " << mismatch.actual << "\n"
+                 << "  file: " << mismatch.expected << endl;
+        }
+        for (int param : invalid) {
+            cerr << "could not read param " << param << endl;
+        }
+        if (!mismatches.empty() || !invalid.empty()) {
+            return 1;
         }
     }
     else if (cmd == "cfg-save") {
         Driver driver(id);
-        driver.openURI(uri);
+        openDriver(driver, uri, id);
         driver.configSave();
     }
     else if (cmd == "speed") {
@@ -348,20 +1045,137 @@ int main(int argc, char** argv)
             return 1;
         }
         Driver driver(id);
-        driver.openURI(uri);
+        openDriver(driver, uri, id);
+        readMotorRatings(driver, uri, id);
+        holdSpeedCommand(driver, command, keep_command_time);
+    }
+    else if (cmd == "profile") {
+        if (argc != 5 && argc != 6) {
+            cerr << "'profile' requires a profile file and an optional period\n"
+                 << std::endl;
+            usage(cerr);
+            return 1;
+        }
 
-        auto deadline = Time::now() + Time::fromMicroseconds(keep_command_time * 1e6);
-        driver.readMotorRatings();
-        driver.enable();
-        do {
-            driver.writeSpeedCommand(command);
-            usleep(50000);
-        } while (Time::now() < deadline);
+        SpeedProfile profile;
+        try {
+            if (argv[4] == string("-")) {
+                profile = SpeedProfile::parse(cin);
+            }
+            else {
+                ifstream in(argv[4]);
+                if (!in) {
+                    cerr << "cannot open " << argv[4] << endl;
+                    return 1;
+                }
+                profile = SpeedProfile::parse(in);
+            }
+        }
+        catch (std::invalid_argument const& e) {
+            cerr << argv[4] << ": " << e.what() << endl;
+            return 1;
+        }
+        if (profile.points.empty()) {
+            cerr << argv[4] << ": empty profile" << endl;
+            return 1;
+        }
+        Time period = Time::fromMilliseconds(50);
+        if (argc == 6) {
+            period = Time::fromMicroseconds(stof(argv[5]) * 1e6);
+        }
+        if (period.toMicroseconds() <= 0) {
+            cerr << "the period must be positive" << endl;
+            return 1;
+        }
+
+        Driver driver(id);
+        openDriver(driver, uri, id);
+        readMotorRatings(driver, uri, id);
+        return runSpeedProfile(driver, profile, period);
+    }
+    else if (cmd == "calibrate") {
+        bool save = false;
+        if (argc == 5 && argv[4] == string("--save")) {
+            save = true;
+        }
+        else if (argc != 4) {
+            cerr << "'calibrate' accepts only an optional --save argument\n"
+                 << std::endl;
+            usage(cerr);
+            return 1;
+        }
+
+        Driver driver(id);
+        openDriver(driver, uri, id);
+        auto result = driver.calibrateInterframeDelay();
+        cout << "Delay (ms); Transactions; Timeouts; Errors\n";
+        for (auto const& step : result.steps) {
+            cout << setw(10) << step.delay.toMicroseconds() / 1000.0 << " "
+                 << setw(12) << step.transactions << " " << setw(8)
+                 << step.timeouts << " " << setw(6) << step.errors << "\n";
+        }
+
+        if (!result.success) {
+            cerr << "could not find a safe interframe delay, the previous delay "
+                    "is kept" << endl;
+            return 1;
+        }
+        cout << "Smallest safe delay: "
+             << result.smallest_safe.toMicroseconds() / 1000.0 << " ms\n"
+             << "Recommended delay: "
+             << result.recommended.toMicroseconds() / 1000.0 << " ms" << endl;
+
+        if (save) {
+            string path = controllerFilePath(uri, id, "interframe_delay");
+            filesystem::create_directories(filesystem::path(path).parent_path());
+            ofstream out(path);
+            out << result.recommended.toMicroseconds() << "\n";
+            cout << "Saved in " << path << endl;
+        }
+    }
+    else if (cmd == "stats") {
+        int count = 100;
+        if (argc == 5) {
+            count = stoi(argv[4]);
+        }
+        else if (argc > 5) {
+            cerr << "too many arguments to 'stats'\n" << std::endl;
+            usage(cerr);
+            return 1;
+        }
+
+        Driver driver(id);
+        openDriver(driver, uri, id);
+        readMotorRatings(driver, uri, id);
+        for (int i = 0; i < count; ++i) {
+            // The errors are what we are looking for, keep going
+            try {
+                driver.readCurrentState();
+                driver.readTemperatures();
+                driver.readCurrentAlarm();
+            }
+            catch (std::runtime_error const&) {
+            }
+        }
+        printStatistics(cout, driver.getStatistics());
+    }
+    else if (cmd == "serve") {
+        if (argc != 5) {
+            cerr << "'serve' requires the path of the socket\n" << std::endl;
+            usage(cerr);
+            return 1;
+        }
+
+        Driver driver(id);
+        openDriver(driver, uri, id);
+        readMotorRatings(driver, uri, id);
+        return serve(driver, argv[4]);
     }
     else if (cmd == "setup") {
 
         Driver driver(id);
-        driver.openURI(uri);
+        openDriver(driver, uri, id);
+        driver.readConfigurationRegisters();
         driver.prepare();
 
         auto args = processSetupArguments(argc, argv);
@@ -0,0 +1,410 @@
+#include <motors_weg_cvw300/Parameters.hpp>
+#include <motors_weg_cvw300/Driver.hpp>
+#include <motors_weg_cvw300/Registers.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+using namespace motors_weg_cvw300;
+using namespace motors_weg_cvw300::parameters;
+
+bool parameters::isCommandParameter(int id) {
+    return id == registers::CONFIG_SAVE.id ||
+           id == registers::SERIAL_STATUS_WORD.id ||
+           id == registers::SERIAL_REFERENCE_SPEED.id;
+}
+
+char const* parameters::accessToString(Access access) {
+    switch (access) {
+        case ACCESS_RO:
+            return "ro";
+        case ACCESS_RW:
+            return "rw";
+        default:
+            return "invalid";
+    }
+}
+
+typedef map<int, uint16_t> Values;
+
+/** Read a block of registers, splitting it on exception replies until the
+ * parameters that cannot be read are found
+ *
+ * @return the number of frames sent
+ */
+static int readBlock(Values& values, vector<int>& invalid,
+                     Driver& driver, int start, int length) {
+    vector<uint16_t> block(length);
+    try {
+        driver.readRegisters(block.data(), start, length);
+    }
+    catch (modbus::RequestException const&) {
+        if (length == 1) {
+            invalid.push_back(start);
+            return 1;
+        }
+
+        int half = length / 2;
+        return 1 + readBlock(values, invalid, driver, start, half) +
+               readBlock(values, invalid, driver, start + half, length - half);
+    }
+
+    for (int i = 0; i < length; ++i) {
+        values[start + i] = block[i];
+    }
+    return 1;
+}
+
+Access parameters::getStaticAccess(int id) {
+    for (auto const& r : registers::ALL) {
+        if (r.id == id) {
+            return r.access;
+        }
+    }
+    return ACCESS_INVALID;
+}
+
+/** Find whether a parameter is read-write by writing its current value back */
+static Access probeAccess(Driver& driver, int id, uint16_t value) {
+    try {
+        driver.writeSingleRegister<uint16_t>(id, value);
+        return ACCESS_RW;
+    }
+    catch (modbus::RequestException const&) {
+        return ACCESS_RO;
+    }
+}
+
+DumpResult parameters::dump(Driver& driver, DumpSettings const& settings) {
+    map<int, Access> reference;
+    for (auto const& p : settings.reference) {
+        reference[p.id] = p.access;
+    }
+
+    DumpResult result;
+    for (int start = settings.first; start <= settings.last;
+         start += ReadPlan::MAX_REGISTERS_PER_FRAME) {
+        int length = min(ReadPlan::MAX_REGISTERS_PER_FRAME, settings.last - start + 1);
+        Values values;
+        readBlock(values, result.invalid, driver, start, length);
+        for (auto const& v : values) {
+            Access access = getStaticAccess(v.first);
+            if (access == ACCESS_INVALID) {
+                auto it = reference.find(v.first);
+                if (it != reference.end()) {
+                    access = it->second;
+                }
+                else if (settings.probe_access) {
+                    access = probeAccess(driver, v.first, v.second);
+                }
+                else {
+                    access = ACCESS_RO;
+                    result.unclassified.push_back(v.first);
+                }
+            }
+            result.parameters.push_back(Parameter{ v.first, v.second, access });
+        }
+    }
+    return result;
+}
+
+vector<Parameter> parameters::parse(istream& in) {
+    vector<Parameter> result;
+    while (true) {
+        int param;
+        int value;
+        string mode;
+        in >> param >> value >> mode;
+        if (!in) {
+            break;
+        }
+
+        Access access;
+        if (mode == "rw") {
+            access = ACCESS_RW;
+        }
+        else if (mode == "ro") {
+            access = ACCESS_RO;
+        }
+        else {
+            throw std::invalid_argument("unexpected mode '" + mode +
+                                        "' for param " + to_string(param));
+        }
+        result.push_back(Parameter{ param, static_cast<uint16_t>(value), access });
+    }
+    return result;
+}
+
+static vector<Parameter> selectWritable(vector<Parameter> const& parameters) {
+    vector<Parameter> result;
+    for (auto const& p : parameters) {
+        if (p.access == ACCESS_RW && !isCommandParameter(p.id)) {
+            result.push_back(p);
+        }
+    }
+    sort(result.begin(), result.end(),
+         [](Parameter const& a, Parameter const& b) { return a.id < b.id; });
+    return result;
+}
+
+/** Number of times a write is sent before giving up on a parameter */
+static const int LOAD_WRITE_ATTEMPTS = 3;
+
+/** How a write done by @c load ended */
+enum WriteOutcome {
+    WRITE_DONE,
+    /** The controller replied with an exception */
+    WRITE_REFUSED,
+    /** No valid reply was received, even after retrying */
+    WRITE_FAILED
+};
+
+/** Write contiguous parameters
+ *
+ * Writing the same values twice is harmless, so a write that got no valid
+ * reply (timeout, CRC error, ...) is sent again
+ */
+static WriteOutcome writeParameters(LoadResult& result, Driver& driver,
+                                    int start, vector<uint16_t> const& values) {
+    for (int attempt = 0; attempt < LOAD_WRITE_ATTEMPTS; ++attempt) {
+        result.frames++;
+        try {
+            if (values.size() == 1) {
+                driver.writeSingleRegister<uint16_t>(start, values[0]);
+            }
+            else {
+                driver.writeRegisters(start, values);
+            }
+            return WRITE_DONE;
+        }
+        catch (modbus::RequestException const&) {
+            return WRITE_REFUSED;
+        }
+        catch (std::runtime_error const&) {
+        }
+    }
+    return WRITE_FAILED;
+}
+
+static void recordWrite(LoadResult& result, int id, WriteOutcome outcome) {
+    switch (outcome) {
+        case WRITE_DONE:
+            result.written.push_back(id);
+            break;
+        case WRITE_REFUSED:
+            result.refused.push_back(id);
+            break;
+        case WRITE_FAILED:
+            result.failed.push_back(id);
+            break;
+    }
+}
+
+LoadResult parameters::load(Driver& driver, vector<Parameter> const& parameters) {
+    auto writable = selectWritable(parameters);
+
+    LoadResult result;
+    size_t i = 0;
+    while (i < writable.size()) {
+        size_t end = i + 1;
+        while (end < writable.size() &&
+               writable[end].id == writable[end - 1].id + 1 &&
+               end - i < MAX_REGISTERS_PER_WRITE) {
+            ++end;
+        }
+
+        vector<uint16_t> values;
+        for (size_t j = i; j < end; ++j) {
+            values.push_back(writable[j].value);
+        }
+
+        auto outcome = writeParameters(result, driver, writable[i].id, values);
+        if (outcome == WRITE_REFUSED && values.size() > 1) {
+            // Write the parameters one by one to find the refused ones
+            for (size_t j = i; j < end; ++j) {
+                recordWrite(result, writable[j].id,
+                            writeParameters(result, driver, writable[j].id,
+                                            { writable[j].value }));
+            }
+        }
+        else {
+            for (size_t j = i; j < end; ++j) {
+                recordWrite(result, writable[j].id, outcome);
+            }
+        }
+        i = end;
+    }
+    return result;
+}
+
+/** Plan the reads of the given read-write parameters
+ *
+ * The plan only merges reads across parameters that are in the dump, that
+ * is parameters known to be readable
+ */
+static ReadPlan planReads(vector<Parameter> const& parameters,
+                          vector<Parameter> const& writable,
+                          BusCostModel const& model) {
+    ReadPlan plan;
+    for (auto const& p : writable) {
+        plan.add(p.id);
+    }
+    if (!writable.empty()) {
+        vector<bool> dumped(writable.back().id - writable.front().id + 1, false);
+        for (auto const& p : parameters) {
+            int offset = p.id - writable.front().id;
+            if (offset >= 0 && offset < static_cast<int>(dumped.size())) {
+                dumped[offset] = true;
+            }
+        }
+        for (size_t i = 0; i < dumped.size(); ++i) {
+            if (!dumped[i]) {
+                plan.exclude(writable.front().id + i);
+            }
+        }
+    }
+    plan.compile(model);
+    return plan;
+}
+
+VerifyResult parameters::verify(Driver& driver, vector<Parameter> const& parameters) {
+    auto writable = selectWritable(parameters);
+    ReadPlan plan = planReads(parameters, writable, driver.getBusCostModel());
+
+    VerifyResult result;
+    Values values;
+    for (auto const& block : plan.getBlocks()) {
+        readBlock(values, result.invalid, driver, block.start, block.length);
+    }
+
+    for (auto const& p : writable) {
+        auto it = values.find(p.id);
+        if (it != values.end() && it->second != p.value) {
+            result.mismatches.push_back(Mismatch{ p.id, p.value, it->second });
+        }
+    }
+    return result;
+}
+
+static const uint32_t FNV_OFFSET_BASIS = 2166136261u;
+static const uint32_t FNV_PRIME = 16777619u;
+
+static uint32_t hashUpdate(uint32_t hash, uint16_t value) {
+    hash = (hash ^ (value & 0xFF)) * FNV_PRIME;
+    return (hash ^ (value >> 8)) * FNV_PRIME;
+}
+
+/** FNV-1a hash of the values of a block
+ *
+ * Only the parameters of @a selection (the read-write parameters of the
+ * dump) are hashed. Both the parameter IDs and the values are hashed, so
+ * that a parameter missing from @a values changes the hash
+ */
+static uint32_t hashBlock(ReadPlan::Block const& block, Values const& selection,
+                          Values const& values) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    auto begin = selection.lower_bound(block.start);
+    auto end = selection.lower_bound(block.start + block.length);
+    for (auto it = begin; it != end; ++it) {
+        auto value = values.find(it->first);
+        if (value == values.end()) {
+            continue;
+        }
+        hash = hashUpdate(hash, it->first);
+        hash = hashUpdate(hash, value->second);
+    }
+    return hash;
+}
+
+static Values toValues(vector<Parameter> const& parameters) {
+    Values values;
+    for (auto const& p : parameters) {
+        if (p.access == ACCESS_RW && !isCommandParameter(p.id)) {
+            values[p.id] = p.value;
+        }
+    }
+    return values;
+}
+
+vector<BlockDigest> parameters::computeDigest(vector<Parameter> const& parameters,
+                                              int first, int last,
+                                              BusCostModel const& model) {
+    Values values = toValues(parameters);
+
+    vector<Parameter> writable;
+    for (auto const& p : selectWritable(parameters)) {
+        if (p.id >= first && p.id <= last) {
+            writable.push_back(p);
+        }
+    }
+    ReadPlan plan = planReads(parameters, writable, model);
+
+    vector<BlockDigest> digest;
+    for (auto const& block : plan.getBlocks()) {
+        digest.push_back(
+            BlockDigest{ block.start, block.length, hashBlock(block, values, values) }
+        );
+    }
+    return digest;
+}
+
+void parameters::writeDigest(ostream& out, vector<BlockDigest> const& digest) {
+    for (auto const& block : digest) {
+        out << block.start << " " << block.length << " "
+            << hex << setw(8) << setfill('0') << block.hash
+            << dec << setfill(' ') << "\n";
+    }
+}
+
+vector<BlockDigest> parameters::parseDigest(istream& in) {
+    vector<BlockDigest> result;
+    while (true) {
+        int start;
+        int length;
+        uint32_t hash;
+        in >> dec >> start >> length >> hex >> hash;
+        if (!in) {
+            break;
+        }
+
+        if (length < 1 || length > ReadPlan::MAX_REGISTERS_PER_FRAME) {
+            throw std::invalid_argument("invalid length " + to_string(length) +
+                                        " for digest block starting at " +
+                                        to_string(start));
+        }
+        result.push_back(BlockDigest{ start, length, hash });
+    }
+    return result;
+}
+
+DiffResult parameters::diff(Driver& driver, vector<Parameter> const& parameters,
+                            vector<BlockDigest> const& digest) {
+    Values expected = toValues(parameters);
+
+    DiffResult result;
+    for (auto const& block_digest : digest) {
+        ReadPlan::Block block{ block_digest.start, block_digest.length };
+
+        Values actual;
+        result.frames += readBlock(actual, result.invalid, driver,
+                                   block.start, block.length);
+        if (hashBlock(block, expected, actual) == block_digest.hash) {
+            continue;
+        }
+
+        result.changed_blocks.push_back(block_digest);
+        for (int id = block.start; id < block.start + block.length; ++id) {
+            auto e = expected.find(id);
+            auto a = actual.find(id);
+            if (e == expected.end() || a == actual.end()) {
+                continue;
+            }
+            if (e->second != a->second) {
+                result.mismatches.push_back(Mismatch{ id, e->second, a->second });
+            }
+        }
+    }
+    return result;
+}
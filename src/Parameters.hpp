@@ -0,0 +1,221 @@
+#ifndef MOTORS_WEG_CVW300_PARAMETERS_HPP
+#define MOTORS_WEG_CVW300_PARAMETERS_HPP
+
+#include <cstdint>
+#include <istream>
+#include <motors_weg_cvw300/ReadPlan.hpp>
+#include <ostream>
+#include <vector>
+
+namespace motors_weg_cvw300 {
+    class Driver;
+
+    /**
+     * Access to the whole CVW300 parameter space, used to dump and restore
+     * a controller's configuration
+     *
+     * The controller is accessed through the Driver, so that these functions
+     * can be used while polling or on a shared bus
+     */
+    namespace parameters {
+        /** Highest parameter number of the CVW300 */
+        static const int MAX_PARAMETER = 1059;
+
+        /** Maximum number of registers in a Write Multiple Registers frame */
+        static const int MAX_REGISTERS_PER_WRITE = 123;
+
+        enum Access {
+            /** The parameter does not exist, reading it returns an exception */
+            ACCESS_INVALID,
+            /** Read-only parameter */
+            ACCESS_RO,
+            /** Read-write parameter */
+            ACCESS_RW
+        };
+
+        /** Whether a parameter commands the drive or triggers an action
+         *
+         * These are the configuration save (303), the serial status word
+         * (682) and the serial speed reference (683). Their value in a dump
+         * is only what the drive was doing when it was taken, so they are
+         * never written back, compared nor hashed.
+         */
+        bool isCommandParameter(int id);
+
+        /** The access mode of a parameter in the compiled-in register table
+         * (registers::ALL)
+         *
+         * @return ACCESS_INVALID if the parameter is not in the table
+         */
+        Access getStaticAccess(int id);
+
+        /** The string representation of an access mode in dump files */
+        char const* accessToString(Access access);
+
+        struct Parameter {
+            int id;
+            uint16_t value;
+            Access access;
+        };
+
+        struct DumpSettings {
+            /** The range of parameters to read */
+            int first = 1;
+            int last = MAX_PARAMETER;
+
+            /** A dump of a controller of the same model, e.g. one made with
+             * @c probe_access
+             *
+             * The access mode of the parameters that are not in the
+             * compiled-in table is taken from it
+             */
+            std::vector<Parameter> reference;
+
+            /** Find the access mode of the parameters that are neither in the
+             * compiled-in table nor in the reference by writing their value
+             * back, which the controller refuses for read-only parameters
+             *
+             * This writes to the controller and costs one frame per
+             * parameter. It is disabled by default
+             */
+            bool probe_access = false;
+        };
+
+        struct DumpResult {
+            std::vector<Parameter> parameters;
+
+            /** Parameters that the controller refused to read */
+            std::vector<int> invalid;
+
+            /** Parameters whose access mode is unknown
+             *
+             * They are recorded as read-only, so that they are never written
+             * back by @c load
+             */
+            std::vector<int> unclassified;
+        };
+
+        /** Read all readable parameters
+         *
+         * Parameters are read in blocks. Blocks for which the controller
+         * returns an exception are split until the offending parameters are
+         * found. Unless @c DumpSettings::probe_access is set, this only
+         * reads from the controller.
+         *
+         * The access mode of each parameter is taken from the compiled-in
+         * register table, and then from the reference dump.
+         */
+        DumpResult dump(Driver& driver, DumpSettings const& settings = DumpSettings());
+
+        /** Parse a dump file, as generated by cfg-dump
+         *
+         * @throw std::invalid_argument if a line has an unknown access mode
+         */
+        std::vector<Parameter> parse(std::istream& in);
+
+        /** A parameter whose value on the controller is not the expected one */
+        struct Mismatch {
+            int id;
+            uint16_t expected;
+            uint16_t actual;
+        };
+
+        struct LoadResult {
+            /** Number of write frames sent */
+            int frames = 0;
+
+            /** Parameters that have been written */
+            std::vector<int> written;
+
+            /** Parameters the controller refused to write */
+            std::vector<int> refused;
+
+            /** Parameters whose write got no valid reply (timeout, CRC
+             * error, ...), even after retrying. Whether the controller has
+             * the new value is unknown
+             */
+            std::vector<int> failed;
+        };
+
+        /** Write the read-write parameters of a dump
+         *
+         * Contiguous parameters are grouped in Write Multiple Registers
+         * frames. If the controller refuses a frame, its parameters are
+         * written one by one to find the refused ones. A frame that gets no
+         * valid reply is sent again a few times, and then reported as failed
+         * while the load continues with the next frame. Read-only and
+         * command parameters are ignored.
+         */
+        LoadResult load(Driver& driver, std::vector<Parameter> const& parameters);
+
+        struct VerifyResult {
+            std::vector<Mismatch> mismatches;
+
+            /** Parameters the controller refused to read */
+            std::vector<int> invalid;
+        };
+
+        /** Compare the read-write parameters of a dump with the controller's
+         *
+         * Command parameters are ignored.
+         * The parameters are read in blocks, grouped according to the
+         * driver's bus cost model. The blocks only cover parameters that are
+         * in the dump
+         */
+        VerifyResult verify(Driver& driver, std::vector<Parameter> const& parameters);
+
+        /** Hash of the read-write parameters of a block of the parameter space
+         *
+         * The blocks are the ones @c verify would read, so that checking a
+         * digest costs one read per block and only reads parameters that
+         * are in the dump
+         */
+        struct BlockDigest {
+            int start;
+            int length;
+            uint32_t hash;
+        };
+
+        /** Compute the digest of the read-write parameters in [first, last] */
+        std::vector<BlockDigest> computeDigest(std::vector<Parameter> const& parameters,
+                                               int first = 1,
+                                               int last = MAX_PARAMETER,
+                                               BusCostModel const& model =
+                                                   BusCostModel());
+
+        /** Save a digest, one block per line */
+        void writeDigest(std::ostream& out, std::vector<BlockDigest> const& digest);
+
+        /** Load a digest saved with @c writeDigest
+         *
+         * @throw std::invalid_argument if the digest is malformed
+         */
+        std::vector<BlockDigest> parseDigest(std::istream& in);
+
+        struct DiffResult {
+            /** Number of read frames sent */
+            int frames = 0;
+
+            /** Blocks whose hash differs from the digest */
+            std::vector<BlockDigest> changed_blocks;
+
+            /** Differences with the dump within the changed blocks */
+            std::vector<Mismatch> mismatches;
+
+            /** Parameters the controller refused to read */
+            std::vector<int> invalid;
+        };
+
+        /** Compare the controller's configuration against a digest
+         *
+         * Each block of the digest is read and hashed. Only the blocks whose
+         * hash differ are compared parameter-by-parameter with the dump the
+         * digest has been computed from. Since these values have already
+         * been read, this costs no additional frames.
+         */
+        DiffResult diff(Driver& driver, std::vector<Parameter> const& parameters,
+                        std::vector<BlockDigest> const& digest);
+    }
+}
+
+#endif
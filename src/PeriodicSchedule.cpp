@@ -0,0 +1,62 @@
+#include <motors_weg_cvw300/PeriodicSchedule.hpp>
+#include <cerrno>
+#include <ctime>
+#include <stdexcept>
+
+using namespace base;
+using namespace motors_weg_cvw300;
+
+PeriodicSchedule::PeriodicSchedule(Time const& period)
+    : PeriodicSchedule(period, now()) {
+}
+
+PeriodicSchedule::PeriodicSchedule(Time const& period, int64_t start)
+    : m_period(period.toMicroseconds() * 1000)
+    , m_start(start) {
+    if (m_period <= 0) {
+        throw std::invalid_argument("PeriodicSchedule: the period must be positive");
+    }
+}
+
+int64_t PeriodicSchedule::now() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+Time PeriodicSchedule::toTime(int64_t ns) {
+    return Time::fromMicroseconds(ns / 1000);
+}
+
+int64_t PeriodicSchedule::getStart() const {
+    return m_start;
+}
+
+int64_t PeriodicSchedule::getCycle() const {
+    return m_cycle;
+}
+
+int64_t PeriodicSchedule::getDeadline() const {
+    return m_start + m_cycle * m_period;
+}
+
+int64_t PeriodicSchedule::waitDeadline() const {
+    int64_t deadline = getDeadline();
+    timespec ts;
+    ts.tv_sec = deadline / 1000000000;
+    ts.tv_nsec = deadline % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+    return now();
+}
+
+int64_t PeriodicSchedule::next(int64_t end) {
+    int64_t skipped = 0;
+    int64_t last_passed = (end - m_start) / m_period;
+    if (last_passed > m_cycle) {
+        skipped = last_passed - m_cycle;
+        m_cycle = last_passed;
+    }
+    m_cycle++;
+    return skipped;
+}
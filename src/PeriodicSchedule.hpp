@@ -0,0 +1,63 @@
+#ifndef MOTORS_WEG_CVW300_PERIODICSCHEDULE_HPP
+#define MOTORS_WEG_CVW300_PERIODICSCHEDULE_HPP
+
+#include <base/Time.hpp>
+#include <cstdint>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Absolute-time schedule of a periodic task
+     *
+     * Cycle N is due at start + N * period on the monotonic clock,
+     * regardless of the time the previous cycles took, so that the period
+     * does not drift. When a cycle ends after the deadline of the next
+     * ones, these are skipped.
+     *
+     * Times are in nanoseconds of CLOCK_MONOTONIC
+     */
+    class PeriodicSchedule {
+        int64_t m_period;
+        int64_t m_start;
+        int64_t m_cycle = 0;
+
+    public:
+        /** Start the schedule now. The first cycle is due immediately
+         *
+         * @throw std::invalid_argument if the period is not positive
+         */
+        explicit PeriodicSchedule(base::Time const& period);
+
+        /** Start the schedule at a given time */
+        PeriodicSchedule(base::Time const& period, int64_t start);
+
+        /** The current time of the monotonic clock */
+        static int64_t now();
+
+        /** Convert a duration in nanoseconds */
+        static base::Time toTime(int64_t ns);
+
+        /** Time at which the schedule started */
+        int64_t getStart() const;
+
+        /** Index of the current cycle */
+        int64_t getCycle() const;
+
+        /** Deadline of the current cycle */
+        int64_t getDeadline() const;
+
+        /** Sleep until the deadline of the current cycle
+         *
+         * @return the wakeup time
+         */
+        int64_t waitDeadline() const;
+
+        /** Move to the first cycle whose deadline is after the given end of
+         * the current one
+         *
+         * @return the number of cycles that were skipped
+         */
+        int64_t next(int64_t end);
+    };
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include <motors_weg_cvw300/PolledState.hpp>
+
+using namespace base;
+using namespace motors_weg_cvw300;
+
+static char const* POLL_GROUP_NAMES[POLL_GROUP_COUNT] = {
+    "state",
+    "temperatures",
+    "alarm",
+    "fault_state",
+    "ratings"
+};
+
+char const* motors_weg_cvw300::getPollGroupName(PollGroup group) {
+    if (group < 0 || group >= POLL_GROUP_COUNT) {
+        return "unknown";
+    }
+    return POLL_GROUP_NAMES[group];
+}
+
+Time PollingSettings::getPeriod(PollGroup group) const {
+    switch (group) {
+        case POLL_GROUP_STATE:
+            return state_period;
+        case POLL_GROUP_TEMPERATURES:
+            return temperatures_period;
+        case POLL_GROUP_ALARM:
+            return alarm_period;
+        case POLL_GROUP_FAULT_STATE:
+            return fault_state_period;
+        case POLL_GROUP_RATINGS:
+            return ratings_period;
+        default:
+            return Time();
+    }
+}
+
+Time PolledState::getTime(PollGroup group) const {
+    switch (group) {
+        case POLL_GROUP_STATE:
+            return state_time;
+        case POLL_GROUP_TEMPERATURES:
+            return temperatures_time;
+        case POLL_GROUP_ALARM:
+            return alarm_time;
+        case POLL_GROUP_FAULT_STATE:
+            return fault_state_time;
+        case POLL_GROUP_RATINGS:
+            return ratings_time;
+        default:
+            return Time();
+    }
+}
+
+bool PolledState::isFresh(PollGroup group, Time const& max_age, Time const& now) const {
+    Time time = getTime(group);
+    return !time.isNull() && now - time <= max_age;
+}
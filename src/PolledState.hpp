@@ -0,0 +1,116 @@
+#ifndef MOTORS_WEG_CVW300_POLLEDSTATE_HPP
+#define MOTORS_WEG_CVW300_POLLEDSTATE_HPP
+
+#include <base/Time.hpp>
+#include <motors_weg_cvw300/CurrentState.hpp>
+#include <motors_weg_cvw300/FaultState.hpp>
+#include <motors_weg_cvw300/InverterTemperatures.hpp>
+#include <motors_weg_cvw300/MotorRatings.hpp>
+
+namespace motors_weg_cvw300 {
+    /** The groups of data refreshed by the background poller
+     *
+     * The state is the fast group, which sets the pace of the poller. The
+     * other groups are read along with it when they are due
+     */
+    enum PollGroup {
+        POLL_GROUP_STATE,
+        POLL_GROUP_TEMPERATURES,
+        POLL_GROUP_ALARM,
+        POLL_GROUP_FAULT_STATE,
+        POLL_GROUP_RATINGS,
+        POLL_GROUP_COUNT
+    };
+
+    /** Name of a poll group */
+    char const* getPollGroupName(PollGroup group);
+
+    /** Periods at which the background poller refreshes the data
+     *
+     * The other groups are only read when they fit in the state period,
+     * except that a group late by a whole (non-null) period is read even if
+     * it delays the next state read. The state period must therefore leave
+     * room for them: at 19200 bauds, the state alone takes about 65ms and
+     * the state, temperatures and alarm together about 80ms, which the
+     * default period accommodates.
+     *
+     * @see Driver::startPolling
+     */
+    struct PollingSettings {
+        base::Time state_period = base::Time::fromMilliseconds(100);
+        base::Time temperatures_period = base::Time::fromSeconds(1);
+        base::Time alarm_period = base::Time::fromMilliseconds(200);
+
+        /** Period of the fault state reads. Null (the default) disables them */
+        base::Time fault_state_period;
+
+        /** Period of the motor ratings reads. Null (the default) disables
+         * them
+         *
+         * The ratings are only published in the polled state. The driver
+         * keeps using the ones it had when polling started for its
+         * conversions
+         */
+        base::Time ratings_period;
+
+        /** The period of a group
+         *
+         * The state, temperatures and alarm are always polled, a null period
+         * meaning as often as possible, i.e. whenever they fit in the state
+         * period. The fault state and ratings are not polled if their period
+         * is null
+         */
+        base::Time getPeriod(PollGroup group) const;
+    };
+
+    /** Latest data acquired by the background poller
+     *
+     * Each part is refreshed at its own rate, and therefore has its own
+     * timestamp. The timestamps are the estimated time at which the
+     * controller sampled the data (see CurrentState::time). A null timestamp
+     * means that the part has not been read yet.
+     */
+    struct PolledState {
+        /** Incremented each time the poller publishes new data */
+        uint64_t sequence = 0;
+
+        CurrentState state;
+        base::Time state_time;
+
+        InverterTemperatures temperatures;
+        base::Time temperatures_time;
+
+        int alarm = 0;
+        base::Time alarm_time;
+
+        FaultState fault_state;
+        base::Time fault_state_time;
+
+        MotorRatings ratings;
+        base::Time ratings_time;
+
+        /** Number of poll reads that failed since polling started, plus the
+         * number of times the data of a group could not be decoded
+         */
+        uint64_t errors = 0;
+
+        /** Number of times a due group has been postponed to the next state
+         * cycle, because reading it would have delayed the next state read
+         * past its deadline
+         */
+        uint64_t deferrals[POLL_GROUP_COUNT] = {};
+
+        /** Time at which the data of a group was sampled, null if it has not
+         * been read yet
+         */
+        base::Time getTime(PollGroup group) const;
+
+        /** Whether the data of a group has been sampled less than @a max_age
+         * before @a now
+         */
+        bool isFresh(PollGroup group, base::Time const& max_age,
+                     base::Time const& now = base::Time::now()) const;
+    };
+}
+
+#endif
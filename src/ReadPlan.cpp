@@ -0,0 +1,173 @@
+#include <motors_weg_cvw300/ReadPlan.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+using namespace base;
+using namespace motors_weg_cvw300;
+
+/** Size of a read request (address, function, start, length and CRC) */
+static const int READ_REQUEST_SIZE = 8;
+/** Size of a single register write request, and of its reply (address,
+ * function, register, value and CRC) */
+static const int WRITE_FRAME_SIZE = 8;
+/** Size of a read reply without the register values (address, function,
+ * byte count and CRC) */
+static const int READ_REPLY_OVERHEAD = 5;
+
+Time BusCostModel::byteTime() const {
+    return Time::fromMicroseconds(
+        static_cast<int64_t>(bits_per_byte) * 1000000 / baud_rate
+    );
+}
+
+Time BusCostModel::readFrameCost() const {
+    return interframe_delay +
+           byteTime() * (READ_REQUEST_SIZE + READ_REPLY_OVERHEAD);
+}
+
+Time BusCostModel::writeFrameCost() const {
+    return interframe_delay + byteTime() * (WRITE_FRAME_SIZE * 2);
+}
+
+Time BusCostModel::registerCost() const {
+    return byteTime() * 2;
+}
+
+int BusCostModel::maxMergeableGap() const {
+    int64_t register_cost = registerCost().toMicroseconds();
+    if (register_cost <= 0) {
+        return ReadPlan::MAX_REGISTERS_PER_FRAME;
+    }
+    return readFrameCost().toMicroseconds() / register_cost;
+}
+
+void ReadPlan::add(int register_id) {
+    m_registers.push_back(register_id);
+    m_blocks.clear();
+}
+
+void ReadPlan::add(int start, int length) {
+    for (int i = 0; i < length; ++i) {
+        m_registers.push_back(start + i);
+    }
+    m_blocks.clear();
+}
+
+void ReadPlan::exclude(int register_id) {
+    m_excluded.push_back(register_id);
+    m_blocks.clear();
+}
+
+void ReadPlan::exclude(int start, int length) {
+    for (int i = 0; i < length; ++i) {
+        m_excluded.push_back(start + i);
+    }
+    m_blocks.clear();
+}
+
+bool ReadPlan::hasExcluded(int first, int last) const {
+    auto it = lower_bound(m_excluded.begin(), m_excluded.end(), first);
+    return it != m_excluded.end() && *it <= last;
+}
+
+bool ReadPlan::contains(int register_id) const {
+    return find(m_registers.begin(), m_registers.end(), register_id) !=
+           m_registers.end();
+}
+
+bool ReadPlan::empty() const {
+    return m_registers.empty();
+}
+
+void ReadPlan::compile(BusCostModel const& model) {
+    sort(m_registers.begin(), m_registers.end());
+    m_registers.erase(unique(m_registers.begin(), m_registers.end()),
+                      m_registers.end());
+    sort(m_excluded.begin(), m_excluded.end());
+    m_excluded.erase(unique(m_excluded.begin(), m_excluded.end()),
+                     m_excluded.end());
+
+    m_blocks.clear();
+    if (m_registers.empty()) {
+        m_values.clear();
+        return;
+    }
+
+    int max_gap = model.maxMergeableGap();
+    Block current = { m_registers.front(), 1 };
+    for (auto it = m_registers.begin() + 1; it != m_registers.end(); ++it) {
+        int end = current.start + current.length;
+        int gap = *it - end;
+        int merged_length = *it - current.start + 1;
+        bool mergeable = gap <= max_gap &&
+                         merged_length <= MAX_REGISTERS_PER_FRAME &&
+                         (gap == 0 || !hasExcluded(end, *it - 1));
+        if (mergeable) {
+            current.length = merged_length;
+        }
+        else {
+            m_blocks.push_back(current);
+            current = Block{ *it, 1 };
+        }
+    }
+    m_blocks.push_back(current);
+
+    m_timings.resize(m_blocks.size());
+    fill(m_timings.begin(), m_timings.end(), Timing());
+
+    m_first = m_registers.front();
+    m_values.resize(m_registers.back() - m_first + 1);
+    fill(m_values.begin(), m_values.end(), 0);
+}
+
+vector<ReadPlan::Block> const& ReadPlan::getBlocks() const {
+    return m_blocks;
+}
+
+Time ReadPlan::estimateCost(BusCostModel const& model) const {
+    Time cost;
+    for (auto const& block : m_blocks) {
+        cost += model.readFrameCost() + model.registerCost() * block.length;
+    }
+    return cost;
+}
+
+uint16_t* ReadPlan::getBlockBuffer(Block const& block) {
+    return &m_values[block.start - m_first];
+}
+
+size_t ReadPlan::findBlock(int register_id) const {
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        auto const& block = m_blocks[i];
+        if (register_id >= block.start &&
+            register_id < block.start + block.length) {
+            return i;
+        }
+    }
+    throw std::out_of_range("ReadPlan: register not covered by the plan");
+}
+
+uint16_t ReadPlan::get(int register_id) const {
+    findBlock(register_id);
+    return m_values[register_id - m_first];
+}
+
+Time ReadPlan::Timing::midpoint() const {
+    return request + (reply - request) / 2;
+}
+
+void ReadPlan::setTiming(Block const& block, Timing const& timing) {
+    m_timings[findBlock(block.start)] = timing;
+}
+
+ReadPlan::Timing ReadPlan::getTiming(int register_id) const {
+    return m_timings[findBlock(register_id)];
+}
+
+ReadPlan::Timing ReadPlan::getTiming() const {
+    if (m_timings.empty()) {
+        return Timing();
+    }
+    return Timing{ m_timings.front().request, m_timings.back().reply };
+}
@@ -0,0 +1,160 @@
+#ifndef MOTORS_WEG_CVW300_READPLAN_HPP
+#define MOTORS_WEG_CVW300_READPLAN_HPP
+
+#include <base/Time.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Estimation of the time it takes to transfer data on the bus
+     *
+     * This is used to decide whether it is cheaper to read registers that
+     * are not needed (and throw them away) or to issue another frame.
+     */
+    struct BusCostModel {
+        /** Baud rate of the serial line */
+        int baud_rate = 19200;
+
+        /** Number of bits on the wire for each byte (start, data, parity, stop) */
+        int bits_per_byte = 11;
+
+        /** Delay enforced between two frames */
+        base::Time interframe_delay = base::Time::fromMilliseconds(20);
+
+        /** Time it takes to transmit a single byte */
+        base::Time byteTime() const;
+
+        /** Fixed cost of a read transaction
+         *
+         * This is the transfer time of the request and of the reply overhead
+         * (address, function, byte count and CRC), plus the interframe delay
+         */
+        base::Time readFrameCost() const;
+
+        /** Cost of a single-register write transaction */
+        base::Time writeFrameCost() const;
+
+        /** Cost of reading one additional register in an existing frame */
+        base::Time registerCost() const;
+
+        /** Number of registers that are cheaper to read and throw away than
+         * to start a new frame
+         */
+        int maxMergeableGap() const;
+    };
+
+    /**
+     * Set of registers to read, and how to read them with as few Modbus
+     * transactions as possible
+     *
+     * Declare the registers with @c add, call @c compile to get the frames
+     * (blocks) that should be used to read them. Once the blocks have been
+     * read into @c getBlockBuffer, the values are accessible with @c get
+     */
+    class ReadPlan {
+    public:
+        /** Maximum number of registers that can be read in a single frame */
+        static const int MAX_REGISTERS_PER_FRAME = 125;
+
+        struct Block {
+            int start;
+            int length;
+        };
+
+        /** When a block was read */
+        struct Timing {
+            /** Time at which the request was handed to the bus */
+            base::Time request;
+            /** Time at which the reply was fully received */
+            base::Time reply;
+
+            /** Estimated time at which the controller sampled the values
+             *
+             * This is the midpoint between request and reply
+             */
+            base::Time midpoint() const;
+        };
+
+    private:
+        std::vector<int> m_registers;
+        std::vector<int> m_excluded;
+        std::vector<Block> m_blocks;
+        std::vector<Timing> m_timings;
+        int m_first = 0;
+        std::vector<uint16_t> m_values;
+
+        size_t findBlock(int register_id) const;
+
+        /** Whether a register of [first, last] has been excluded
+         *
+         * Only valid after m_excluded has been sorted by @c compile
+         */
+        bool hasExcluded(int first, int last) const;
+
+    public:
+        /** Add a register to the plan */
+        void add(int register_id);
+
+        /** Add a contiguous range of registers to the plan */
+        void add(int start, int length);
+
+        /** Declare a register that must not be read
+         *
+         * @c compile never merges two blocks across an excluded register,
+         * e.g. a parameter the controller answers with an exception. The
+         * registers added to the plan are read even if they are excluded
+         */
+        void exclude(int register_id);
+
+        /** Declare a contiguous range of registers that must not be read */
+        void exclude(int start, int length);
+
+        /** Whether the given register has been added to the plan */
+        bool contains(int register_id) const;
+
+        /** Whether no registers have been added to this plan */
+        bool empty() const;
+
+        /** Compute the blocks needed to read the registers
+         *
+         * Two consecutive registers are read in the same frame if the cost
+         * of reading the registers in-between is lower than the cost of
+         * a new frame, and if none of them has been excluded
+         */
+        void compile(BusCostModel const& model);
+
+        /** The blocks computed by the last call to @c compile */
+        std::vector<Block> const& getBlocks() const;
+
+        /** Estimated time needed to read all the blocks */
+        base::Time estimateCost(BusCostModel const& model) const;
+
+        /** Pointer to where the values of the given block should be stored */
+        uint16_t* getBlockBuffer(Block const& block);
+
+        /** Get the value of a register
+         *
+         * @throw std::out_of_range if the register is not covered by any
+         *   of the blocks
+         */
+        uint16_t get(int register_id) const;
+
+        /** Record when the given block has been read */
+        void setTiming(Block const& block, Timing const& timing);
+
+        /** When the block that contains the given register has been read
+         *
+         * @throw std::out_of_range if the register is not covered by any
+         *   of the blocks
+         */
+        Timing getTiming(int register_id) const;
+
+        /** When the whole plan has been read, that is from the request of the
+         * first block to the reply of the last one
+         */
+        Timing getTiming() const;
+    };
+}
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef MOTORS_WEG_CVW300_REGISTERS_HPP
+#define MOTORS_WEG_CVW300_REGISTERS_HPP
+
+#include <cstdint>
+#include <initializer_list>
+#include <motors_weg_cvw300/Parameters.hpp>
+#include <motors_weg_cvw300/ReadPlan.hpp>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Description of the CVW300 registers used by the driver
+     *
+     * Each register is described once, with its ID, the type of its raw
+     * value and the scale to apply to get the value in SI units. Adding a
+     * new field to the driver's data structures should only require adding
+     * its register here and calling @c decode on it.
+     */
+    namespace registers {
+        enum RawType {
+            RAW_UINT16,
+            RAW_INT16
+        };
+
+        enum Unit {
+            UNIT_NONE,
+            UNIT_AMPERE,
+            UNIT_VOLT,
+            UNIT_HERTZ,
+            UNIT_CELSIUS,
+            UNIT_SECOND,
+            UNIT_RAD_PER_SECOND,
+            /** Ratio of a rated value (e.g. the motor rated torque) */
+            UNIT_RATIO
+        };
+
+        struct Register {
+            int id;
+            RawType type;
+            /** The SI value is raw * factor / divisor */
+            double factor;
+            double divisor;
+            Unit unit;
+            parameters::Access access;
+        };
+
+        constexpr double RPM_FACTOR = 2 * 3.14159265358979323846;
+        constexpr double RPM_DIVISOR = 60;
+
+        using parameters::ACCESS_RO;
+        using parameters::ACCESS_RW;
+
+        inline constexpr Register MOTOR_SPEED =
+            { 2, RAW_INT16, RPM_FACTOR, RPM_DIVISOR, UNIT_RAD_PER_SECOND, ACCESS_RO };
+        inline constexpr Register INVERTER_OUTPUT_CURRENT =
+            { 3, RAW_INT16, 1, 10, UNIT_AMPERE, ACCESS_RO };
+        inline constexpr Register BATTERY_VOLTAGE =
+            { 4, RAW_INT16, 1, 10, UNIT_VOLT, ACCESS_RO };
+        inline constexpr Register INVERTER_OUTPUT_FREQUENCY =
+            { 5, RAW_INT16, 1, 10, UNIT_HERTZ, ACCESS_RO };
+        inline constexpr Register INVERTER_STATUS =
+            { 6, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RO };
+        inline constexpr Register INVERTER_OUTPUT_VOLTAGE =
+            { 7, RAW_INT16, 1, 10, UNIT_VOLT, ACCESS_RO };
+        /** Ratio of the motor rated torque */
+        inline constexpr Register MOTOR_TORQUE =
+            { 9, RAW_INT16, 1, 1000, UNIT_RATIO, ACCESS_RO };
+        inline constexpr Register TEMPERATURE_MOSFET =
+            { 30, RAW_INT16, 1, 10, UNIT_CELSIUS, ACCESS_RO };
+        inline constexpr Register TEMPERATURE_AIR =
+            { 34, RAW_INT16, 1, 10, UNIT_CELSIUS, ACCESS_RO };
+        inline constexpr Register MOTOR_OVERLOAD =
+            { 37, RAW_INT16, 1, 100, UNIT_RATIO, ACCESS_RO };
+        inline constexpr Register ENCODER_SPEED =
+            { 38, RAW_INT16, RPM_FACTOR, RPM_DIVISOR, UNIT_RAD_PER_SECOND, ACCESS_RO };
+        inline constexpr Register ENCODER_PULSE_COUNTER =
+            { 39, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RO };
+
+        inline constexpr Register CURRENT_ALARM =
+            { 48, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RO };
+        inline constexpr Register CURRENT_FAULT =
+            { 49, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RO };
+
+        /** Last fault. The four previous ones follow every 4 registers */
+        inline constexpr Register LAST_FAULT =
+            { 50, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RO };
+        inline constexpr int FAULT_HISTORY_STRIDE = 4;
+        inline constexpr Register LAST_FAULT_CURRENT =
+            { 90, RAW_INT16, 1, 10, UNIT_AMPERE, ACCESS_RO };
+        inline constexpr Register LAST_FAULT_BATTERY_VOLTAGE =
+            { 91, RAW_INT16, 1, 10, UNIT_VOLT, ACCESS_RO };
+        inline constexpr Register LAST_FAULT_SPEED =
+            { 92, RAW_INT16, RPM_FACTOR, RPM_DIVISOR, UNIT_RAD_PER_SECOND, ACCESS_RO };
+        inline constexpr Register LAST_FAULT_COMMAND =
+            { 93, RAW_INT16, RPM_FACTOR, RPM_DIVISOR, UNIT_RAD_PER_SECOND, ACCESS_RO };
+        inline constexpr Register LAST_FAULT_INVERTER_OUTPUT_FREQUENCY =
+            { 94, RAW_INT16, 1, 10, UNIT_HERTZ, ACCESS_RO };
+        inline constexpr Register LAST_FAULT_INVERTER_OUTPUT_VOLTAGE =
+            { 95, RAW_INT16, 1, 10, UNIT_VOLT, ACCESS_RO };
+
+        inline constexpr Register RAMP_ACCELERATION_TIME =
+            { 100, RAW_INT16, 1, 1, UNIT_SECOND, ACCESS_RW };
+        inline constexpr Register RAMP_DECELERATION_TIME =
+            { 101, RAW_INT16, 1, 1, UNIT_SECOND, ACCESS_RW };
+        inline constexpr Register RAMP_TYPE =
+            { 104, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register MAX_SPEED_REFERENCE =
+            { 134, RAW_UINT16, RPM_FACTOR, RPM_DIVISOR, UNIT_RAD_PER_SECOND, ACCESS_RW };
+
+        inline constexpr Register GAIN_SPEED_P =
+            { 161, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register GAIN_SPEED_I =
+            { 162, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register GAIN_SPEED_D =
+            { 166, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register GAIN_CURRENT_P =
+            { 167, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register GAIN_CURRENT_I =
+            { 168, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        /** Ratio of the motor rated torque */
+        inline constexpr Register MAX_FORWARD_TORQUE =
+            { 169, RAW_UINT16, 1, 1000, UNIT_RATIO, ACCESS_RW };
+        /** Ratio of the motor rated torque */
+        inline constexpr Register MAX_REVERSE_TORQUE =
+            { 170, RAW_UINT16, 1, 1000, UNIT_RATIO, ACCESS_RW };
+        inline constexpr Register GAIN_FLUX_P =
+            { 175, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register GAIN_FLUX_I =
+            { 176, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register FLUX_NOMINAL =
+            { 178, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register FLUX_MAXIMAL =
+            { 179, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+
+        inline constexpr Register CONTROL_TYPE =
+            { 202, RAW_INT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register REM_REFERENCE_SELECTION =
+            { 222, RAW_INT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register REM_DIRECTION_SELECTION =
+            { 226, RAW_INT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register REM_RUN_STOP_SELECTION =
+            { 227, RAW_INT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register REM_JOG_SELECTION =
+            { 228, RAW_INT16, 1, 1, UNIT_NONE, ACCESS_RW };
+
+        inline constexpr Register CONFIG_SAVE =
+            { 303, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register SERIAL_ERROR_ACTION =
+            { 313, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register SERIAL_WATCHDOG =
+            { 314, RAW_INT16, 1, 10, UNIT_SECOND, ACCESS_RW };
+
+        inline constexpr Register MOTOR_NOMINAL_CURRENT =
+            { 401, RAW_INT16, 1, 10, UNIT_AMPERE, ACCESS_RW };
+        inline constexpr Register MOTOR_NOMINAL_SPEED =
+            { 402, RAW_INT16, RPM_FACTOR, RPM_DIVISOR, UNIT_RAD_PER_SECOND, ACCESS_RW };
+        /** Rated power code (0: 3kW, 1: 6kW, 2: 12kW) */
+        inline constexpr Register MOTOR_NOMINAL_POWER =
+            { 404, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        inline constexpr Register ENCODER_COUNT =
+            { 405, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+
+        inline constexpr Register SERIAL_STATUS_WORD =
+            { 682, RAW_UINT16, 1, 1, UNIT_NONE, ACCESS_RW };
+        /** Speed reference, 8192 being the motor rated speed */
+        inline constexpr Register SERIAL_REFERENCE_SPEED =
+            { 683, RAW_INT16, 1, 1, UNIT_NONE, ACCESS_RW };
+
+        /** All the registers known to the driver */
+        inline constexpr Register ALL[] = {
+            MOTOR_SPEED, INVERTER_OUTPUT_CURRENT, BATTERY_VOLTAGE,
+            INVERTER_OUTPUT_FREQUENCY, INVERTER_STATUS, INVERTER_OUTPUT_VOLTAGE,
+            MOTOR_TORQUE, TEMPERATURE_MOSFET, TEMPERATURE_AIR, MOTOR_OVERLOAD,
+            ENCODER_SPEED, ENCODER_PULSE_COUNTER, CURRENT_ALARM, CURRENT_FAULT,
+            LAST_FAULT, LAST_FAULT_CURRENT, LAST_FAULT_BATTERY_VOLTAGE,
+            LAST_FAULT_SPEED, LAST_FAULT_COMMAND,
+            LAST_FAULT_INVERTER_OUTPUT_FREQUENCY,
+            LAST_FAULT_INVERTER_OUTPUT_VOLTAGE, RAMP_ACCELERATION_TIME,
+            RAMP_DECELERATION_TIME, RAMP_TYPE, MAX_SPEED_REFERENCE,
+            GAIN_SPEED_P, GAIN_SPEED_I, GAIN_SPEED_D, GAIN_CURRENT_P,
+            GAIN_CURRENT_I, MAX_FORWARD_TORQUE, MAX_REVERSE_TORQUE,
+            GAIN_FLUX_P, GAIN_FLUX_I, FLUX_NOMINAL, FLUX_MAXIMAL, CONTROL_TYPE,
+            REM_REFERENCE_SELECTION, REM_DIRECTION_SELECTION,
+            REM_RUN_STOP_SELECTION, REM_JOG_SELECTION, CONFIG_SAVE,
+            SERIAL_ERROR_ACTION, SERIAL_WATCHDOG, MOTOR_NOMINAL_CURRENT,
+            MOTOR_NOMINAL_SPEED, MOTOR_NOMINAL_POWER, ENCODER_COUNT,
+            SERIAL_STATUS_WORD, SERIAL_REFERENCE_SPEED
+        };
+
+        constexpr bool hasUniqueIDs() {
+            for (auto const& a : ALL) {
+                int count = 0;
+                for (auto const& b : ALL) {
+                    count += (a.id == b.id);
+                }
+                if (count != 1) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        static_assert(hasUniqueIDs(), "two registers share the same ID");
+
+        /** The raw value of a register, interpreted according to its type */
+        constexpr int32_t toRaw(Register const& r, uint16_t value) {
+            return r.type == RAW_INT16 ? static_cast<int16_t>(value)
+                                       : static_cast<int32_t>(value);
+        }
+
+        /** Convert a register value into SI units */
+        template<typename T = float>
+        constexpr T decode(Register const& r, uint16_t value) {
+            return static_cast<T>(toRaw(r, value) * r.factor / r.divisor);
+        }
+
+        /** Convert the register value read by a plan into SI units */
+        template<typename T = float>
+        T decode(Register const& r, ReadPlan const& plan) {
+            return decode<T>(r, plan.get(r.id));
+        }
+
+        /** Convert a SI value into a register value
+         *
+         * The scaled value is truncated towards zero. It is computed in
+         * single precision, as the values given to the driver are floats,
+         * so that e.g. a ratio of 0.52f is encoded as 520 and not 519
+         */
+        constexpr uint16_t encode(Register const& r, double value) {
+            return static_cast<uint16_t>(static_cast<int32_t>(
+                static_cast<float>(value * r.divisor / r.factor)
+            ));
+        }
+
+        /** A contiguous range of registers */
+        struct Span {
+            int start;
+            int length;
+        };
+
+        /** The smallest range that contains all the given registers */
+        constexpr Span spanOf(std::initializer_list<Register> registers) {
+            int first = registers.begin()->id;
+            int last = first;
+            for (auto const& r : registers) {
+                first = r.id < first ? r.id : first;
+                last = r.id > last ? r.id : last;
+            }
+            return Span{ first, last - first + 1 };
+        }
+
+        /** Whether a range can be read in a single frame */
+        constexpr bool fitsInFrame(Span const& span) {
+            return span.length <= ReadPlan::MAX_REGISTERS_PER_FRAME;
+        }
+    }
+}
+
+#endif
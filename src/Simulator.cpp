@@ -0,0 +1,610 @@
+#include <motors_weg_cvw300/Simulator.hpp>
+#include <motors_weg_cvw300/Configuration.hpp>
+#include <motors_weg_cvw300/InverterStatus.hpp>
+#include <motors_weg_cvw300/Parameters.hpp>
+#include <motors_weg_cvw300/Registers.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace base;
+using namespace motors_weg_cvw300;
+using namespace motors_weg_cvw300::registers;
+
+static const int FUNCTION_READ_HOLDING_REGISTERS = 3;
+static const int FUNCTION_READ_INPUT_REGISTERS = 4;
+static const int FUNCTION_WRITE_SINGLE_REGISTER = 6;
+static const int FUNCTION_WRITE_MULTIPLE_REGISTERS = 16;
+
+/** Minimum silence that marks the end of a frame on the pseudo-terminal */
+static const Time MIN_FRAME_SILENCE = Time::fromMilliseconds(2);
+
+/** Number of pole pairs of the simulated motor */
+static const int POLE_PAIRS = 2;
+static const double BATTERY_VOLTAGE_V = 48;
+static const double FRICTION_TORQUE_RATIO = 0.05;
+
+static uint16_t crc16(uint8_t const* begin, uint8_t const* end) {
+    uint16_t crc = 0xFFFF;
+    for (auto it = begin; it != end; ++it) {
+        crc ^= *it;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+        }
+    }
+    return crc;
+}
+
+static void appendCRC(vector<uint8_t>& frame) {
+    uint16_t crc = crc16(frame.data(), frame.data() + frame.size());
+    frame.push_back(crc & 0xFF);
+    frame.push_back(crc >> 8);
+}
+
+static uint16_t readUInt16(uint8_t const* buffer) {
+    return static_cast<uint16_t>(buffer[0]) << 8 | buffer[1];
+}
+
+static void appendUInt16(vector<uint8_t>& buffer, uint16_t value) {
+    buffer.push_back(value >> 8);
+    buffer.push_back(value & 0xFF);
+}
+
+const int Simulator::ALARM_SERIAL_TIMEOUT;
+const int Simulator::FAULT_SERIAL_TIMEOUT;
+
+Simulator::Simulator(SimulatorSettings const& settings)
+    : m_settings(settings)
+    , m_registers(parameters::MAX_PARAMETER + 1, 0)
+    , m_random(settings.seed) {
+    m_registers[RAMP_ACCELERATION_TIME.id] = 5;
+    m_registers[RAMP_DECELERATION_TIME.id] = 5;
+    m_registers[MAX_SPEED_REFERENCE.id] = 3000;
+    m_registers[CONTROL_TYPE.id] = configuration::CONTROL_ENCODER;
+    m_registers[SERIAL_ERROR_ACTION.id] = configuration::STOP_WITH_RAMP;
+    m_registers[MOTOR_NOMINAL_CURRENT.id] = 100;
+    m_registers[MOTOR_NOMINAL_SPEED.id] = 3000;
+    m_registers[MOTOR_NOMINAL_POWER.id] = 1;
+    m_registers[ENCODER_COUNT.id] = 1024;
+    updateOutputs();
+
+    openPTY();
+}
+
+Simulator::~Simulator() {
+    stop();
+    closePTY();
+}
+
+void Simulator::openPTY() {
+    m_pty_master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (m_pty_master < 0 || grantpt(m_pty_master) != 0 ||
+        unlockpt(m_pty_master) != 0) {
+        closePTY();
+        throw std::runtime_error("Simulator: cannot create pseudo-terminal: " +
+                                 string(strerror(errno)));
+    }
+
+    char path[256];
+    if (ptsname_r(m_pty_master, path, sizeof(path)) != 0) {
+        closePTY();
+        throw std::runtime_error("Simulator: cannot get pseudo-terminal name");
+    }
+    m_pty_path = path;
+
+    // Keep the slave side open, or reading the master fails with EIO while
+    // no client is connected
+    m_pty_slave = ::open(path, O_RDWR | O_NOCTTY);
+    termios tio;
+    if (m_pty_slave < 0 || tcgetattr(m_pty_slave, &tio) != 0) {
+        closePTY();
+        throw std::runtime_error("Simulator: cannot open " + m_pty_path);
+    }
+    cfmakeraw(&tio);
+    tcsetattr(m_pty_slave, TCSANOW, &tio);
+}
+
+void Simulator::closePTY() {
+    if (m_pty_slave >= 0) {
+        ::close(m_pty_slave);
+        m_pty_slave = -1;
+    }
+    if (m_pty_master >= 0) {
+        ::close(m_pty_master);
+        m_pty_master = -1;
+    }
+}
+
+string Simulator::getPTYPath() const {
+    return m_pty_path;
+}
+
+void Simulator::start() {
+    if (m_thread.joinable()) {
+        throw std::logic_error("Simulator::start: already started");
+    }
+    m_quit = false;
+    m_thread = thread(&Simulator::loop, this);
+}
+
+void Simulator::stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    m_quit = true;
+    m_thread.join();
+}
+
+Time Simulator::transferTime(size_t bytes) const {
+    if (m_settings.baud_rate <= 0) {
+        return Time();
+    }
+    return Time::fromMicroseconds(
+        static_cast<int64_t>(bytes) * 11 * 1000000 / m_settings.baud_rate
+    );
+}
+
+void Simulator::loop() {
+    Time silence = max(MIN_FRAME_SILENCE, transferTime(4));
+
+    vector<uint8_t> buffer;
+    Time first_byte, last_byte;
+    while (!m_quit) {
+        pollfd fd = { m_pty_master, POLLIN, 0 };
+        int ret = poll(&fd, 1, buffer.empty() ? 10 : 1);
+        Time now = Time::now();
+        if (ret > 0 && (fd.revents & POLLIN)) {
+            uint8_t data[512];
+            ssize_t size = ::read(m_pty_master, data, sizeof(data));
+            if (size > 0) {
+                if (buffer.empty()) {
+                    first_byte = now;
+                }
+                buffer.insert(buffer.end(), data, data + size);
+                last_byte = now;
+            }
+        }
+
+        while (!buffer.empty()) {
+            int size = expectedRequestSize(buffer.data(), buffer.size());
+            vector<uint8_t> frame;
+            if (size > 0 && buffer.size() >= static_cast<size_t>(size)) {
+                frame.assign(buffer.begin(), buffer.begin() + size);
+                buffer.erase(buffer.begin(), buffer.begin() + size);
+            }
+            else if (now - last_byte >= silence) {
+                frame.swap(buffer);
+            }
+            else {
+                break;
+            }
+
+            vector<uint8_t> reply = processFrame(frame, first_byte);
+            if (reply.empty()) {
+                continue;
+            }
+
+            Time delay = m_settings.response_delay +
+                         transferTime(frame.size() + reply.size());
+            if (!m_settings.response_jitter.isNull()) {
+                uniform_int_distribution<int64_t> jitter(
+                    0, m_settings.response_jitter.toMicroseconds()
+                );
+                lock_guard<mutex> lock(m_mutex);
+                delay = delay + Time::fromMicroseconds(jitter(m_random));
+            }
+            Time sleep_time = first_byte + delay - Time::now();
+            if (sleep_time > Time()) {
+                usleep(sleep_time.toMicroseconds());
+            }
+            if (::write(m_pty_master, reply.data(), reply.size()) < 0) {
+                // Nobody is reading (or the client is too slow), the
+                // reply is lost as it would be on a real line
+            }
+            // The time at which the next frame in the buffer started is
+            // unknown, use the time at which its last byte arrived
+            first_byte = last_byte;
+        }
+
+        lock_guard<mutex> lock(m_mutex);
+        updateModel(Time::now());
+    }
+}
+
+int Simulator::expectedRequestSize(uint8_t const* buffer, size_t size) {
+    if (size < 2) {
+        return 0;
+    }
+
+    switch (buffer[1]) {
+        case FUNCTION_READ_HOLDING_REGISTERS:
+        case FUNCTION_READ_INPUT_REGISTERS:
+        case FUNCTION_WRITE_SINGLE_REGISTER:
+            return 8;
+        case FUNCTION_WRITE_MULTIPLE_REGISTERS:
+            return size < 7 ? 0 : 9 + buffer[6];
+        default:
+            return -1;
+    }
+}
+
+bool Simulator::randomEvent(double probability) {
+    if (probability <= 0) {
+        return false;
+    }
+    return uniform_real_distribution<double>(0, 1)(m_random) < probability;
+}
+
+vector<uint8_t> Simulator::processFrame(vector<uint8_t> const& frame,
+                                        Time const& now) {
+    lock_guard<mutex> lock(m_mutex);
+
+    if (frame.size() < 4) {
+        m_statistics.invalid_frames++;
+        return vector<uint8_t>();
+    }
+    uint16_t crc = frame[frame.size() - 2] | frame[frame.size() - 1] << 8;
+    if (crc != crc16(frame.data(), frame.data() + frame.size() - 2)) {
+        m_statistics.invalid_frames++;
+        return vector<uint8_t>();
+    }
+
+    int address = frame[0];
+    bool broadcast = (address == 0);
+    if (!broadcast && address != m_settings.address) {
+        return vector<uint8_t>();
+    }
+
+    m_statistics.requests++;
+    updateModel(now);
+    checkWatchdog(now);
+    m_last_request = now;
+
+    if (randomEvent(m_settings.timeout_probability)) {
+        m_statistics.injected_timeouts++;
+        return vector<uint8_t>();
+    }
+
+    uint8_t function = frame[1];
+    vector<uint8_t> payload(frame.begin() + 2, frame.end() - 2);
+    vector<uint8_t> reply;
+    if (randomEvent(m_settings.exception_probability)) {
+        m_statistics.injected_exceptions++;
+        reply = { static_cast<uint8_t>(function | 0x80), SLAVE_DEVICE_FAILURE };
+    }
+    else {
+        reply = processRequest(function, payload, broadcast);
+    }
+    updateOutputs();
+
+    if (broadcast) {
+        return vector<uint8_t>();
+    }
+
+    if (reply[0] & 0x80) {
+        m_statistics.exceptions++;
+    }
+    reply.insert(reply.begin(), m_settings.address);
+    appendCRC(reply);
+    if (randomEvent(m_settings.crc_error_probability)) {
+        m_statistics.injected_crc_errors++;
+        reply.back() ^= 0xFF;
+    }
+    m_statistics.replies++;
+    return reply;
+}
+
+vector<uint8_t> Simulator::processRequest(uint8_t function,
+                                          vector<uint8_t> const& payload,
+                                          bool broadcast) {
+    uint8_t exception = 0;
+    vector<uint8_t> reply = { function };
+    switch (function) {
+        case FUNCTION_READ_HOLDING_REGISTERS:
+        case FUNCTION_READ_INPUT_REGISTERS:
+            if (payload.size() != 4 || broadcast) {
+                exception = ILLEGAL_DATA_VALUE;
+            }
+            else {
+                exception = readRegisters(reply, readUInt16(&payload[0]),
+                                          readUInt16(&payload[2]));
+            }
+            break;
+        case FUNCTION_WRITE_SINGLE_REGISTER:
+            if (payload.size() != 4) {
+                exception = ILLEGAL_DATA_VALUE;
+            }
+            else {
+                exception = writeRegisters(readUInt16(&payload[0]),
+                                           { readUInt16(&payload[2]) });
+                reply.insert(reply.end(), payload.begin(), payload.end());
+            }
+            break;
+        case FUNCTION_WRITE_MULTIPLE_REGISTERS: {
+            if (payload.size() < 5) {
+                exception = ILLEGAL_DATA_VALUE;
+                break;
+            }
+            int count = readUInt16(&payload[2]);
+            if (count < 1 || count > parameters::MAX_REGISTERS_PER_WRITE ||
+                payload[4] != count * 2 ||
+                payload.size() != static_cast<size_t>(5 + count * 2)) {
+                exception = ILLEGAL_DATA_VALUE;
+                break;
+            }
+
+            vector<uint16_t> values;
+            for (int i = 0; i < count; ++i) {
+                values.push_back(readUInt16(&payload[5 + i * 2]));
+            }
+            exception = writeRegisters(readUInt16(&payload[0]), values);
+            reply.insert(reply.end(), payload.begin(), payload.begin() + 4);
+            break;
+        }
+        default:
+            exception = ILLEGAL_FUNCTION;
+    }
+
+    if (exception) {
+        return { static_cast<uint8_t>(function | 0x80), exception };
+    }
+    return reply;
+}
+
+parameters::Access Simulator::getAccess(int id) const {
+    auto const& invalid = m_settings.invalid_registers;
+    if (id < 0 || id > parameters::MAX_PARAMETER ||
+        find(invalid.begin(), invalid.end(), id) != invalid.end()) {
+        return parameters::ACCESS_INVALID;
+    }
+    for (auto const& r : registers::ALL) {
+        if (r.id == id) {
+            return r.access;
+        }
+    }
+    return parameters::ACCESS_RW;
+}
+
+uint8_t Simulator::readRegisters(vector<uint8_t>& reply, int start, int length) {
+    if (length < 1 || length > ReadPlan::MAX_REGISTERS_PER_FRAME) {
+        return ILLEGAL_DATA_VALUE;
+    }
+    for (int id = start; id < start + length; ++id) {
+        if (getAccess(id) == parameters::ACCESS_INVALID) {
+            return ILLEGAL_DATA_ADDRESS;
+        }
+    }
+
+    reply.push_back(length * 2);
+    for (int id = start; id < start + length; ++id) {
+        appendUInt16(reply, m_registers[id]);
+    }
+    return 0;
+}
+
+uint8_t Simulator::writeRegisters(int start, vector<uint16_t> const& values) {
+    int end = start + values.size();
+    for (int id = start; id < end; ++id) {
+        if (getAccess(id) != parameters::ACCESS_RW) {
+            return ILLEGAL_DATA_ADDRESS;
+        }
+    }
+
+    for (int id = start; id < end; ++id) {
+        uint16_t previous = m_registers[id];
+        m_registers[id] = values[id - start];
+        if (id == SERIAL_STATUS_WORD.id) {
+            applyStatusWord(previous, m_registers[id]);
+        }
+    }
+    return 0;
+}
+
+void Simulator::applyStatusWord(uint16_t previous, uint16_t current) {
+    m_watchdog_triggered = false;
+    if (m_registers[CURRENT_ALARM.id] == ALARM_SERIAL_TIMEOUT) {
+        m_registers[CURRENT_ALARM.id] = 0;
+    }
+
+    bool reset_fault = (current & configuration::SERIAL_RESET_FAULT) &&
+                       !(previous & configuration::SERIAL_RESET_FAULT);
+    if (reset_fault) {
+        m_registers[CURRENT_FAULT.id] = 0;
+    }
+}
+
+double Simulator::getSpeedReference() const {
+    double rated_speed =
+        decode<double>(MOTOR_NOMINAL_SPEED, m_registers[MOTOR_NOMINAL_SPEED.id]);
+    double max_speed =
+        decode<double>(MAX_SPEED_REFERENCE, m_registers[MAX_SPEED_REFERENCE.id]);
+
+    uint16_t status = m_registers[SERIAL_STATUS_WORD.id];
+    int16_t reference = static_cast<int16_t>(m_registers[SERIAL_REFERENCE_SPEED.id]);
+    double speed = reference * rated_speed / 8192;
+    if (!(status & configuration::SERIAL_DIRECTION_POSITIVE)) {
+        speed = -speed;
+    }
+    return max(-max_speed, min(max_speed, speed));
+}
+
+bool Simulator::isRunning() const {
+    uint16_t status = m_registers[SERIAL_STATUS_WORD.id];
+    return (status & configuration::SERIAL_CONTROL_ON) &&
+           (status & configuration::SERIAL_GENERAL) &&
+           !m_registers[CURRENT_FAULT.id] && !m_watchdog_triggered;
+}
+
+void Simulator::checkWatchdog(Time const& now) {
+    double timeout = decode<double>(SERIAL_WATCHDOG, m_registers[SERIAL_WATCHDOG.id]);
+    int action = m_registers[SERIAL_ERROR_ACTION.id];
+    if (timeout <= 0 || action == configuration::INACTIVE ||
+        m_watchdog_triggered || m_last_request.isNull() ||
+        (now - m_last_request).toSeconds() < timeout) {
+        return;
+    }
+
+    m_watchdog_triggered = true;
+    if (action == configuration::FAULT) {
+        setFault(FAULT_SERIAL_TIMEOUT);
+        return;
+    }
+
+    m_registers[CURRENT_ALARM.id] = ALARM_SERIAL_TIMEOUT;
+    if (action == configuration::DISCONNECT) {
+        m_speed = 0;
+        m_acceleration = 0;
+    }
+}
+
+void Simulator::updateModel(Time const& now) {
+    if (m_last_update.isNull() || now <= m_last_update) {
+        m_last_update = max(now, m_last_update);
+        return;
+    }
+    double dt = (now - m_last_update).toSeconds();
+    m_last_update = now;
+    checkWatchdog(now);
+
+    double max_speed =
+        decode<double>(MAX_SPEED_REFERENCE, m_registers[MAX_SPEED_REFERENCE.id]);
+    double target = isRunning() ? getSpeedReference() : 0;
+
+    double acceleration_time = decode<double>(
+        RAMP_ACCELERATION_TIME, m_registers[RAMP_ACCELERATION_TIME.id]
+    );
+    double deceleration_time = decode<double>(
+        RAMP_DECELERATION_TIME, m_registers[RAMP_DECELERATION_TIME.id]
+    );
+    bool accelerating = std::abs(target) > std::abs(m_speed) &&
+                        target * m_speed >= 0;
+    double ramp_time = accelerating ? acceleration_time : deceleration_time;
+
+    // Time needed to reach the target, the speed is constant afterwards
+    double previous = m_speed;
+    double ramp_duration = 0;
+    if (ramp_time > 0 && max_speed > 0) {
+        double rate = max_speed / ramp_time;
+        ramp_duration = min(dt, std::abs(target - previous) / rate);
+        m_speed += std::copysign(rate * ramp_duration, target - previous);
+    }
+    else {
+        m_speed = target;
+    }
+    m_acceleration = (m_speed - previous) / dt;
+
+    double distance = (previous + m_speed) / 2 * ramp_duration +
+                      m_speed * (dt - ramp_duration);
+    double ticks_per_turn = m_registers[ENCODER_COUNT.id];
+    m_encoder_ticks += distance / (2 * M_PI) * ticks_per_turn;
+    updateOutputs();
+}
+
+void Simulator::updateOutputs() {
+    double rated_speed =
+        decode<double>(MOTOR_NOMINAL_SPEED, m_registers[MOTOR_NOMINAL_SPEED.id]);
+    double max_speed =
+        decode<double>(MAX_SPEED_REFERENCE, m_registers[MAX_SPEED_REFERENCE.id]);
+    double acceleration_time = decode<double>(
+        RAMP_ACCELERATION_TIME, m_registers[RAMP_ACCELERATION_TIME.id]
+    );
+    double nominal_current = decode<double>(
+        MOTOR_NOMINAL_CURRENT, m_registers[MOTOR_NOMINAL_CURRENT.id]
+    );
+
+    bool running = isRunning();
+    double speed = std::abs(m_speed);
+
+    double torque = 0;
+    if (running || speed > 0) {
+        torque = FRICTION_TORQUE_RATIO;
+        if (acceleration_time > 0 && max_speed > 0) {
+            torque += std::abs(m_acceleration) * acceleration_time / max_speed / 2;
+        }
+    }
+    // The driver gets the speed direction from the sign of current * torque
+    double current = nominal_current * torque;
+    if (m_speed < 0) {
+        current = -current;
+    }
+
+    InverterStatus status = STATUS_READY;
+    if (m_registers[CURRENT_FAULT.id]) {
+        status = STATUS_FAULT;
+    }
+    else if (running) {
+        status = STATUS_RUN;
+    }
+
+    auto set = [this](Register const& r, double value) {
+        m_registers[r.id] = encode(r, value);
+    };
+    set(MOTOR_SPEED, speed);
+    set(INVERTER_OUTPUT_CURRENT, current);
+    set(BATTERY_VOLTAGE, BATTERY_VOLTAGE_V);
+    set(INVERTER_OUTPUT_FREQUENCY, speed / (2 * M_PI) * POLE_PAIRS);
+    set(INVERTER_STATUS, status);
+    set(INVERTER_OUTPUT_VOLTAGE,
+        rated_speed > 0 ? BATTERY_VOLTAGE_V * min(1.0, speed / rated_speed) : 0);
+    set(MOTOR_TORQUE, torque);
+    set(TEMPERATURE_MOSFET, 35);
+    set(TEMPERATURE_AIR, 30);
+    set(ENCODER_SPEED, speed);
+    m_registers[ENCODER_PULSE_COUNTER.id] =
+        static_cast<uint16_t>(static_cast<int64_t>(floor(m_encoder_ticks)));
+}
+
+void Simulator::setFault(uint16_t code) {
+    for (int i = 4; i > 0; --i) {
+        m_registers[LAST_FAULT.id + FAULT_HISTORY_STRIDE * i] =
+            m_registers[LAST_FAULT.id + FAULT_HISTORY_STRIDE * (i - 1)];
+    }
+    m_registers[LAST_FAULT.id] = code;
+    m_registers[CURRENT_FAULT.id] = code;
+
+    m_registers[LAST_FAULT_CURRENT.id] = m_registers[INVERTER_OUTPUT_CURRENT.id];
+    m_registers[LAST_FAULT_BATTERY_VOLTAGE.id] = m_registers[BATTERY_VOLTAGE.id];
+    m_registers[LAST_FAULT_SPEED.id] = encode(LAST_FAULT_SPEED, m_speed);
+    m_registers[LAST_FAULT_COMMAND.id] = encode(LAST_FAULT_COMMAND, getSpeedReference());
+    m_registers[LAST_FAULT_INVERTER_OUTPUT_FREQUENCY.id] =
+        m_registers[INVERTER_OUTPUT_FREQUENCY.id];
+    m_registers[LAST_FAULT_INVERTER_OUTPUT_VOLTAGE.id] =
+        m_registers[INVERTER_OUTPUT_VOLTAGE.id];
+
+    // The controller disables the power stage, the motor coasts
+    m_speed = 0;
+    m_acceleration = 0;
+    updateOutputs();
+}
+
+uint16_t Simulator::getRegister(int id) const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_registers.at(id);
+}
+
+void Simulator::setRegister(int id, uint16_t value) {
+    lock_guard<mutex> lock(m_mutex);
+    uint16_t previous = m_registers.at(id);
+    m_registers[id] = value;
+    if (id == SERIAL_STATUS_WORD.id) {
+        applyStatusWord(previous, value);
+    }
+    updateOutputs();
+}
+
+void Simulator::injectFault(uint16_t code) {
+    lock_guard<mutex> lock(m_mutex);
+    setFault(code);
+}
+
+SimulatorStatistics Simulator::getStatistics() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_statistics;
+}
@@ -0,0 +1,199 @@
+#ifndef MOTORS_WEG_CVW300_SIMULATOR_HPP
+#define MOTORS_WEG_CVW300_SIMULATOR_HPP
+
+#include <base/Time.hpp>
+#include <atomic>
+#include <cstdint>
+#include <motors_weg_cvw300/Parameters.hpp>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace motors_weg_cvw300 {
+    struct SimulatorSettings {
+        /** Modbus address the simulator answers to */
+        int address = 1;
+
+        /** Baud rate of the simulated serial line
+         *
+         * The replies are delayed by the time it would take to transfer the
+         * request and the reply at this rate. Set to zero to disable the
+         * line emulation
+         */
+        int baud_rate = 19200;
+
+        /** Processing time of the controller, added to each reply */
+        base::Time response_delay = base::Time::fromMilliseconds(2);
+
+        /** Maximum of a random delay added to response_delay */
+        base::Time response_jitter;
+
+        /** Probability to not answer a request at all */
+        double timeout_probability = 0;
+
+        /** Probability to answer with a corrupted CRC */
+        double crc_error_probability = 0;
+
+        /** Probability to answer with a "slave device failure" exception */
+        double exception_probability = 0;
+
+        /** Seed of the random generator used for the error injection */
+        unsigned int seed = 0;
+
+        /** Registers that do not exist, whose reads and writes are answered
+         * with an exception
+         *
+         * Use this to reproduce the holes of a controller's parameter space
+         */
+        std::vector<int> invalid_registers;
+    };
+
+    struct SimulatorStatistics {
+        /** Number of valid requests addressed to the simulator */
+        uint64_t requests = 0;
+        /** Number of replies sent, including exceptions */
+        uint64_t replies = 0;
+        /** Number of exception replies, injected or not */
+        uint64_t exceptions = 0;
+        /** Number of frames that were dropped because of an invalid CRC */
+        uint64_t invalid_frames = 0;
+        /** Number of requests left unanswered by the error injection */
+        uint64_t injected_timeouts = 0;
+        /** Number of replies corrupted by the error injection */
+        uint64_t injected_crc_errors = 0;
+        /** Number of exception replies sent by the error injection */
+        uint64_t injected_exceptions = 0;
+    };
+
+    /**
+     * Simulation of a CVW300 controller on a pseudo-terminal
+     *
+     * The simulator answers the Modbus RTU requests used by the Driver
+     * (read holding registers, write single register and write multiple
+     * registers) on the whole parameter space. The registers described in
+     * registers::ALL have their documented access mode, the other ones are
+     * plain read-write storage, except for SimulatorSettings::invalid_registers.
+     *
+     * The serial status word (682) and the speed reference (683) drive a
+     * simple motor model that ramps the speed according to the ramp
+     * configuration (100, 101 and 134). The model updates the state
+     * registers (2 to 9), the encoder registers (37 to 39) and the serial
+     * watchdog (313 and 314). Faults can be injected with @c injectFault,
+     * which fills the fault history (49 to 95).
+     *
+     * Use getPTYPath to connect to it, e.g. with
+     * serial://PATH:19200 as URI
+     */
+    class Simulator {
+    public:
+        /** Exception codes of the replies */
+        enum ExceptionCode {
+            ILLEGAL_FUNCTION = 1,
+            ILLEGAL_DATA_ADDRESS = 2,
+            ILLEGAL_DATA_VALUE = 3,
+            SLAVE_DEVICE_FAILURE = 4
+        };
+
+        /** Alarm raised when the serial watchdog triggers */
+        static const int ALARM_SERIAL_TIMEOUT = 128;
+        /** Fault raised when the serial watchdog triggers with the FAULT
+         * action */
+        static const int FAULT_SERIAL_TIMEOUT = 228;
+
+    private:
+        SimulatorSettings m_settings;
+
+        mutable std::mutex m_mutex;
+        std::vector<uint16_t> m_registers;
+        SimulatorStatistics m_statistics;
+        std::mt19937 m_random;
+
+        double m_speed = 0;
+        double m_acceleration = 0;
+        double m_encoder_ticks = 0;
+        base::Time m_last_update;
+        base::Time m_last_request;
+        bool m_watchdog_triggered = false;
+
+        int m_pty_master = -1;
+        int m_pty_slave = -1;
+        std::string m_pty_path;
+
+        std::thread m_thread;
+        std::atomic<bool> m_quit{ false };
+
+        void openPTY();
+        void closePTY();
+        void loop();
+
+        bool randomEvent(double probability);
+        base::Time transferTime(size_t bytes) const;
+
+        void updateModel(base::Time const& now);
+        void updateOutputs();
+        void checkWatchdog(base::Time const& now);
+        void applyStatusWord(uint16_t previous, uint16_t current);
+        bool isRunning() const;
+        /** Speed requested through the serial interface, in rad/s */
+        double getSpeedReference() const;
+        void setFault(uint16_t code);
+
+        std::vector<uint8_t> processRequest(uint8_t function,
+                                            std::vector<uint8_t> const& payload,
+                                            bool broadcast);
+        /** The simulated access mode of a register */
+        parameters::Access getAccess(int id) const;
+        uint8_t readRegisters(std::vector<uint8_t>& reply, int start, int length);
+        uint8_t writeRegisters(int start, std::vector<uint16_t> const& values);
+
+    public:
+        explicit Simulator(SimulatorSettings const& settings = SimulatorSettings());
+        ~Simulator();
+
+        /** Path of the pseudo-terminal the simulator listens on */
+        std::string getPTYPath() const;
+
+        /** Start answering requests on the pseudo-terminal in a background
+         * thread */
+        void start();
+
+        /** Stop the background thread */
+        void stop();
+
+        /** Process a request frame and return the reply
+         *
+         * This is what the background thread does with each frame, without
+         * the delays. It returns an empty frame if there should be no reply
+         * (frame for another address, broadcast, invalid CRC or injected
+         * timeout)
+         */
+        std::vector<uint8_t> processFrame(std::vector<uint8_t> const& frame,
+                                          base::Time const& now = base::Time::now());
+
+        /** Expected size of the request at the start of @a buffer
+         *
+         * @return the size, or zero if the buffer is too short to know, or
+         *   -1 if the function is not supported
+         */
+        static int expectedRequestSize(uint8_t const* buffer, size_t size);
+
+        /** Read a register, without going through the bus */
+        uint16_t getRegister(int id) const;
+
+        /** Write a register, without going through the bus
+         *
+         * Unlike through the bus, this allows to change read-only registers
+         */
+        void setRegister(int id, uint16_t value);
+
+        /** Put the controller in fault, which disables the motor until the
+         * fault is reset through the status word */
+        void injectFault(uint16_t code);
+
+        SimulatorStatistics getStatistics() const;
+    };
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include <csignal>
+#include <iostream>
+#include <motors_weg_cvw300/Simulator.hpp>
+#include <string>
+#include <unistd.h>
+
+using namespace base;
+using namespace std;
+using namespace motors_weg_cvw300;
+
+static volatile sig_atomic_t quit = 0;
+
+static void handleSignal(int)
+{
+    quit = 1;
+}
+
+void usage(ostream& stream)
+{
+    stream << "usage: motors_weg_cvw300_simulator [OPTIONS]\n"
+           << "Simulates a CVW300 controller on a pseudo-terminal, whose path is "
+              "displayed on startup\n"
+           << "\n"
+           << "Options\n"
+           << "  --address ID: modbus address of the simulated controller (1)\n"
+           << "  --baud RATE: baud rate of the simulated line, 0 to disable the "
+              "line emulation (19200)\n"
+           << "  --delay MS: processing time of each request (2)\n"
+           << "  --jitter MS: maximum of a random delay added to each reply (0)\n"
+           << "  --timeout-rate P: probability to not answer a request (0)\n"
+           << "  --crc-error-rate P: probability to send a reply with an invalid "
+              "CRC (0)\n"
+           << "  --exception-rate P: probability to answer with an exception (0)\n"
+           << "  --seed SEED: seed of the error injection random generator (0)\n"
+           << endl;
+}
+
+int main(int argc, char** argv)
+{
+    SimulatorSettings settings;
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--help" || option == "-h") {
+            usage(cout);
+            return 0;
+        }
+        else if (i + 1 == argc) {
+            cerr << "missing value for option " << option << "\n" << endl;
+            usage(cerr);
+            return 1;
+        }
+
+        string value = argv[++i];
+        if (option == "--address") {
+            settings.address = stoi(value);
+        }
+        else if (option == "--baud") {
+            settings.baud_rate = stoi(value);
+        }
+        else if (option == "--delay") {
+            settings.response_delay = Time::fromMicroseconds(stof(value) * 1000);
+        }
+        else if (option == "--jitter") {
+            settings.response_jitter = Time::fromMicroseconds(stof(value) * 1000);
+        }
+        else if (option == "--timeout-rate") {
+            settings.timeout_probability = stod(value);
+        }
+        else if (option == "--crc-error-rate") {
+            settings.crc_error_probability = stod(value);
+        }
+        else if (option == "--exception-rate") {
+            settings.exception_probability = stod(value);
+        }
+        else if (option == "--seed") {
+            settings.seed = stoul(value);
+        }
+        else {
+            cerr << "unknown option " << option << "\n" << endl;
+            usage(cerr);
+            return 1;
+        }
+    }
+
+    Simulator simulator(settings);
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+    simulator.start();
+
+    int baud_rate = settings.baud_rate ? settings.baud_rate : 19200;
+    cout << "simulating controller " << settings.address << " on "
+         << simulator.getPTYPath() << "\n"
+         << "URI: serial://" << simulator.getPTYPath() << ":" << baud_rate << endl;
+
+    while (!quit) {
+        usleep(100000);
+    }
+    simulator.stop();
+
+    auto stats = simulator.getStatistics();
+    cout << "\nrequests: " << stats.requests << "\n"
+         << "replies: " << stats.replies << "\n"
+         << "exceptions: " << stats.exceptions << "\n"
+         << "invalid frames: " << stats.invalid_frames << "\n"
+         << "injected timeouts: " << stats.injected_timeouts << "\n"
+         << "injected CRC errors: " << stats.injected_crc_errors << "\n"
+         << "injected exceptions: " << stats.injected_exceptions << endl;
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <motors_weg_cvw300/SpeedProfile.hpp>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace base;
+using namespace motors_weg_cvw300;
+
+SpeedProfile SpeedProfile::parse(istream& in) {
+    SpeedProfile profile;
+    string line;
+    for (int line_number = 1; getline(in, line); ++line_number) {
+        line = line.substr(0, line.find('#'));
+        istringstream fields(line);
+        double time;
+        Point point;
+        if (!(fields >> time)) {
+            if (line.find_first_not_of(" \t\r") == string::npos) {
+                continue;
+            }
+            throw std::invalid_argument("line " + to_string(line_number) +
+                                        ": expected TIME SPEED");
+        }
+
+        string trailing;
+        if (!(fields >> point.speed) || fields >> trailing) {
+            throw std::invalid_argument("line " + to_string(line_number) +
+                                        ": expected TIME SPEED");
+        }
+        point.time = Time::fromMicroseconds(time * 1e6);
+        if (point.time < Time() ||
+            (!profile.points.empty() && point.time < profile.points.back().time)) {
+            throw std::invalid_argument("line " + to_string(line_number) +
+                                        ": times must be positive and increasing");
+        }
+        profile.points.push_back(point);
+    }
+    return profile;
+}
+
+Time SpeedProfile::getDuration() const {
+    return points.empty() ? Time() : points.back().time;
+}
+
+float SpeedProfile::getSpeed(Time const& time) const {
+    if (points.empty()) {
+        return 0;
+    }
+
+    auto next = upper_bound(points.begin(), points.end(), time,
+                            [](Time const& t, Point const& p) { return t < p.time; });
+    if (next == points.begin()) {
+        return points.front().speed;
+    }
+    else if (next == points.end()) {
+        return points.back().speed;
+    }
+
+    auto const& previous = *(next - 1);
+    double ratio = (time - previous.time).toSeconds() /
+                   (next->time - previous.time).toSeconds();
+    return previous.speed + (next->speed - previous.speed) * ratio;
+}
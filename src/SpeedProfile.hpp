@@ -0,0 +1,49 @@
+#ifndef MOTORS_WEG_CVW300_SPEEDPROFILE_HPP
+#define MOTORS_WEG_CVW300_SPEEDPROFILE_HPP
+
+#include <base/Time.hpp>
+#include <istream>
+#include <vector>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Timed speed command profile
+     *
+     * The profile is a list of (time, speed) points, with time relative to
+     * the start of the profile. The speed is linearly interpolated between
+     * two points. Steps are expressed with two points at the same time.
+     */
+    struct SpeedProfile {
+        struct Point {
+            base::Time time;
+            /** Speed command in rad/s */
+            float speed = 0;
+        };
+
+        std::vector<Point> points;
+
+        /** Parse a profile
+         *
+         * The profile is made of one "TIME SPEED" pair per line, with the
+         * time in seconds and the speed in rad/s. Empty lines and the text
+         * that follows a '#' are ignored.
+         *
+         * @throw std::invalid_argument if a line cannot be parsed, or if the
+         *   times are negative or decreasing
+         */
+        static SpeedProfile parse(std::istream& in);
+
+        /** Time of the last point */
+        base::Time getDuration() const;
+
+        /** The speed command at a given time
+         *
+         * It is the speed of the first point before the profile starts, and
+         * of the last point after it ends. If there are multiple points at
+         * the same time, the last one is used.
+         */
+        float getSpeed(base::Time const& time) const;
+    };
+}
+
+#endif
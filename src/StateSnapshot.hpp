@@ -0,0 +1,18 @@
+#ifndef MOTORS_WEG_CVW300_STATESNAPSHOT_HPP
+#define MOTORS_WEG_CVW300_STATESNAPSHOT_HPP
+
+#include <motors_weg_cvw300/CurrentState.hpp>
+#include <motors_weg_cvw300/InverterTemperatures.hpp>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Motor state, temperatures and alarm read together from the controller
+     */
+    struct StateSnapshot {
+        CurrentState state;
+        InverterTemperatures temperatures;
+        int alarm = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,280 @@
+#include <motors_weg_cvw300/Statistics.hpp>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+using namespace std;
+using namespace base;
+using namespace motors_weg_cvw300;
+
+const int LatencyHistogram::SUB_BUCKETS;
+const int LatencyHistogram::BUCKET_COUNT;
+const int StatisticsRecorder::MAX_BLOCKS;
+
+int LatencyHistogram::bucketOf(Time const& duration) {
+    int64_t us = duration.toMicroseconds();
+    if (us < SUB_BUCKETS) {
+        return max<int64_t>(us, 0);
+    }
+
+    int log2 = 63 - __builtin_clzll(us);
+    int sub = (us >> (log2 - 2)) & (SUB_BUCKETS - 1);
+    return min(SUB_BUCKETS * (log2 - 1) + sub, BUCKET_COUNT - 1);
+}
+
+Time LatencyHistogram::getBucketLowerBound(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return Time::fromMicroseconds(bucket);
+    }
+
+    int log2 = bucket / SUB_BUCKETS + 1;
+    int sub = bucket % SUB_BUCKETS;
+    return Time::fromMicroseconds(static_cast<int64_t>(SUB_BUCKETS + sub) << (log2 - 2));
+}
+
+Time LatencyHistogram::getBucketUpperBound(int bucket) {
+    return getBucketLowerBound(bucket + 1);
+}
+
+void LatencyHistogram::add(Time const& duration) {
+    counts[bucketOf(duration)]++;
+}
+
+uint64_t LatencyHistogram::getCount() const {
+    uint64_t total = 0;
+    for (auto count : counts) {
+        total += count;
+    }
+    return total;
+}
+
+Time LatencyHistogram::getPercentile(double p) const {
+    uint64_t total = getCount();
+    if (total == 0) {
+        return Time();
+    }
+
+    // Rank of the sample, starting at 1
+    uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(p * total)));
+    uint64_t cumulated = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        cumulated += counts[i];
+        if (cumulated >= rank) {
+            return getBucketUpperBound(i);
+        }
+    }
+    return getBucketUpperBound(BUCKET_COUNT - 1);
+}
+
+static char const* OPERATION_NAMES[OPERATION_COUNT] = {
+    "calibrateInterframeDelay",
+    "configSave",
+    "readMotorRatings",
+    "readConfigurationRegisters",
+    "prepare",
+    "resetFault",
+    "enable",
+    "disable",
+    "writeSerialWatchdog",
+    "writeControlType",
+    "writeJointLimits",
+    "writeSpeedCommand",
+    "writeRampConfiguration",
+    "writeSingleRegister",
+    "writeRegisters",
+    "readCurrentState",
+    "readCurrentAlarm",
+    "readFaultState",
+    "readTemperatures",
+    "readSnapshot",
+    "readRegisters",
+    "poll"
+};
+
+char const* motors_weg_cvw300::getOperationName(DriverOperation operation) {
+    if (operation < 0 || operation >= OPERATION_COUNT) {
+        return "unknown";
+    }
+    return OPERATION_NAMES[operation];
+}
+
+void StatisticsRecorder::AtomicHistogram::add(Time const& duration) {
+    counts[LatencyHistogram::bucketOf(duration)].fetch_add(1, memory_order_relaxed);
+}
+
+void StatisticsRecorder::AtomicHistogram::read(LatencyHistogram& histogram) const {
+    for (int i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+        histogram.counts[i] = counts[i].load(memory_order_relaxed);
+    }
+}
+
+void StatisticsRecorder::AtomicHistogram::reset() {
+    for (auto& count : counts) {
+        count.store(0, memory_order_relaxed);
+    }
+}
+
+void StatisticsRecorder::AtomicTransactionStatistics::add(
+    Outcome outcome, Time const& latency, bool retry
+) {
+    frames.fetch_add(1, memory_order_relaxed);
+    if (retry) {
+        retries.fetch_add(1, memory_order_relaxed);
+    }
+
+    switch (outcome) {
+        case SUCCESS:
+            break;
+        case TIMEOUT:
+            timeouts.fetch_add(1, memory_order_relaxed);
+            return;
+        case CRC_ERROR:
+            crc_errors.fetch_add(1, memory_order_relaxed);
+            break;
+        case EXCEPTION:
+            exceptions.fetch_add(1, memory_order_relaxed);
+            break;
+        case OTHER_ERROR:
+            errors.fetch_add(1, memory_order_relaxed);
+            return;
+    }
+    this->latency.add(latency);
+}
+
+void StatisticsRecorder::AtomicTransactionStatistics::read(
+    TransactionStatistics& statistics
+) const {
+    statistics.frames = frames.load(memory_order_relaxed);
+    statistics.retries = retries.load(memory_order_relaxed);
+    statistics.timeouts = timeouts.load(memory_order_relaxed);
+    statistics.crc_errors = crc_errors.load(memory_order_relaxed);
+    statistics.exceptions = exceptions.load(memory_order_relaxed);
+    statistics.errors = errors.load(memory_order_relaxed);
+    latency.read(statistics.latency);
+}
+
+void StatisticsRecorder::AtomicTransactionStatistics::reset() {
+    for (auto counter : { &frames, &retries, &timeouts, &crc_errors,
+                          &exceptions, &errors }) {
+        counter->store(0, memory_order_relaxed);
+    }
+    latency.reset();
+}
+
+void StatisticsRecorder::AtomicOperationStatistics::reset() {
+    calls.store(0, memory_order_relaxed);
+    failures.store(0, memory_order_relaxed);
+    transactions.reset();
+    duration.reset();
+}
+
+StatisticsRecorder::StatisticsRecorder() {
+    reset();
+}
+
+void StatisticsRecorder::reset() {
+    m_total.reset();
+    for (auto& operation : m_operations) {
+        operation.reset();
+    }
+    for (auto& block : m_blocks) {
+        block.key.store(0, memory_order_relaxed);
+        block.transactions.reset();
+    }
+    m_untracked_block_transactions.store(0, memory_order_relaxed);
+}
+
+uint32_t StatisticsRecorder::blockKey(bool write, int start, int length) {
+    // Non-zero as length is at least one
+    return (write ? 1u << 31 : 0) | static_cast<uint32_t>(start & 0xFFFF) << 8 |
+           static_cast<uint32_t>(length & 0xFF);
+}
+
+StatisticsRecorder::AtomicBlockStatistics* StatisticsRecorder::findBlock(uint32_t key) {
+    // Open addressing with linear probing. Slots are only ever claimed, so
+    // a key is never moved once it has been inserted
+    uint32_t hash = ((key ^ key >> 16) * 2654435761u >> 16) % MAX_BLOCKS;
+    for (int i = 0; i < MAX_BLOCKS; ++i) {
+        auto& block = m_blocks[(hash + i) % MAX_BLOCKS];
+        uint32_t current = block.key.load(memory_order_acquire);
+        if (current == 0 &&
+            block.key.compare_exchange_strong(current, key, memory_order_acq_rel)) {
+            return &block;
+        }
+        if (current == key) {
+            return &block;
+        }
+    }
+    return nullptr;
+}
+
+void StatisticsRecorder::recordTransaction(DriverOperation operation, bool write,
+                                           int start, int length, Outcome outcome,
+                                           Time const& latency, bool retry) {
+    m_total.add(outcome, latency, retry);
+    if (operation >= 0 && operation < OPERATION_COUNT) {
+        m_operations[operation].transactions.add(outcome, latency, retry);
+    }
+
+    auto block = findBlock(blockKey(write, start, length));
+    if (block) {
+        block->transactions.add(outcome, latency, retry);
+    }
+    else {
+        m_untracked_block_transactions.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+void StatisticsRecorder::recordCall(DriverOperation operation, bool failed,
+                                    Time const& duration) {
+    auto& statistics = m_operations[operation];
+    statistics.calls.fetch_add(1, memory_order_relaxed);
+    if (failed) {
+        statistics.failures.fetch_add(1, memory_order_relaxed);
+    }
+    statistics.duration.add(duration);
+}
+
+DriverStatistics StatisticsRecorder::get() const {
+    DriverStatistics result;
+    m_total.read(result.total);
+
+    for (int i = 0; i < OPERATION_COUNT; ++i) {
+        auto const& atomic = m_operations[i];
+        if (!atomic.calls.load(memory_order_relaxed) &&
+            !atomic.transactions.frames.load(memory_order_relaxed)) {
+            continue;
+        }
+
+        OperationStatistics operation;
+        operation.operation = static_cast<DriverOperation>(i);
+        operation.calls = atomic.calls.load(memory_order_relaxed);
+        operation.failures = atomic.failures.load(memory_order_relaxed);
+        atomic.transactions.read(operation.transactions);
+        atomic.duration.read(operation.duration);
+        result.operations.push_back(operation);
+    }
+
+    for (auto const& atomic : m_blocks) {
+        uint32_t key = atomic.key.load(memory_order_acquire);
+        if (!key) {
+            continue;
+        }
+
+        BlockStatistics block;
+        block.write = key >> 31;
+        block.start = (key >> 8) & 0xFFFF;
+        block.length = key & 0xFF;
+        atomic.transactions.read(block.transactions);
+        result.blocks.push_back(block);
+    }
+    sort(result.blocks.begin(), result.blocks.end(),
+         [](BlockStatistics const& a, BlockStatistics const& b) {
+             return make_tuple(a.start, a.length, a.write) <
+                    make_tuple(b.start, b.length, b.write);
+         });
+
+    result.untracked_block_transactions =
+        m_untracked_block_transactions.load(memory_order_relaxed);
+    return result;
+}
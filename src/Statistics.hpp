@@ -0,0 +1,267 @@
+#ifndef MOTORS_WEG_CVW300_STATISTICS_HPP
+#define MOTORS_WEG_CVW300_STATISTICS_HPP
+
+#include <base/Time.hpp>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Log-linear histogram of durations
+     *
+     * Durations are counted in microseconds. Below 4us, there is one bucket
+     * per microsecond. Above, each power-of-two range is split in four
+     * buckets of equal width, which bounds the error on the percentiles to
+     * 25% while covering durations up to half a minute in 100 buckets.
+     * Longer durations are counted in the last bucket.
+     */
+    struct LatencyHistogram {
+        static const int SUB_BUCKETS = 4;
+        static const int BUCKET_COUNT = 100;
+
+        uint64_t counts[BUCKET_COUNT] = {};
+
+        /** Index of the bucket in which a duration is counted */
+        static int bucketOf(base::Time const& duration);
+
+        /** Smallest duration counted in a bucket */
+        static base::Time getBucketLowerBound(int bucket);
+
+        /** Duration at which the next bucket starts */
+        static base::Time getBucketUpperBound(int bucket);
+
+        void add(base::Time const& duration);
+
+        /** Total number of samples */
+        uint64_t getCount() const;
+
+        /** Estimate of the given percentile
+         *
+         * This is the upper bound of the bucket that contains it, i.e. the
+         * true percentile is at most this value (except when the last bucket
+         * is reached).
+         *
+         * @param p the percentile, between 0 and 1
+         * @return the estimate, or a null time if there are no samples
+         */
+        base::Time getPercentile(double p) const;
+    };
+
+    /** Counters of bus transactions */
+    struct TransactionStatistics {
+        /** Number of request frames sent */
+        uint64_t frames = 0;
+
+        /** Number of frames that re-sent an earlier request
+         *
+         * These are also counted in @c frames
+         */
+        uint64_t retries = 0;
+
+        /** Number of transactions that got no reply */
+        uint64_t timeouts = 0;
+
+        /** Number of replies with an invalid CRC */
+        uint64_t crc_errors = 0;
+
+        /** Number of exception replies */
+        uint64_t exceptions = 0;
+
+        /** Number of transactions that failed for other reasons (unexpected
+         * reply, I/O errors)
+         */
+        uint64_t errors = 0;
+
+        /** Time between the start of the request and the end of the reply, for
+         * the transactions that got a reply (valid or not)
+         */
+        LatencyHistogram latency;
+    };
+
+    /** The Driver operations the statistics are collected for */
+    enum DriverOperation {
+        OPERATION_CALIBRATE_INTERFRAME_DELAY,
+        OPERATION_CONFIG_SAVE,
+        OPERATION_READ_MOTOR_RATINGS,
+        OPERATION_READ_CONFIGURATION_REGISTERS,
+        OPERATION_PREPARE,
+        OPERATION_RESET_FAULT,
+        OPERATION_ENABLE,
+        OPERATION_DISABLE,
+        OPERATION_WRITE_SERIAL_WATCHDOG,
+        OPERATION_WRITE_CONTROL_TYPE,
+        OPERATION_WRITE_JOINT_LIMITS,
+        OPERATION_WRITE_SPEED_COMMAND,
+        OPERATION_WRITE_RAMP_CONFIGURATION,
+        OPERATION_WRITE_SINGLE_REGISTER,
+        OPERATION_WRITE_REGISTERS,
+        OPERATION_READ_CURRENT_STATE,
+        OPERATION_READ_CURRENT_ALARM,
+        OPERATION_READ_FAULT_STATE,
+        OPERATION_READ_TEMPERATURES,
+        OPERATION_READ_SNAPSHOT,
+        OPERATION_READ_REGISTERS,
+        /** The reads of the background poller */
+        OPERATION_POLL,
+        OPERATION_COUNT
+    };
+
+    /** Name of the Driver method corresponding to an operation */
+    char const* getOperationName(DriverOperation operation);
+
+    struct OperationStatistics {
+        DriverOperation operation = OPERATION_COUNT;
+
+        /** Number of calls */
+        uint64_t calls = 0;
+
+        /** Number of calls that ended with an exception */
+        uint64_t failures = 0;
+
+        /** Transactions done by the calls */
+        TransactionStatistics transactions;
+
+        /** Duration of the calls */
+        LatencyHistogram duration;
+    };
+
+    /** Statistics of the transactions on a given block of registers */
+    struct BlockStatistics {
+        bool write = false;
+        int start = 0;
+        int length = 0;
+
+        TransactionStatistics transactions;
+    };
+
+    struct DriverStatistics {
+        /** All the transactions of the driver */
+        TransactionStatistics total;
+
+        /** Statistics of the operations that have been called at least once */
+        std::vector<OperationStatistics> operations;
+
+        /** Statistics of the register blocks that have been accessed, sorted
+         * by start register
+         */
+        std::vector<BlockStatistics> blocks;
+
+        /** Transactions that are not accounted for in @c blocks, because
+         * more than StatisticsRecorder::MAX_BLOCKS different blocks have
+         * been accessed
+         */
+        uint64_t untracked_block_transactions = 0;
+    };
+
+    /**
+     * Lock-free collection of the driver statistics
+     *
+     * The recording methods can be called concurrently from any thread
+     * without blocking. They only use relaxed atomic increments, which means
+     * that a snapshot taken with @c get while transactions are being recorded
+     * may be slightly inconsistent (e.g. a transaction counted in the total
+     * but not yet in its block).
+     *
+     * The block statistics are stored in a fixed-size table, so that no
+     * allocation is needed when a new block is accessed.
+     */
+    class StatisticsRecorder {
+    public:
+        /** How a transaction ended */
+        enum Outcome {
+            SUCCESS,
+            TIMEOUT,
+            CRC_ERROR,
+            EXCEPTION,
+            OTHER_ERROR
+        };
+
+        /** Maximum number of different register blocks whose statistics
+         * are tracked
+         */
+        static const int MAX_BLOCKS = 32;
+
+    private:
+        struct AtomicHistogram {
+            std::atomic<uint64_t> counts[LatencyHistogram::BUCKET_COUNT];
+
+            void add(base::Time const& duration);
+            void read(LatencyHistogram& histogram) const;
+            void reset();
+        };
+
+        struct AtomicTransactionStatistics {
+            std::atomic<uint64_t> frames;
+            std::atomic<uint64_t> retries;
+            std::atomic<uint64_t> timeouts;
+            std::atomic<uint64_t> crc_errors;
+            std::atomic<uint64_t> exceptions;
+            std::atomic<uint64_t> errors;
+            AtomicHistogram latency;
+
+            void add(Outcome outcome, base::Time const& latency, bool retry);
+            void read(TransactionStatistics& statistics) const;
+            void reset();
+        };
+
+        struct AtomicOperationStatistics {
+            std::atomic<uint64_t> calls;
+            std::atomic<uint64_t> failures;
+            AtomicTransactionStatistics transactions;
+            AtomicHistogram duration;
+
+            void reset();
+        };
+
+        struct AtomicBlockStatistics {
+            /** Key of the block as returned by blockKey, zero if the slot is
+             * free
+             */
+            std::atomic<uint32_t> key;
+            AtomicTransactionStatistics transactions;
+        };
+
+        AtomicTransactionStatistics m_total;
+        AtomicOperationStatistics m_operations[OPERATION_COUNT];
+        AtomicBlockStatistics m_blocks[MAX_BLOCKS];
+        std::atomic<uint64_t> m_untracked_block_transactions;
+
+        static uint32_t blockKey(bool write, int start, int length);
+        AtomicBlockStatistics* findBlock(uint32_t key);
+
+    public:
+        StatisticsRecorder();
+
+        /** Record a bus transaction
+         *
+         * @param operation the operation during which it was done, or
+         *   OPERATION_COUNT if it was done outside of one
+         * @param write whether the transaction wrote or read the registers
+         * @param start the first register of the transaction
+         * @param length the number of registers
+         * @param outcome how the transaction ended
+         * @param latency duration of the transaction
+         * @param retry whether the request was the re-send of an earlier one
+         */
+        void recordTransaction(DriverOperation operation, bool write,
+                               int start, int length, Outcome outcome,
+                               base::Time const& latency, bool retry = false);
+
+        /** Record the end of a call to a Driver operation */
+        void recordCall(DriverOperation operation, bool failed,
+                        base::Time const& duration);
+
+        /** Snapshot of the statistics */
+        DriverStatistics get() const;
+
+        /** Zero all the statistics
+         *
+         * Unlike the other methods, this must not be called concurrently
+         * with the recording methods
+         */
+        void reset();
+    };
+}
+
+#endif
@@ -0,0 +1,186 @@
+#include <motors_weg_cvw300/Trace.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std;
+using namespace motors_weg_cvw300;
+using namespace motors_weg_cvw300::trace;
+
+static const char MAGIC[8] = { 'C', 'V', 'W', '3', '0', '0', 'T', 'R' };
+static const size_t RUN_HEADER_SIZE = sizeof(MAGIC) + 4;
+static const uint16_t RECORD_MARKER = 0xA55A;
+static const size_t RECORD_HEADER_SIZE = 2 + 1 + 8 + 2;
+static const size_t RECORD_TRAILER_SIZE = 2;
+
+template<typename T>
+static void writeLE(uint8_t* buffer, T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        buffer[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+template<typename T>
+static T readLE(uint8_t const* buffer) {
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<T>(buffer[i]) << (8 * i);
+    }
+    return value;
+}
+
+uint64_t trace::now() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+static bool isRunHeader(vector<uint8_t> const& buffer, size_t pos) {
+    return buffer.size() - pos >= RUN_HEADER_SIZE &&
+           memcmp(&buffer[pos], MAGIC, sizeof(MAGIC)) == 0;
+}
+
+/** Decode the record that starts at @c pos
+ *
+ * @return the size of the record, or zero if there is no valid record there
+ */
+static size_t parseRecord(vector<uint8_t> const& buffer, size_t pos, Record& record) {
+    size_t available = buffer.size() - pos;
+    if (available < RECORD_HEADER_SIZE + RECORD_TRAILER_SIZE) {
+        return 0;
+    }
+
+    uint8_t const* header = &buffer[pos];
+    if (readLE<uint16_t>(header) != RECORD_MARKER || header[2] > REPLY) {
+        return 0;
+    }
+    size_t size = readLE<uint16_t>(header + 11);
+    size_t record_size = RECORD_HEADER_SIZE + size + RECORD_TRAILER_SIZE;
+    if (available < record_size ||
+        readLE<uint16_t>(header + RECORD_HEADER_SIZE + size) != size) {
+        return 0;
+    }
+
+    uint8_t const* data = header + RECORD_HEADER_SIZE;
+    record.direction = static_cast<Direction>(header[2]);
+    record.time = readLE<uint64_t>(header + 3);
+    record.data.assign(data, data + size);
+    return record_size;
+}
+
+vector<Record> trace::read(istream& in) {
+    vector<uint8_t> buffer((istreambuf_iterator<char>(in)),
+                           istreambuf_iterator<char>());
+    if (!isRunHeader(buffer, 0)) {
+        throw std::invalid_argument("not a CVW300 trace");
+    }
+
+    vector<Record> records;
+    uint32_t runs = 0;
+    uint64_t last_time = 0;
+    size_t pos = 0;
+    while (pos < buffer.size()) {
+        if (isRunHeader(buffer, pos)) {
+            uint32_t version = readLE<uint32_t>(&buffer[pos + sizeof(MAGIC)]);
+            if (version != VERSION) {
+                throw std::invalid_argument("unsupported trace version " +
+                                            to_string(version));
+            }
+            runs++;
+            last_time = 0;
+            pos += RUN_HEADER_SIZE;
+            continue;
+        }
+
+        // Data that is not a valid record is what remains of a record
+        // truncated by a crash. Skip it byte by byte until the next record,
+        // or the header of the next run
+        Record record;
+        size_t size = parseRecord(buffer, pos, record);
+        if (size == 0 || record.time < last_time) {
+            pos++;
+            continue;
+        }
+
+        record.run = runs - 1;
+        last_time = record.time;
+        records.push_back(move(record));
+        pos += size;
+    }
+    return records;
+}
+
+vector<Record> trace::read(string const& path) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    return read(in);
+}
+
+vector<Transaction> trace::toTransactions(vector<Record> const& records) {
+    vector<Transaction> result;
+    for (auto const& record : records) {
+        if (record.direction == REQUEST) {
+            Transaction transaction;
+            transaction.request = record.data;
+            transaction.request_time = record.time;
+            transaction.reply_time = record.time;
+            transaction.run = record.run;
+            result.push_back(transaction);
+        }
+        else if (!result.empty() && result.back().run == record.run) {
+            auto& transaction = result.back();
+            transaction.reply.insert(transaction.reply.end(),
+                                     record.data.begin(), record.data.end());
+            transaction.reply_time = record.time;
+        }
+    }
+    return result;
+}
+
+Writer::Writer(string const& path)
+    : m_file(path, ios::binary | ios::app) {
+    if (!m_file) {
+        throw std::runtime_error("cannot open " + path + " to write the trace");
+    }
+
+    uint8_t header[RUN_HEADER_SIZE];
+    memcpy(header, MAGIC, sizeof(MAGIC));
+    writeLE<uint32_t>(header + sizeof(MAGIC), VERSION);
+    m_file.write(reinterpret_cast<char const*>(header), sizeof(header));
+    m_file.flush();
+}
+
+void Writer::write(Direction direction, uint8_t const* data, size_t size) {
+    uint64_t time = now();
+    lock_guard<mutex> lock(m_mutex);
+    // Split data that does not fit in the size field in multiple records
+    do {
+        uint16_t length = min<size_t>(size, UINT16_MAX);
+        uint8_t header[RECORD_HEADER_SIZE];
+        writeLE<uint16_t>(header, RECORD_MARKER);
+        header[2] = direction;
+        writeLE<uint64_t>(header + 3, time);
+        writeLE<uint16_t>(header + 11, length);
+        uint8_t trailer[RECORD_TRAILER_SIZE];
+        writeLE<uint16_t>(trailer, length);
+        m_file.write(reinterpret_cast<char const*>(header), sizeof(header));
+        m_file.write(reinterpret_cast<char const*>(data), length);
+        m_file.write(reinterpret_cast<char const*>(trailer), sizeof(trailer));
+        data += length;
+        size -= length;
+    } while (size > 0);
+    m_file.flush();
+}
+
+void Writer::writeData(uint8_t const* data, size_t size) {
+    write(REQUEST, data, size);
+}
+
+void Writer::readData(uint8_t const* data, size_t size) {
+    write(REPLY, data, size);
+}
@@ -0,0 +1,127 @@
+#ifndef MOTORS_WEG_CVW300_TRACE_HPP
+#define MOTORS_WEG_CVW300_TRACE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <iodrivers_base/IOListener.hpp>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Binary traces of the frames exchanged with the controller
+     *
+     * A trace file is only ever appended to, so that the captures of
+     * successive runs end up in the same trace. Each run starts with the 8
+     * bytes "CVW300TR" followed by the format version as a 32-bit integer.
+     * It is then a sequence of records, each made of
+     *
+     * - the record marker (uint16, 0xA55A)
+     * - the direction (uint8, 0 for requests, 1 for replies)
+     * - the time at which the data was seen by the driver (uint64, in
+     *   nanoseconds of the monotonic clock, whose origin is arbitrary and
+     *   changes at each boot)
+     * - the data size (uint16)
+     * - the data itself
+     * - the data size again (uint16)
+     *
+     * All integers are little-endian. A record truncated by a crash does not
+     * have a valid marker and matching sizes at the expected places. The
+     * reader skips such data until the next record or run.
+     */
+    namespace trace {
+        static const int VERSION = 2;
+
+        enum Direction {
+            REQUEST = 0,
+            REPLY = 1
+        };
+
+        struct Record {
+            Direction direction = REQUEST;
+            /** Monotonic time in nanoseconds */
+            uint64_t time = 0;
+            std::vector<uint8_t> data;
+            /** Index of the run that captured the record in the file
+             *
+             * Times can only be compared within the same run
+             */
+            uint32_t run = 0;
+        };
+
+        /** A request and the reply that followed it */
+        struct Transaction {
+            std::vector<uint8_t> request;
+            /** The reply, empty if the request got none (timeout) */
+            std::vector<uint8_t> reply;
+            /** Monotonic time at which the request was sent, in nanoseconds */
+            uint64_t request_time = 0;
+            /** Monotonic time at which the last part of the reply was
+             * received, in nanoseconds. Equal to request_time if there is no
+             * reply
+             */
+            uint64_t reply_time = 0;
+            /** Index of the run that captured the transaction in the file */
+            uint32_t run = 0;
+        };
+
+        /** The current time of the monotonic clock used in the traces */
+        uint64_t now();
+
+        /** Read all the records of a trace
+         *
+         * Data that is not a valid record, e.g. a record truncated by a
+         * crash, is skipped. So are records whose time is before the one of
+         * the previous record of the same run.
+         *
+         * @throw std::invalid_argument if the stream is not a trace, or has
+         *   runs of an unsupported version
+         */
+        std::vector<Record> read(std::istream& in);
+
+        /** Read all the records of a trace file
+         *
+         * @throw std::runtime_error if the file cannot be opened
+         * @throw std::invalid_argument if it is not a trace of a supported
+         *   version
+         */
+        std::vector<Record> read(std::string const& path);
+
+        /** Group the records of a trace into transactions
+         *
+         * Each request is associated with all the reply data received until
+         * the next request of the same run
+         */
+        std::vector<Transaction> toTransactions(std::vector<Record> const& records);
+
+        /**
+         * Capture of the frames exchanged by a driver into a trace file
+         *
+         * Register it with the driver's addListener. Each record is flushed
+         * as soon as it is written, so that the trace is complete even if
+         * the process crashes
+         */
+        class Writer : public iodrivers_base::IOListener {
+            std::mutex m_mutex;
+            std::ofstream m_file;
+
+            void write(Direction direction, uint8_t const* data, size_t size);
+
+        public:
+            /** Open a trace file for appending, creating it if needed
+             *
+             * It starts a new run in the file
+             *
+             * @throw std::runtime_error if the file cannot be opened
+             */
+            explicit Writer(std::string const& path);
+
+            void writeData(uint8_t const* data, size_t size) override;
+            void readData(uint8_t const* data, size_t size) override;
+        };
+    }
+}
+
+#endif
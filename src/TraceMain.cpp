@@ -0,0 +1,107 @@
+#include <iomanip>
+#include <iostream>
+#include <motors_weg_cvw300/Statistics.hpp>
+#include <motors_weg_cvw300/Trace.hpp>
+#include <sstream>
+#include <string>
+
+using namespace base;
+using namespace std;
+using namespace motors_weg_cvw300;
+
+void usage(ostream& stream)
+{
+    stream << "usage: motors_weg_cvw300_trace CMD TRACE\n"
+           << "Inspects the frame traces captured by motors_weg_cvw300_ctl when "
+              "MOTORS_WEG_CVW300_TRACE is set\n"
+           << "\n"
+           << "Available Commands\n"
+           << "  dump: display the transactions, with their time relative to the "
+              "start of their run and their latency\n"
+           << "  stats: display the number of transactions and timeouts, and the "
+              "latency distribution\n"
+           << endl;
+}
+
+static string toHex(vector<uint8_t> const& data)
+{
+    ostringstream out;
+    out << hex << setfill('0');
+    for (size_t i = 0; i < data.size(); ++i) {
+        out << (i ? " " : "") << setw(2) << static_cast<int>(data[i]);
+    }
+    return out.str();
+}
+
+static double toMilliseconds(uint64_t ns)
+{
+    return ns / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        bool error = argc == 1 ? 0 : 1;
+        usage(error ? cerr : cout);
+        return error;
+    }
+
+    string cmd = argv[1];
+    auto transactions = trace::toTransactions(trace::read(string(argv[2])));
+
+    if (cmd == "dump") {
+        // The monotonic clock may restart between runs, so times are shown
+        // relative to the first transaction of their run
+        uint64_t start = 0;
+        uint32_t run = 0;
+        cout << fixed << setprecision(3);
+        for (size_t i = 0; i < transactions.size(); ++i) {
+            auto const& t = transactions[i];
+            if (i == 0 || t.run != run) {
+                run = t.run;
+                start = t.request_time;
+                cout << "run " << run << "\n";
+            }
+            cout << setw(12) << toMilliseconds(t.request_time - start) << " > "
+                 << toHex(t.request) << "\n";
+            if (t.reply.empty()) {
+                cout << setw(12) << "" << " < (timeout)\n";
+            }
+            else {
+                cout << setw(12) << toMilliseconds(t.reply_time - start) << " < "
+                     << toHex(t.reply) << " (" << setprecision(1)
+                     << toMilliseconds(t.reply_time - t.request_time) << " ms)"
+                     << setprecision(3) << "\n";
+            }
+        }
+        cout << flush;
+    }
+    else if (cmd == "stats") {
+        LatencyHistogram latency;
+        uint64_t timeouts = 0;
+        for (auto const& t : transactions) {
+            if (t.reply.empty()) {
+                timeouts++;
+            }
+            else {
+                latency.add(Time::fromMicroseconds(
+                    (t.reply_time - t.request_time) / 1000
+                ));
+            }
+        }
+
+        auto ms = [](Time const& time) { return time.toMicroseconds() / 1000.0; };
+        cout << fixed << setprecision(1)
+             << "Transactions: " << transactions.size() << "\n"
+             << "Timeouts: " << timeouts << "\n"
+             << "Latency p50: " << ms(latency.getPercentile(0.5)) << " ms\n"
+             << "Latency p99: " << ms(latency.getPercentile(0.99)) << " ms\n"
+             << "Latency max: " << ms(latency.getPercentile(1)) << " ms" << endl;
+    }
+    else {
+        cerr << "unknown command '" << cmd << "'\n";
+        usage(cerr);
+        return 1;
+    }
+    return 0;
+}
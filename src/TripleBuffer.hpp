@@ -0,0 +1,64 @@
+#ifndef MOTORS_WEG_CVW300_TRIPLEBUFFER_HPP
+#define MOTORS_WEG_CVW300_TRIPLEBUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace motors_weg_cvw300 {
+    /**
+     * Wait-free exchange of the latest value between a single writer thread
+     * and a single reader thread
+     *
+     * The writer and the reader each own one of the three slots. The third
+     * one is exchanged atomically when a value is published (writer side) or
+     * fetched (reader side). Neither side ever blocks the other.
+     */
+    template<typename T>
+    class TripleBuffer {
+        static const uint8_t INDEX_MASK = 0x3;
+        static const uint8_t NEW_DATA = 0x4;
+
+        T m_slots[3];
+        /** Index of the shared slot, plus NEW_DATA if it has not been
+         * fetched yet
+         */
+        std::atomic<uint8_t> m_shared;
+        uint8_t m_write = 0;
+        uint8_t m_read = 1;
+
+    public:
+        TripleBuffer()
+            : m_shared(2) {
+        }
+
+        /** The slot in which the writer should put the next value */
+        T& getWriteBuffer() {
+            return m_slots[m_write];
+        }
+
+        /** Make the value in the write buffer available to the reader */
+        void publish() {
+            m_write = m_shared.exchange(m_write | NEW_DATA) & INDEX_MASK;
+        }
+
+        /** Write and publish a value */
+        void write(T const& value) {
+            getWriteBuffer() = value;
+            publish();
+        }
+
+        /** Fetch the latest published value
+         *
+         * Returns the same value as the previous call if nothing new has
+         * been published in-between
+         */
+        T const& read() {
+            if (m_shared.load() & NEW_DATA) {
+                m_read = m_shared.exchange(m_read) & INDEX_MASK;
+            }
+            return m_slots[m_read];
+        }
+    };
+}
+
+#endif
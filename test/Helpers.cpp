@@ -3,3 +3,34 @@
 
 using namespace std;
 using namespace modbus;
+
+void BusUsage::writeData(uint8_t const*, size_t size) {
+    frames++;
+    bytes += size;
+}
+
+void BusUsage::readData(uint8_t const*, size_t size) {
+    bytes += size;
+}
+
+vector<uint8_t> formatWriteMultipleRequest(
+    int address, int start, vector<uint16_t> const& values
+) {
+    vector<uint8_t> payload{
+        static_cast<uint8_t>((start >> 8) & 0xFF),
+        static_cast<uint8_t>(start & 0xFF),
+        static_cast<uint8_t>((values.size() >> 8) & 0xFF),
+        static_cast<uint8_t>(values.size() & 0xFF),
+        static_cast<uint8_t>(values.size() * 2)
+    };
+    for (auto v : values) {
+        payload.push_back((v >> 8) & 0xFF);
+        payload.push_back(v & 0xFF);
+    }
+
+    uint8_t frame[512];
+    uint8_t* end = RTU::formatFrame(
+        frame, address, 0x10, &payload[0], &payload[0] + payload.size()
+    );
+    return vector<uint8_t>(frame, end);
+}
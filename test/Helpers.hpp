@@ -2,7 +2,25 @@
 #define MOTORS_WEG_CVW300_HELPERS_HPP
 
 #include <gtest/gtest.h>
+#include <iodrivers_base/IOListener.hpp>
 #include <modbus/RTU.hpp>
+#include <motors_weg_cvw300/Trace.hpp>
+
+/** Counts the frames and bytes a driver exchanges on the bus */
+struct BusUsage : public iodrivers_base::IOListener {
+    /** Number of request frames sent */
+    int frames = 0;
+    /** Number of bytes on the bus, requests and replies */
+    size_t bytes = 0;
+
+    void writeData(uint8_t const* data, size_t size) override;
+    void readData(uint8_t const* data, size_t size) override;
+};
+
+/** The request frame of a Write Multiple Registers */
+std::vector<uint8_t> formatWriteMultipleRequest(
+    int address, int start, std::vector<uint16_t> const& values
+);
 
 template<typename Test>
 struct Helpers {
@@ -14,10 +32,50 @@ struct Helpers {
         int address, int registerID, uint16_t value
     );
 
+    void EXPECT_MODBUS_WRITE_EXCEPTION(
+        int address, int registerID, uint16_t value, uint8_t exception_code
+    );
+
+    void EXPECT_MODBUS_WRITE_MULTIPLE(
+        int address, int start, std::vector<uint16_t> values
+    );
+
+    void EXPECT_MODBUS_WRITE_MULTIPLE_EXCEPTION(
+        int address, int start, std::vector<uint16_t> values,
+        uint8_t exception_code
+    );
+
     void EXPECT_MODBUS_READ(
         int address, bool input,
         int register_id, std::vector<uint16_t> expected_values
     );
+
+    void EXPECT_MODBUS_READ_EXCEPTION(
+        int address, bool input, int register_id, int length,
+        uint8_t exception_code
+    );
+
+    /** Run @a f and check that it does not use more than @a max_frames
+     * requests and @a max_bytes bytes (requests and replies) on the bus
+     *
+     * The transactions themselves must still be declared with the other
+     * EXPECT_ methods. This makes the bus usage of an API call part of its
+     * tested contract, regardless of which registers the test expects
+     *
+     * @return the measured bus usage
+     */
+    template<typename F>
+    BusUsage EXPECT_BUS_BUDGET(int max_frames, size_t max_bytes, F f);
+
+    /** Expect the requests of a captured trace, and answer them with the
+     * captured replies
+     *
+     * Requests that got no reply in the trace are expected with an empty
+     * reply, i.e. they time out during the replay
+     */
+    void EXPECT_TRACE(
+        std::vector<motors_weg_cvw300::trace::Transaction> const& transactions
+    );
 };
 
 template<typename Test>
@@ -44,6 +102,57 @@ void Helpers<Test>::EXPECT_MODBUS_WRITE(
                       std::vector<std::uint8_t>(responseFrame, responseEnd));
 }
 
+template<typename Test>
+void Helpers<Test>::EXPECT_MODBUS_WRITE_EXCEPTION(
+    int address, int registerID, uint16_t value, uint8_t exception_code
+) {
+    uint8_t requestFrame[256];
+    uint8_t* requestEnd = modbus::RTU::formatWriteRegister(
+        requestFrame, address, registerID, value
+    );
+
+    uint8_t responseFrame[256];
+    uint8_t* responseEnd = modbus::RTU::formatFrame(
+        responseFrame, requestFrame[0], requestFrame[1] | 0x80,
+        &exception_code, &exception_code + 1
+    );
+
+    test.EXPECT_REPLY(std::vector<std::uint8_t>(requestFrame, requestEnd),
+                      std::vector<std::uint8_t>(responseFrame, responseEnd));
+}
+
+template<typename Test>
+void Helpers<Test>::EXPECT_MODBUS_WRITE_MULTIPLE(
+    int address, int start, std::vector<uint16_t> values
+) {
+    auto request = formatWriteMultipleRequest(address, start, values);
+
+    // The reply echoes the start and number of registers
+    uint8_t responseFrame[256];
+    uint8_t* responseEnd = modbus::RTU::formatFrame(
+        responseFrame, request[0], request[1], &request[2], &request[6]
+    );
+
+    test.EXPECT_REPLY(request,
+                      std::vector<std::uint8_t>(responseFrame, responseEnd));
+}
+
+template<typename Test>
+void Helpers<Test>::EXPECT_MODBUS_WRITE_MULTIPLE_EXCEPTION(
+    int address, int start, std::vector<uint16_t> values, uint8_t exception_code
+) {
+    auto request = formatWriteMultipleRequest(address, start, values);
+
+    uint8_t responseFrame[256];
+    uint8_t* responseEnd = modbus::RTU::formatFrame(
+        responseFrame, request[0], request[1] | 0x80,
+        &exception_code, &exception_code + 1
+    );
+
+    test.EXPECT_REPLY(request,
+                      std::vector<std::uint8_t>(responseFrame, responseEnd));
+}
+
 template<typename Test>
 void Helpers<Test>::EXPECT_MODBUS_READ(
     int address, bool input, int start, std::vector<uint16_t> expected_values
@@ -69,4 +178,51 @@ void Helpers<Test>::EXPECT_MODBUS_READ(
                       std::vector<std::uint8_t>(responseFrame, responseEnd));
 }
 
+template<typename Test>
+void Helpers<Test>::EXPECT_MODBUS_READ_EXCEPTION(
+    int address, bool input, int start, int length, uint8_t exception_code
+) {
+    uint8_t requestFrame[256];
+    uint8_t* requestEnd = modbus::RTU::formatReadRegisters(
+        requestFrame, address, input, start, length
+    );
+
+    uint8_t responseFrame[256];
+    uint8_t* responseEnd = modbus::RTU::formatFrame(
+        responseFrame, requestFrame[0], requestFrame[1] | 0x80,
+        &exception_code, &exception_code + 1
+    );
+
+    test.EXPECT_REPLY(std::vector<std::uint8_t>(requestFrame, requestEnd),
+                      std::vector<std::uint8_t>(responseFrame, responseEnd));
+}
+
+template<typename Test>
+template<typename F>
+BusUsage Helpers<Test>::EXPECT_BUS_BUDGET(int max_frames, size_t max_bytes, F f) {
+    BusUsage usage;
+    test.driver.addListener(&usage);
+    try {
+        f();
+    }
+    catch (...) {
+        test.driver.removeListener(&usage);
+        throw;
+    }
+    test.driver.removeListener(&usage);
+
+    EXPECT_LE(usage.frames, max_frames) << "frame budget exceeded";
+    EXPECT_LE(usage.bytes, max_bytes) << "byte budget exceeded";
+    return usage;
+}
+
+template<typename Test>
+void Helpers<Test>::EXPECT_TRACE(
+    std::vector<motors_weg_cvw300::trace::Transaction> const& transactions
+) {
+    for (auto const& transaction : transactions) {
+        test.EXPECT_REPLY(transaction.request, transaction.reply);
+    }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <iodrivers_base/FixtureGTest.hpp>
+#include <motors_weg_cvw300/BusScheduler.hpp>
+#include "Helpers.hpp"
+
+using namespace motors_weg_cvw300;
+
+struct BusSchedulerTest : public testing::Test,
+                          public iodrivers_base::Fixture<BusScheduler>,
+                          public Helpers<BusSchedulerTest> {
+    BusSchedulerTest()
+        : Helpers<BusSchedulerTest>(*this) {
+        MotorRatings ratings;
+        ratings.speed = 10;
+        ratings.torque = 42;
+
+        driver.addDrive(1);
+        driver.addDrive(2);
+        driver.getDrive(0).setMotorRatings(ratings);
+        driver.getDrive(1).setMotorRatings(ratings);
+    }
+
+    void EXPECT_STATE_READ(int address, uint16_t speed) {
+        EXPECT_MODBUS_READ(address, false, 2, { speed, 0, 0, 0, 0, 0, 0, 0 });
+        EXPECT_MODBUS_READ(address, false, 37, { 0 });
+    }
+};
+
+TEST_F(BusSchedulerTest, it_reads_the_state_of_all_drives_by_default) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_STATE_READ(1, 60);
+    EXPECT_STATE_READ(2, 120);
+    ASSERT_EQ(2, driver.runCycle());
+
+    ASSERT_FLOAT_EQ(2 * M_PI, driver.getState(0).motor.speed);
+    ASSERT_FLOAT_EQ(4 * M_PI, driver.getState(1).motor.speed);
+    ASSERT_EQ(1, driver.getStatistics(0).state_updates);
+    ASSERT_EQ(1, driver.getStatistics(1).state_updates);
+}
+
+TEST_F(BusSchedulerTest, it_sends_the_commands_before_reading_the_states) {
+    IODRIVERS_BASE_MOCK();
+
+    driver.setSpeedCommand(0, 5.2);
+    driver.setSpeedCommand(1, -5.2);
+    EXPECT_MODBUS_WRITE(1, 683, 4259);
+    EXPECT_MODBUS_WRITE(2, 683, -4259);
+    EXPECT_STATE_READ(1, 0);
+    EXPECT_STATE_READ(2, 0);
+    driver.runCycle();
+
+    ASSERT_EQ(1, driver.getStatistics(0).commands);
+    ASSERT_EQ(1, driver.getStatistics(1).commands);
+}
+
+TEST_F(BusSchedulerTest, it_reads_the_states_round_robin_within_the_budget) {
+    IODRIVERS_BASE_MOCK();
+
+    driver.setSpeedCommand(0, 5.2);
+    driver.setSpeedCommand(1, -5.2);
+    auto model = driver.getDrive(0).getBusCostModel();
+    driver.setCycleBudget(model.writeFrameCost() * 2 +
+                          driver.getDrive(0).estimateCurrentStateReadCost());
+
+    EXPECT_MODBUS_WRITE(1, 683, 4259);
+    EXPECT_MODBUS_WRITE(2, 683, -4259);
+    EXPECT_STATE_READ(1, 0);
+    ASSERT_EQ(1, driver.runCycle());
+
+    EXPECT_MODBUS_WRITE(1, 683, 4259);
+    EXPECT_MODBUS_WRITE(2, 683, -4259);
+    EXPECT_STATE_READ(2, 0);
+    ASSERT_EQ(1, driver.runCycle());
+
+    ASSERT_EQ(1, driver.getStatistics(0).state_updates);
+    ASSERT_EQ(1, driver.getStatistics(1).state_updates);
+    ASSERT_EQ(2, driver.getStatistics(0).commands);
+}
+
+TEST_F(BusSchedulerTest, it_reads_at_least_one_state_per_cycle) {
+    IODRIVERS_BASE_MOCK();
+
+    driver.setCycleBudget(base::Time::fromMicroseconds(1));
+    EXPECT_STATE_READ(1, 0);
+    ASSERT_EQ(1, driver.runCycle());
+}
+
+TEST_F(BusSchedulerTest, it_counts_errors_and_continues_the_cycle) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_READ_EXCEPTION(1, false, 2, 8, 4);
+    EXPECT_STATE_READ(2, 0);
+    driver.runCycle();
+
+    ASSERT_EQ(1, driver.getStatistics(0).errors);
+    ASSERT_EQ(0, driver.getStatistics(0).state_updates);
+    ASSERT_EQ(1, driver.getStatistics(1).state_updates);
+}
+
+TEST_F(BusSchedulerTest, it_does_not_count_the_suppressed_commands) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_WRITE(1, 313, 1);
+    EXPECT_MODBUS_WRITE(1, 314, 10);
+    driver.getDrive(0).writeSerialWatchdog(base::Time::fromSeconds(1));
+    driver.getDrive(0).setSpeedCommandSuppression(true);
+    driver.setSpeedCommand(0, 5.2);
+
+    EXPECT_MODBUS_WRITE(1, 683, 4259);
+    EXPECT_STATE_READ(1, 0);
+    EXPECT_STATE_READ(2, 0);
+    driver.runCycle();
+    EXPECT_STATE_READ(1, 0);
+    EXPECT_STATE_READ(2, 0);
+    driver.runCycle();
+
+    ASSERT_EQ(1, driver.getStatistics(0).commands);
+    ASSERT_EQ(0, driver.getStatistics(0).errors);
+}
+
+TEST_F(BusSchedulerTest, it_counts_the_commands_refused_by_the_driver_as_errors) {
+    IODRIVERS_BASE_MOCK();
+
+    driver.getDrive(0).setMotorRatings(MotorRatings());
+    driver.setSpeedCommand(0, 5.2);
+
+    EXPECT_STATE_READ(1, 0);
+    EXPECT_STATE_READ(2, 0);
+    ASSERT_EQ(2, driver.runCycle());
+
+    ASSERT_EQ(0, driver.getStatistics(0).commands);
+    ASSERT_EQ(1, driver.getStatistics(0).errors);
+}
+
+TEST_F(BusSchedulerTest, it_refuses_to_change_the_bus_timing_from_a_drive) {
+    auto& drive = driver.getDrive(0);
+    ASSERT_THROW(drive.setInterframeDelay(base::Time::fromMilliseconds(5)),
+                 std::logic_error);
+    ASSERT_THROW(drive.calibrateInterframeDelay(), std::logic_error);
+}
+
+TEST_F(BusSchedulerTest, it_refuses_to_open_a_drive_of_the_shared_bus) {
+    ASSERT_THROW(driver.getDrive(0).openURI("test://"), std::logic_error);
+}
+
+TEST_F(BusSchedulerTest, it_updates_the_cost_model_of_the_drives) {
+    driver.setInterframeDelay(base::Time::fromMilliseconds(5));
+    ASSERT_EQ(base::Time::fromMilliseconds(5),
+              driver.getDrive(1).getBusCostModel().interframe_delay);
+}
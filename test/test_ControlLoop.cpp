@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <base/Float.hpp>
+#include <future>
+#include <iodrivers_base/FixtureGTest.hpp>
+#include <motors_weg_cvw300/ControlLoop.hpp>
+#include <motors_weg_cvw300/Driver.hpp>
+#include <unistd.h>
+#include "Helpers.hpp"
+
+using namespace motors_weg_cvw300;
+
+struct ControlLoopDriver : public Driver {
+    ControlLoopDriver()
+        : Driver(5) {
+    }
+};
+
+struct ControlLoopTest : public testing::Test,
+                         public iodrivers_base::Fixture<ControlLoopDriver>,
+                         public Helpers<ControlLoopTest> {
+    ControlLoopSettings settings;
+    ControlLoop loop;
+    std::promise<void> done;
+
+    ControlLoopTest()
+        : Helpers<ControlLoopTest>(*this)
+        , loop(driver) {
+        MotorRatings ratings;
+        ratings.speed = 10;
+        ratings.torque = 42;
+        driver.setMotorRatings(ratings);
+        settings.period = base::Time::fromMilliseconds(1);
+    }
+
+    void EXPECT_STATE_READ(uint16_t speed) {
+        EXPECT_MODBUS_READ(5, false, 2, { speed, 0, 0, 0, 0, 0, 0, 0 });
+        EXPECT_MODBUS_READ(5, false, 37, { 0 });
+    }
+
+    /** Stop the loop after the given number of callback calls */
+    ControlLoop::Callback stopAfter(int cycles, std::vector<float> const& commands) {
+        auto calls = std::make_shared<int>(0);
+        return [=](CurrentState const&) {
+            int call = (*calls)++;
+            if (call + 1 == cycles) {
+                loop.requestStop();
+                done.set_value();
+            }
+            return commands.at(call);
+        };
+    }
+
+    void waitAndStop() {
+        ASSERT_EQ(std::future_status::ready,
+                  done.get_future().wait_for(std::chrono::seconds(5)));
+        loop.stop();
+    }
+};
+
+TEST_F(ControlLoopTest, it_reads_the_state_and_writes_the_command_of_the_callback) {
+    IODRIVERS_BASE_MOCK();
+
+    std::vector<float> speeds;
+    EXPECT_STATE_READ(100);
+    EXPECT_MODBUS_WRITE(5, 683, 2048);
+    EXPECT_STATE_READ(200);
+    EXPECT_MODBUS_WRITE(5, 683, 4096);
+    auto callback = stopAfter(2, { 2.5, 5 });
+    loop.start([&](CurrentState const& state) {
+        speeds.push_back(state.motor.speed);
+        return callback(state);
+    }, settings);
+    waitAndStop();
+
+    ASSERT_EQ(2, speeds.size());
+    ASSERT_LT(speeds[0], speeds[1]);
+    auto statistics = loop.getStatistics();
+    ASSERT_EQ(2, statistics.cycles);
+    ASSERT_EQ(0, statistics.errors);
+    ASSERT_EQ(2, statistics.jitter.getCount());
+    ASSERT_EQ(1, statistics.period.getCount());
+    ASSERT_EQ(2, statistics.duration.getCount());
+}
+
+TEST_F(ControlLoopTest, it_does_not_write_a_command_if_the_callback_returns_unknown) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_STATE_READ(0);
+    EXPECT_STATE_READ(0);
+    EXPECT_MODBUS_WRITE(5, 683, 2048);
+    loop.start(stopAfter(2, { base::unknown<float>(), 2.5 }), settings);
+    waitAndStop();
+}
+
+TEST_F(ControlLoopTest, it_counts_the_failed_cycles_and_continues) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 2, 8, 2);
+    EXPECT_STATE_READ(0);
+    EXPECT_MODBUS_WRITE(5, 683, 2048);
+    loop.start(stopAfter(1, { 2.5 }), settings);
+    waitAndStop();
+
+    auto statistics = loop.getStatistics();
+    ASSERT_EQ(2, statistics.cycles);
+    ASSERT_EQ(1, statistics.errors);
+}
+
+TEST_F(ControlLoopTest, it_stops_if_the_callback_throws_something_else_than_a_runtime_error) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_STATE_READ(0);
+    loop.start([&](CurrentState const&) -> float {
+        done.set_value();
+        throw std::logic_error("bug");
+    }, settings);
+    ASSERT_EQ(std::future_status::ready,
+              done.get_future().wait_for(std::chrono::seconds(5)));
+    while (loop.getStatistics().cycles == 0) {
+        usleep(1000);
+    }
+    loop.stop();
+
+    auto statistics = loop.getStatistics();
+    ASSERT_EQ(1, statistics.cycles);
+    ASSERT_EQ(1, statistics.errors);
+    ASSERT_TRUE(statistics.aborted);
+}
+
+TEST_F(ControlLoopTest, it_reports_scheduling_settings_that_cannot_be_applied) {
+    settings.priority = 1000;
+    ASSERT_THROW(loop.start([](CurrentState const&) { return 0.0f; }, settings),
+                 std::runtime_error);
+    ASSERT_FALSE(loop.isRunning());
+}
+
+TEST_F(ControlLoopTest, it_refuses_to_start_twice) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_STATE_READ(0);
+    EXPECT_MODBUS_WRITE(5, 683, 2048);
+    loop.start(stopAfter(1, { 2.5 }), settings);
+    ASSERT_THROW(loop.start([](CurrentState const&) { return 0.0f; }, settings),
+                 std::logic_error);
+    waitAndStop();
+}
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
 #include <iodrivers_base/FixtureGTest.hpp>
 #include <motors_weg_cvw300/Driver.hpp>
 #include "Helpers.hpp"
@@ -22,10 +24,14 @@ struct DriverTest : public testing::Test,
 TEST_F(DriverTest, it_reads_motor_parameters) {
     IODRIVERS_BASE_MOCK();
 
-    EXPECT_MODBUS_READ(5, false, 405, { 1024 }); // 1024 ticks per turn
-    EXPECT_MODBUS_READ(5, false, 401, { 10 }); // 1A nominal
-    EXPECT_MODBUS_READ(5, false, 402, { 500 }); // 500rpm nominal
-    EXPECT_MODBUS_READ(5, false, 404, { 1 }); // 6 kW
+    EXPECT_MODBUS_READ(5, false, 401,
+        { 10, // 1A nominal
+          500, // 500rpm nominal
+          0, // 0403
+          1, // 6 kW
+          1024 // 1024 ticks per turn
+        }
+    );
     auto ratings = driver.readMotorRatings();
 
     ASSERT_FLOAT_EQ(1024, ratings.encoder_count);
@@ -40,14 +46,76 @@ TEST_F(DriverTest, it_keeps_the_encoder_scale_parameter) {
 
     driver.setEncoderScale(4);
 
-    EXPECT_MODBUS_READ(5, false, 405, { 1024 }); // 1024 ticks per turn
-    EXPECT_MODBUS_READ(5, false, 401, { 10 }); // 1A nominal
-    EXPECT_MODBUS_READ(5, false, 402, { 500 }); // 500rpm nominal
-    EXPECT_MODBUS_READ(5, false, 404, { 1 }); // 6 kW
+    EXPECT_MODBUS_READ(5, false, 401,
+        { 10, // 1A nominal
+          500, // 500rpm nominal
+          0, // 0403
+          1, // 6 kW
+          1024 // 1024 ticks per turn
+        }
+    );
     auto ratings = driver.readMotorRatings();
     ASSERT_EQ(4, ratings.encoder_scale);
 }
 
+TEST_F(DriverTest, it_writes_the_motor_ratings_cache_when_it_does_not_exist) {
+    IODRIVERS_BASE_MOCK();
+
+    std::string path = testing::TempDir() + "motors_weg_cvw300_test.motor_ratings";
+    std::remove(path.c_str());
+    EXPECT_MODBUS_READ(5, false, 401, { 10, 500, 0, 1, 1024 });
+    driver.readMotorRatings(path, base::Time::fromSeconds(60));
+
+    DriverAddress5 other;
+    auto ratings = other.readMotorRatings(path, base::Time::fromSeconds(60));
+    std::remove(path.c_str());
+    ASSERT_EQ(1024, ratings.encoder_count);
+    ASSERT_FLOAT_EQ(1, ratings.current);
+    ASSERT_FLOAT_EQ(500.0 * 2.0 * M_PI / 60, ratings.speed);
+    ASSERT_FLOAT_EQ(6000, ratings.power);
+    ASSERT_EQ(0, other.getStatistics().total.frames);
+}
+
+TEST_F(DriverTest, it_reads_the_motor_ratings_again_if_the_cache_is_too_old) {
+    IODRIVERS_BASE_MOCK();
+
+    std::string path = testing::TempDir() + "motors_weg_cvw300_test.motor_ratings";
+    {
+        std::ofstream out(path);
+        out << (base::Time::now() - base::Time::fromSeconds(120)).toMicroseconds()
+            << "\n401 10\n402 500\n403 0\n404 1\n405 1024\n";
+    }
+    EXPECT_MODBUS_READ(5, false, 401, { 20, 500, 0, 2, 2048 });
+    auto ratings = driver.readMotorRatings(path, base::Time::fromSeconds(60));
+    ASSERT_EQ(2048, ratings.encoder_count);
+    ASSERT_FLOAT_EQ(12000, ratings.power);
+
+    // ... and that it refreshed the cache
+    ratings = DriverAddress5().readMotorRatings(path, base::Time::fromSeconds(60));
+    std::remove(path.c_str());
+    ASSERT_EQ(2048, ratings.encoder_count);
+}
+
+TEST_F(DriverTest, it_reads_the_motor_ratings_again_if_the_cache_cannot_be_decoded) {
+    IODRIVERS_BASE_MOCK();
+
+    std::string path = testing::TempDir() + "motors_weg_cvw300_test.motor_ratings";
+    {
+        std::ofstream out(path);
+        out << base::Time::now().toMicroseconds()
+            << "\n401 10\n402 500\n403 0\n404 7\n405 1024\n"; // invalid power
+    }
+    EXPECT_MODBUS_READ(5, false, 401, { 20, 500, 0, 2, 2048 });
+    auto ratings = driver.readMotorRatings(path, base::Time::fromSeconds(60));
+    ASSERT_EQ(2048, ratings.encoder_count);
+    ASSERT_FLOAT_EQ(12000, ratings.power);
+
+    // ... and that it replaced the invalid cache
+    ratings = DriverAddress5().readMotorRatings(path, base::Time::fromSeconds(60));
+    std::remove(path.c_str());
+    ASSERT_EQ(2048, ratings.encoder_count);
+}
+
 TEST_F(DriverTest, it_prepares_the_unit_for_serial_control) {
     IODRIVERS_BASE_MOCK();
 
@@ -55,8 +123,8 @@ TEST_F(DriverTest, it_prepares_the_unit_for_serial_control) {
     EXPECT_MODBUS_WRITE(5, 226, 5); // REM Serial-FWD
     EXPECT_MODBUS_WRITE(5, 227, 2); // REM RUN-STOP serial
     EXPECT_MODBUS_WRITE(5, 228, 0); // JOG disable
-    EXPECT_MODBUS_WRITE(5, 683, 0); // zero speed command
-    EXPECT_MODBUS_WRITE(5, 682, 0x90); // configure for remote and reset fault
+    // configure for remote, reset fault and zero speed command
+    EXPECT_MODBUS_WRITE_MULTIPLE(5, 682, { 0x90, 0 });
     driver.prepare();
 }
 
@@ -70,11 +138,26 @@ TEST_F(DriverTest, it_enables_the_drive) {
 TEST_F(DriverTest, it_disables_the_drive) {
     IODRIVERS_BASE_MOCK();
 
-    EXPECT_MODBUS_WRITE(5, 683, 0); // reset reference speed
-    EXPECT_MODBUS_WRITE(5, 682, 0x10); // disable power stage
+    // disable power stage and reset reference speed
+    EXPECT_MODBUS_WRITE_MULTIPLE(5, 682, { 0x10, 0 });
     driver.disable();
 }
 
+TEST_F(DriverTest, it_enables_the_drive_and_sends_the_first_command_in_a_single_frame) {
+    IODRIVERS_BASE_MOCK();
+    MotorRatings ratings;
+    ratings.speed = 10;
+    driver.setMotorRatings(ratings);
+
+    EXPECT_MODBUS_WRITE_MULTIPLE(5, 682, { 0x17, (uint16_t)-4259 });
+    driver.enable(-5.2);
+}
+
+TEST_F(DriverTest, it_throws_if_enabling_with_a_command_without_a_rated_speed) {
+    IODRIVERS_BASE_MOCK(); // to make sure no message is sent
+    ASSERT_THROW(driver.enable(5.2), std::invalid_argument);
+}
+
 TEST_F(DriverTest, it_configures_the_serial_watchdog) {
     IODRIVERS_BASE_MOCK();
 
@@ -302,6 +385,45 @@ TEST_F(DriverTest, it_optionally_uses_the_encoder_for_position_and_speed_feedbac
     ASSERT_EQ(STATUS_AUTOTUNING, state.inverter_status);
 }
 
+TEST_F(DriverTest, it_stamps_the_current_state_with_the_read_timing_and_a_sequence) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(8, 0));
+    EXPECT_MODBUS_READ(5, false, 37, { 0 });
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(8, 0));
+    EXPECT_MODBUS_READ(5, false, 37, { 0 });
+
+    auto before = base::Time::now();
+    CurrentState first = driver.readCurrentState();
+    CurrentState second = driver.readCurrentState();
+    auto after = base::Time::now();
+
+    ASSERT_LE(before, first.request_time);
+    ASSERT_LE(first.request_time, first.time);
+    ASSERT_LE(first.time, first.reply_time);
+    ASSERT_LE(first.reply_time, second.request_time);
+    ASSERT_LE(second.reply_time, after);
+    ASSERT_EQ(first.sequence + 1, second.sequence);
+}
+
+TEST_F(DriverTest, it_does_not_read_the_excluded_registers) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+    driver.excludeRegisters(8);
+
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(6, 0));
+    EXPECT_MODBUS_READ(5, false, 9, { 0 });
+    EXPECT_MODBUS_READ(5, false, 37, { 0 });
+    driver.readCurrentState();
+}
+
 TEST_F(DriverTest, it_does_not_report_position_if_the_encoder_scale_is_zero) {
     IODRIVERS_BASE_MOCK();
 
@@ -382,6 +504,31 @@ TEST_F(DriverTest, it_normalizes_the_position) {
     ASSERT_FLOAT_EQ(-M_PI / 2, state.motor.position);
 }
 
+TEST_F(DriverTest, it_tracks_the_encoder_position_across_counter_overflows) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.current = 100;
+    ratings.torque = 42;
+    ratings.encoder_scale = 1;
+    ratings.encoder_count = 1000;
+    driver.setMotorRatings(ratings);
+    driver.setUseEncoderFeedback(true);
+
+    EXPECT_MODBUS_READ(5, false, 2, { 0, 0, 0, 0, 0, 0, 0, 0 });
+    EXPECT_MODBUS_READ(5, false, 37, { 0, 25, 65500 });
+    EXPECT_MODBUS_READ(5, false, 2, { 0, 0, 0, 0, 0, 0, 0, 0 });
+    EXPECT_MODBUS_READ(5, false, 37, { 0, 25, 500 });
+
+    CurrentState first = driver.readCurrentState();
+    ASSERT_TRUE(base::isUnknown(first.encoder_velocity));
+    CurrentState second = driver.readCurrentState();
+    ASSERT_EQ(66036, second.encoder_ticks);
+    ASSERT_FLOAT_EQ(66.036 * 2 * M_PI, second.encoder_position);
+    ASSERT_FLOAT_EQ(0.036 * 2 * M_PI, second.motor.position);
+    ASSERT_GT(second.encoder_velocity, 0);
+}
+
 
 TEST_F(DriverTest, it_determines_the_motor_direction_with_torque_positive_and_current_positive) {
     IODRIVERS_BASE_MOCK();
@@ -447,8 +594,7 @@ TEST_F(DriverTest, it_reads_the_temperatures) {
     ratings.torque = 42;
     driver.setMotorRatings(ratings);
 
-    EXPECT_MODBUS_READ(5, false, 30, { 1 });
-    EXPECT_MODBUS_READ(5, false, 34, { (uint16_t)-5 });
+    EXPECT_MODBUS_READ(5, false, 30, { 1, 0, 0, 0, (uint16_t)-5 });
 
     InverterTemperatures temps = driver.readTemperatures();
     ASSERT_FLOAT_EQ(0.1, temps.mosfet.getCelsius());
@@ -469,13 +615,17 @@ TEST_F(DriverTest, it_reads_the_fault_state) {
     ratings.torque = 42;
     driver.setMotorRatings(ratings);
 
-    EXPECT_MODBUS_READ(5, false, 49, { 2 });
-    EXPECT_MODBUS_READ(5, false, 50, { 3 });
-    EXPECT_MODBUS_READ(5, false, 54, { 4 });
-    EXPECT_MODBUS_READ(5, false, 58, { 5 });
-    EXPECT_MODBUS_READ(5, false, 62, { 6 });
-    EXPECT_MODBUS_READ(5, false, 66, { 7 });
-    EXPECT_MODBUS_READ(5, false, 90, { 11, 12, 13, 14, 15, 16 });
+    std::vector<uint16_t> values(95 - 49 + 1, 0);
+    values[49 - 49] = 2;
+    values[50 - 49] = 3;
+    values[54 - 49] = 4;
+    values[58 - 49] = 5;
+    values[62 - 49] = 6;
+    values[66 - 49] = 7;
+    for (int i = 0; i < 6; ++i) {
+        values[90 - 49 + i] = 11 + i;
+    }
+    EXPECT_MODBUS_READ(5, false, 49, values);
 
     FaultState state = driver.readFaultState();
     ASSERT_EQ(2, state.current_fault);
@@ -491,3 +641,665 @@ TEST_F(DriverTest, it_reads_the_fault_state) {
     ASSERT_FLOAT_EQ(1.5, state.inverter_output_frequency);
     ASSERT_FLOAT_EQ(1.6, state.inverter_output_voltage);
 }
+
+TEST_F(DriverTest, it_reads_the_current_state_in_a_single_frame_at_higher_baud_rates) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.current = 100;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+    driver.setBaudRate(57600);
+
+    std::vector<uint16_t> values(37 - 2 + 1, 0);
+    values[0] = 15; // speed 0002
+    values[1] = (uint16_t)-12; // current 0003
+    values[7] = 243; // torque 0009
+    values[37 - 2] = 23; // motor overload ratio 0037
+    EXPECT_MODBUS_READ(5, false, 2, values);
+
+    CurrentState state = driver.readCurrentState();
+    ASSERT_FLOAT_EQ(-15 * 2 * M_PI / 60, state.motor.speed);
+    ASSERT_FLOAT_EQ(0.23, state.motor_overload_ratio);
+}
+
+TEST_F(DriverTest, it_reads_a_full_snapshot_in_a_single_frame) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.current = 100;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+
+    std::vector<uint16_t> values(48 - 2 + 1, 0);
+    values[0] = 15; // speed 0002
+    values[1] = 12; // current 0003
+    values[4] = 4; // inverter status 0006
+    values[7] = 243; // torque 0009
+    values[30 - 2] = 1; // mosfet temperature 0030
+    values[34 - 2] = (uint16_t)-5; // air temperature 0034
+    values[37 - 2] = 23; // motor overload ratio 0037
+    values[48 - 2] = 3; // current alarm 0048
+    EXPECT_MODBUS_READ(5, false, 2, values);
+
+    StateSnapshot snapshot = driver.readSnapshot();
+    ASSERT_FLOAT_EQ(15 * 2 * M_PI / 60, snapshot.state.motor.speed);
+    ASSERT_FLOAT_EQ(0.23, snapshot.state.motor_overload_ratio);
+    ASSERT_EQ(STATUS_AUTOTUNING, snapshot.state.inverter_status);
+    ASSERT_FLOAT_EQ(0.1, snapshot.temperatures.mosfet.getCelsius());
+    ASSERT_FLOAT_EQ(-0.5, snapshot.temperatures.air.getCelsius());
+    ASSERT_EQ(3, snapshot.alarm);
+}
+
+struct BusBudgetTest : public DriverTest {
+    BusBudgetTest() {
+        MotorRatings ratings;
+        ratings.current = 100;
+        ratings.torque = 42;
+        ratings.speed = 10;
+        ratings.encoder_scale = 1;
+        ratings.encoder_count = 1024;
+        driver.setMotorRatings(ratings);
+    }
+};
+
+TEST_F(BusBudgetTest, it_reads_the_current_state_with_the_encoder_in_two_frames) {
+    IODRIVERS_BASE_MOCK();
+    driver.setUseEncoderFeedback(true);
+
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(8, 0));
+    EXPECT_MODBUS_READ(5, false, 37, { 0, 0, 0 });
+    EXPECT_BUS_BUDGET(2, 48, [&] { driver.readCurrentState(); });
+}
+
+TEST_F(BusBudgetTest, it_reads_the_current_state_in_one_frame_at_57600_bauds) {
+    IODRIVERS_BASE_MOCK();
+    driver.setUseEncoderFeedback(true);
+    driver.setBaudRate(57600);
+
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(39 - 2 + 1, 0));
+    EXPECT_BUS_BUDGET(1, 89, [&] { driver.readCurrentState(); });
+}
+
+TEST_F(BusBudgetTest, it_reads_the_speed_profile_in_one_frame) {
+    IODRIVERS_BASE_MOCK();
+    driver.setTelemetryProfile(TELEMETRY_PROFILE_SPEED);
+
+    EXPECT_MODBUS_READ(5, false, 2, { 60, (uint16_t)-12, 0, 0, 0, 0, 0, 243 });
+    CurrentState state;
+    EXPECT_BUS_BUDGET(1, 29, [&] { state = driver.readCurrentState(); });
+    ASSERT_FLOAT_EQ(-60 * 2 * M_PI / 60, state.motor.speed);
+    ASSERT_TRUE(base::isUnknown(state.motor.raw));
+    ASSERT_TRUE(base::isUnknown(state.motor.effort));
+    ASSERT_TRUE(base::isUnknown(state.battery_voltage));
+    ASSERT_TRUE(base::isUnknown(state.motor_overload_ratio));
+    ASSERT_EQ(STATUS_UNKNOWN, state.inverter_status);
+}
+
+TEST_F(BusBudgetTest, it_reads_the_speed_profile_with_the_encoder_in_two_frames) {
+    IODRIVERS_BASE_MOCK();
+    driver.setUseEncoderFeedback(true);
+    driver.setTelemetryProfile(TELEMETRY_PROFILE_SPEED);
+
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(8, 0));
+    EXPECT_MODBUS_READ(5, false, 38, { 0, 0 });
+    EXPECT_BUS_BUDGET(2, 46, [&] { driver.readCurrentState(); });
+}
+
+TEST_F(BusBudgetTest, it_reads_only_the_registers_of_the_profile) {
+    IODRIVERS_BASE_MOCK();
+    driver.setTelemetryProfile(TELEMETRY_STATUS | TELEMETRY_OVERLOAD);
+
+    EXPECT_MODBUS_READ(5, false, 6, { 1 });
+    EXPECT_MODBUS_READ(5, false, 37, { 50 });
+    CurrentState state;
+    EXPECT_BUS_BUDGET(2, 30, [&] { state = driver.readCurrentState(); });
+    ASSERT_EQ(STATUS_RUN, state.inverter_status);
+    ASSERT_FLOAT_EQ(0.5, state.motor_overload_ratio);
+    ASSERT_TRUE(base::isUnknown(state.motor.speed));
+}
+
+TEST_F(BusBudgetTest, it_reads_the_fault_codes_without_an_additional_frame) {
+    IODRIVERS_BASE_MOCK();
+    driver.setTelemetryProfile(TELEMETRY_PROFILE_FULL | TELEMETRY_FAULT);
+
+    std::vector<uint16_t> values(49 - 37 + 1, 0);
+    values[48 - 37] = 2;
+    values[49 - 37] = 12;
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(8, 0));
+    EXPECT_MODBUS_READ(5, false, 37, values);
+    CurrentState state;
+    EXPECT_BUS_BUDGET(2, 70, [&] { state = driver.readCurrentState(); });
+    ASSERT_EQ(2, state.current_alarm);
+    ASSERT_EQ(12, state.current_fault);
+}
+
+TEST_F(DriverTest, it_rejects_an_empty_telemetry_profile) {
+    ASSERT_THROW(driver.setTelemetryProfile(0), std::invalid_argument);
+    ASSERT_EQ(TELEMETRY_PROFILE_FULL, driver.getTelemetryProfile());
+}
+
+TEST_F(BusBudgetTest, it_reads_the_fault_state_in_one_frame) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_READ(5, false, 49, std::vector<uint16_t>(95 - 49 + 1, 0));
+    EXPECT_BUS_BUDGET(1, 107, [&] { driver.readFaultState(); });
+}
+
+TEST_F(BusBudgetTest, it_reads_the_snapshot_in_one_frame) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(48 - 2 + 1, 0));
+    EXPECT_BUS_BUDGET(1, 107, [&] { driver.readSnapshot(); });
+}
+
+TEST_F(BusBudgetTest, it_enables_the_drive_with_a_command_in_one_frame) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_WRITE_MULTIPLE(5, 682, { 0x17, 4259 });
+    EXPECT_BUS_BUDGET(1, 21, [&] { driver.enable(5.2); });
+}
+
+TEST_F(BusBudgetTest, it_writes_a_speed_command_in_one_frame) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_WRITE(5, 683, 4259);
+    EXPECT_BUS_BUDGET(1, 16, [&] { driver.writeSpeedCommand(5.2); });
+}
+
+TEST_F(DriverTest, it_collects_the_statistics_per_operation_and_block) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(8, 0));
+    EXPECT_MODBUS_READ(5, false, 37, { 0 });
+    driver.readCurrentState();
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 48, 1, 2);
+    ASSERT_THROW(driver.readCurrentAlarm(), modbus::RequestException);
+
+    auto statistics = driver.getStatistics();
+    ASSERT_EQ(3, statistics.total.frames);
+    ASSERT_EQ(1, statistics.total.exceptions);
+    ASSERT_EQ(2, statistics.operations.size());
+
+    auto const& state = statistics.operations[0];
+    ASSERT_EQ(OPERATION_READ_CURRENT_STATE, state.operation);
+    ASSERT_EQ(1, state.calls);
+    ASSERT_EQ(0, state.failures);
+    ASSERT_EQ(2, state.transactions.frames);
+    ASSERT_EQ(2, state.transactions.latency.getCount());
+
+    auto const& alarm = statistics.operations[1];
+    ASSERT_EQ(OPERATION_READ_CURRENT_ALARM, alarm.operation);
+    ASSERT_EQ(1, alarm.failures);
+    ASSERT_EQ(1, alarm.transactions.exceptions);
+
+    ASSERT_EQ(3, statistics.blocks.size());
+    ASSERT_EQ(2, statistics.blocks[0].start);
+    ASSERT_EQ(8, statistics.blocks[0].length);
+    ASSERT_EQ(37, statistics.blocks[1].start);
+    ASSERT_EQ(48, statistics.blocks[2].start);
+    ASSERT_EQ(1, statistics.blocks[2].transactions.exceptions);
+}
+
+TEST_F(DriverTest, it_attributes_nested_calls_to_the_outer_operation) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_WRITE(5, 682, 0x90);
+    EXPECT_MODBUS_WRITE(5, 682, 0x10);
+    driver.resetFault();
+
+    auto statistics = driver.getStatistics();
+    ASSERT_EQ(1, statistics.operations.size());
+    ASSERT_EQ(OPERATION_RESET_FAULT, statistics.operations[0].operation);
+    ASSERT_EQ(1, statistics.operations[0].calls);
+    ASSERT_EQ(2, statistics.operations[0].transactions.frames);
+}
+
+TEST_F(DriverTest, it_counts_the_crc_errors_of_the_configuration_save) {
+    IODRIVERS_BASE_MOCK();
+
+    uint8_t frame[256];
+    uint8_t* end = modbus::RTU::formatWriteRegister(frame, 5, 303, 1); // config save
+    std::vector<uint8_t> request(frame, end);
+    std::vector<uint8_t> invalid_reply(request);
+    invalid_reply.back() ^= 0xFF;
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_REPLY(request, invalid_reply);
+    }
+    driver.configSave();
+
+    auto statistics = driver.getStatistics();
+    ASSERT_EQ(3, statistics.total.frames);
+    ASSERT_EQ(3, statistics.total.crc_errors);
+    ASSERT_EQ(2, statistics.total.retries);
+    ASSERT_EQ(OPERATION_CONFIG_SAVE, statistics.operations[0].operation);
+    ASSERT_EQ(0, statistics.operations[0].failures);
+}
+
+TEST_F(DriverTest, it_replays_a_captured_trace) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.current = 100;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+
+    std::string path = testing::TempDir() + "motors_weg_cvw300_replay.trace";
+    std::remove(path.c_str());
+    CurrentState captured;
+    {
+        trace::Writer writer(path);
+        driver.addListener(&writer);
+        EXPECT_MODBUS_READ(5, false, 2,
+                           { 15, (uint16_t)-12, 421, 502, 4, 128, 0, 243 });
+        EXPECT_MODBUS_READ(5, false, 37, { 23 });
+        captured = driver.readCurrentState();
+        driver.removeListener(&writer);
+    }
+
+    auto transactions = trace::toTransactions(trace::read(path));
+    std::remove(path.c_str());
+    ASSERT_EQ(2, transactions.size());
+    EXPECT_TRACE(transactions);
+    CurrentState replayed = driver.readCurrentState();
+    ASSERT_FLOAT_EQ(captured.motor.speed, replayed.motor.speed);
+    ASSERT_FLOAT_EQ(captured.motor.effort, replayed.motor.effort);
+    ASSERT_FLOAT_EQ(captured.motor_overload_ratio, replayed.motor_overload_ratio);
+}
+
+struct CalibrationTest : public DriverTest {
+    InterframeDelayCalibrationSettings settings;
+
+    CalibrationTest() {
+        settings.start = base::Time::fromMilliseconds(3);
+        settings.step = base::Time::fromMilliseconds(1);
+        settings.min = base::Time::fromMilliseconds(1);
+        settings.transactions_per_step = 2;
+        settings.margin = base::Time::fromMilliseconds(2);
+    }
+};
+
+TEST_F(CalibrationTest, it_goes_down_to_the_minimum_delay_if_there_are_no_errors) {
+    IODRIVERS_BASE_MOCK();
+    for (int i = 0; i < 6; ++i) {
+        EXPECT_MODBUS_READ(5, false, 48, { 0 });
+    }
+
+    auto result = driver.calibrateInterframeDelay(settings);
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(3, result.steps.size());
+    ASSERT_EQ(base::Time::fromMilliseconds(1), result.smallest_safe);
+    ASSERT_EQ(base::Time::fromMilliseconds(3), result.recommended);
+    ASSERT_EQ(base::Time::fromMilliseconds(3),
+              driver.getBusCostModel().interframe_delay);
+}
+
+TEST_F(CalibrationTest, it_stops_at_the_first_step_with_errors) {
+    IODRIVERS_BASE_MOCK();
+    EXPECT_MODBUS_READ(5, false, 48, { 0 });
+    EXPECT_MODBUS_READ(5, false, 48, { 0 });
+    EXPECT_MODBUS_READ(5, false, 48, { 0 });
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 48, 1, 4);
+
+    auto result = driver.calibrateInterframeDelay(settings);
+    ASSERT_EQ(2, result.steps.size());
+    ASSERT_EQ(1, result.steps[1].errors);
+    ASSERT_FLOAT_EQ(0.5, result.steps[1].getErrorRate());
+    ASSERT_EQ(base::Time::fromMilliseconds(3), result.smallest_safe);
+    ASSERT_EQ(base::Time::fromMilliseconds(5), result.recommended);
+}
+
+TEST_F(CalibrationTest, it_keeps_the_previous_delay_if_no_safe_delay_was_found) {
+    IODRIVERS_BASE_MOCK();
+    driver.setInterframeDelay(base::Time::fromMilliseconds(10));
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 48, 1, 4);
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 48, 1, 4);
+
+    auto result = driver.calibrateInterframeDelay(settings);
+    ASSERT_FALSE(result.success);
+    ASSERT_EQ(1, result.steps.size());
+    ASSERT_TRUE(result.smallest_safe.isNull());
+    ASSERT_TRUE(result.recommended.isNull());
+    ASSERT_EQ(base::Time::fromMilliseconds(10),
+              driver.getBusCostModel().interframe_delay);
+}
+
+TEST_F(DriverTest, it_polls_the_state_in_the_background) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.current = 100;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+
+    std::vector<uint16_t> values(48 - 2 + 1, 0);
+    values[0] = 15; // speed 0002
+    values[30 - 2] = 1; // mosfet temperature 0030
+    values[48 - 2] = 3; // current alarm 0048
+    EXPECT_MODBUS_READ(5, false, 2, values);
+
+    PollingSettings settings;
+    settings.state_period = base::Time::fromSeconds(3600);
+    settings.temperatures_period = base::Time::fromSeconds(3600);
+    settings.alarm_period = base::Time::fromSeconds(3600);
+    driver.startPolling(settings);
+
+    PolledState polled = driver.waitPolledState(0, base::Time::fromSeconds(10));
+    driver.stopPolling();
+
+    ASSERT_EQ(1, polled.sequence);
+    ASSERT_EQ(0, polled.errors);
+    ASSERT_FLOAT_EQ(15 * 2 * M_PI / 60, polled.state.motor.speed);
+    ASSERT_FLOAT_EQ(0.1, polled.temperatures.mosfet.getCelsius());
+    ASSERT_EQ(3, polled.alarm);
+    ASSERT_FALSE(polled.state_time.isNull());
+    ASSERT_FALSE(driver.isPolling());
+}
+
+TEST_F(DriverTest, it_polls_the_fault_state_along_with_the_state) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+
+    std::vector<uint16_t> values(95 - 2 + 1, 0);
+    values[49 - 2] = 12; // current fault 0049
+    values[50 - 2] = 7; // last fault 0050
+    EXPECT_MODBUS_READ(5, false, 2, values);
+
+    PollingSettings settings;
+    settings.state_period = base::Time::fromSeconds(3600);
+    settings.temperatures_period = base::Time::fromSeconds(3600);
+    settings.alarm_period = base::Time::fromSeconds(3600);
+    settings.fault_state_period = base::Time::fromSeconds(3600);
+    driver.startPolling(settings);
+
+    PolledState polled = driver.waitPolledState(0, base::Time::fromSeconds(10));
+    driver.stopPolling();
+
+    ASSERT_EQ(0, polled.errors);
+    ASSERT_EQ(12, polled.fault_state.current_fault);
+    ASSERT_EQ(7, polled.fault_state.fault_history[0]);
+    ASSERT_TRUE(polled.isFresh(POLL_GROUP_FAULT_STATE, base::Time::fromSeconds(1)));
+    ASSERT_FALSE(polled.isFresh(POLL_GROUP_RATINGS, base::Time::fromSeconds(1)));
+}
+
+TEST_F(DriverTest, it_defers_the_groups_that_would_delay_the_next_state_read) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+    // Make the frames look very long, so that the fault state does not fit
+    // in the state period, while the state, temperatures and alarm do
+    driver.setBaudRate(1);
+
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(8, 0));
+    EXPECT_MODBUS_READ(5, false, 30, std::vector<uint16_t>(8, 0));
+    EXPECT_MODBUS_READ(5, false, 48, { 0 });
+
+    PollingSettings settings;
+    settings.state_period = base::Time::fromSeconds(1000);
+    settings.temperatures_period = base::Time::fromSeconds(3600);
+    settings.alarm_period = base::Time::fromSeconds(3600);
+    settings.fault_state_period = base::Time::fromSeconds(3600);
+    driver.startPolling(settings);
+
+    PolledState polled = driver.waitPolledState(0, base::Time::fromSeconds(10));
+    driver.stopPolling();
+
+    ASSERT_EQ(0, polled.errors);
+    ASSERT_EQ(1, polled.deferrals[POLL_GROUP_FAULT_STATE]);
+    ASSERT_EQ(0, polled.deferrals[POLL_GROUP_TEMPERATURES]);
+    ASSERT_FALSE(polled.temperatures_time.isNull());
+    ASSERT_TRUE(polled.fault_state_time.isNull());
+}
+
+TEST_F(DriverTest, it_does_not_consider_a_group_with_a_null_period_as_starved) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+    // Make the frames look very long, so that only the state fits in the
+    // state period
+    driver.setBaudRate(1);
+
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(8, 0));
+    EXPECT_MODBUS_READ(5, false, 37, { 0 });
+
+    PollingSettings settings;
+    settings.state_period = base::Time::fromSeconds(500);
+    settings.temperatures_period = base::Time();
+    settings.alarm_period = base::Time::fromSeconds(3600);
+    driver.startPolling(settings);
+
+    PolledState polled = driver.waitPolledState(0, base::Time::fromSeconds(10));
+    driver.stopPolling();
+
+    ASSERT_EQ(0, polled.errors);
+    ASSERT_EQ(1, polled.deferrals[POLL_GROUP_TEMPERATURES]);
+    ASSERT_TRUE(polled.temperatures_time.isNull());
+}
+
+TEST_F(DriverTest, it_retries_a_group_whose_read_failed_on_the_next_cycle) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+    // Make the registers free, so that all groups are read in one frame
+    driver.setBaudRate(1000000000);
+
+    std::vector<uint16_t> values(95 - 2 + 1, 0);
+    values[49 - 2] = 12; // current fault 0049
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 2, 94, 4);
+    EXPECT_MODBUS_READ(5, false, 2, values);
+
+    PollingSettings settings;
+    settings.state_period = base::Time::fromMilliseconds(500);
+    settings.temperatures_period = base::Time::fromSeconds(3600);
+    settings.alarm_period = base::Time::fromSeconds(3600);
+    settings.fault_state_period = base::Time::fromSeconds(3600);
+    driver.startPolling(settings);
+
+    // The first cycle fails, the second one reads the fault state
+    PolledState polled = driver.waitPolledState(1, base::Time::fromSeconds(10));
+    driver.stopPolling();
+
+    ASSERT_EQ(1, polled.errors);
+    ASSERT_EQ(12, polled.fault_state.current_fault);
+    ASSERT_FALSE(polled.fault_state_time.isNull());
+}
+
+TEST_F(DriverTest, it_counts_the_polled_data_it_cannot_decode_as_errors) {
+    IODRIVERS_BASE_MOCK();
+
+    MotorRatings ratings;
+    ratings.torque = 42;
+    driver.setMotorRatings(ratings);
+
+    std::vector<uint16_t> values(48 - 2 + 1, 0);
+    values[0] = 15; // speed 0002
+    EXPECT_MODBUS_READ(5, false, 2, values);
+    EXPECT_MODBUS_READ(5, false, 401, { 10, 1800, 0, 7, 1024 }); // invalid power
+
+    PollingSettings settings;
+    settings.state_period = base::Time::fromSeconds(3600);
+    settings.temperatures_period = base::Time::fromSeconds(3600);
+    settings.alarm_period = base::Time::fromSeconds(3600);
+    settings.ratings_period = base::Time::fromSeconds(3600);
+    driver.startPolling(settings);
+
+    PolledState polled = driver.waitPolledState(0, base::Time::fromSeconds(10));
+    driver.stopPolling();
+
+    ASSERT_EQ(1, polled.errors);
+    ASSERT_TRUE(polled.ratings_time.isNull());
+    ASSERT_FLOAT_EQ(15 * 2 * M_PI / 60, polled.state.motor.speed);
+}
+
+TEST_F(DriverTest, it_refuses_configuration_changes_while_polling) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_READ(5, false, 2, std::vector<uint16_t>(48 - 2 + 1, 0));
+    PollingSettings settings;
+    settings.state_period = base::Time::fromSeconds(3600);
+    settings.temperatures_period = base::Time::fromSeconds(3600);
+    settings.alarm_period = base::Time::fromSeconds(3600);
+    driver.startPolling(settings);
+
+    ASSERT_THROW(driver.setMotorRatings(MotorRatings()), std::logic_error);
+    ASSERT_THROW(driver.setUseEncoderFeedback(true), std::logic_error);
+    ASSERT_THROW(driver.setTelemetryProfile(TELEMETRY_PROFILE_FULL), std::logic_error);
+    ASSERT_THROW(driver.setBaudRate(9600), std::logic_error);
+    driver.stopPolling();
+
+    driver.setMotorRatings(MotorRatings());
+}
+
+struct SpeedCommandSuppressionTest : public DriverTest {
+    SpeedCommandSuppressionTest() {
+        MotorRatings ratings;
+        ratings.speed = 10;
+        driver.setMotorRatings(ratings);
+    }
+
+    void writeWatchdog(base::Time const& time) {
+        EXPECT_MODBUS_WRITE(5, 313, 1);
+        EXPECT_MODBUS_WRITE(5, 314, time.toSeconds() * 10);
+        driver.writeSerialWatchdog(time, configuration::STOP_WITH_RAMP);
+    }
+};
+
+TEST_F(SpeedCommandSuppressionTest, it_sends_all_commands_if_suppression_is_disabled) {
+    IODRIVERS_BASE_MOCK();
+    writeWatchdog(base::Time::fromSeconds(1));
+
+    EXPECT_MODBUS_WRITE(5, 683, 4259);
+    EXPECT_MODBUS_WRITE(5, 683, 4259);
+    ASSERT_TRUE(driver.writeSpeedCommand(5.2));
+    ASSERT_TRUE(driver.writeSpeedCommand(5.2));
+}
+
+TEST_F(SpeedCommandSuppressionTest, it_sends_all_commands_if_the_watchdog_is_unknown) {
+    IODRIVERS_BASE_MOCK();
+    driver.setSpeedCommandSuppression(true);
+
+    EXPECT_MODBUS_WRITE(5, 683, 4259);
+    EXPECT_MODBUS_WRITE(5, 683, 4259);
+    ASSERT_TRUE(driver.writeSpeedCommand(5.2));
+    ASSERT_TRUE(driver.writeSpeedCommand(5.2));
+}
+
+TEST_F(SpeedCommandSuppressionTest, it_skips_repeated_commands) {
+    IODRIVERS_BASE_MOCK();
+    writeWatchdog(base::Time::fromSeconds(1));
+    driver.setSpeedCommandSuppression(true);
+
+    EXPECT_MODBUS_WRITE(5, 683, 4259);
+    EXPECT_MODBUS_WRITE(5, 683, -4259);
+    ASSERT_TRUE(driver.writeSpeedCommand(5.2));
+    ASSERT_FALSE(driver.writeSpeedCommand(5.2));
+    ASSERT_TRUE(driver.writeSpeedCommand(-5.2));
+    ASSERT_EQ(1, driver.getSuppressedSpeedCommandCount());
+}
+
+TEST_F(SpeedCommandSuppressionTest, it_resends_the_command_to_keep_the_watchdog_alive) {
+    IODRIVERS_BASE_MOCK();
+    writeWatchdog(base::Time::fromSeconds(1));
+    // A margin equal to the watchdog period requires a write on every call
+    driver.setSpeedCommandSuppression(true, base::Time::fromSeconds(1));
+
+    EXPECT_MODBUS_WRITE(5, 683, 4259);
+    EXPECT_MODBUS_WRITE(5, 683, 4259);
+    ASSERT_TRUE(driver.writeSpeedCommand(5.2));
+    ASSERT_TRUE(driver.writeSpeedCommand(5.2));
+}
+
+TEST_F(SpeedCommandSuppressionTest, it_takes_into_account_the_reference_written_by_disable) {
+    IODRIVERS_BASE_MOCK();
+    writeWatchdog(base::Time::fromSeconds(1));
+    driver.setSpeedCommandSuppression(true);
+
+    EXPECT_MODBUS_WRITE_MULTIPLE(5, 682, { 0x10, 0 });
+    driver.disable();
+    ASSERT_FALSE(driver.writeSpeedCommand(0));
+}
+
+struct ShadowRegistersTest : public DriverTest {
+    void readConfiguration() {
+        EXPECT_MODBUS_READ(5, false, 100, { 1, 5, 0, 0, 1 });
+        EXPECT_MODBUS_READ(5, false, 134, { 47 });
+        EXPECT_MODBUS_READ(5, false, 169, { 520, 520 });
+        std::vector<uint16_t> values(228 - 202 + 1, 0);
+        values[0] = 2; // control type 202
+        values[222 - 202] = 5; // reference selection
+        values[226 - 202] = 5; // direction selection
+        values[227 - 202] = 2; // run/stop selection
+        EXPECT_MODBUS_READ(5, false, 202, values);
+        EXPECT_MODBUS_READ(5, false, 313, { 1, 50 });
+        driver.readConfigurationRegisters();
+    }
+};
+
+TEST_F(ShadowRegistersTest, it_skips_writes_of_registers_that_already_have_the_value) {
+    IODRIVERS_BASE_MOCK();
+    readConfiguration();
+
+    configuration::Ramps ramps;
+    ramps.acceleration_time = base::Time::fromMilliseconds(1200);
+    ramps.deceleration_time = base::Time::fromMilliseconds(5100);
+    ramps.type = configuration::RAMP_S_CURVE;
+    driver.writeRampConfiguration(ramps);
+    driver.writeControlType(configuration::CONTROL_ENCODER);
+    driver.writeSerialWatchdog(base::Time::fromSeconds(5));
+    ASSERT_EQ(6, driver.getSkippedConfigurationWriteCount());
+}
+
+TEST_F(ShadowRegistersTest, it_writes_only_the_registers_that_differ) {
+    IODRIVERS_BASE_MOCK();
+    readConfiguration();
+
+    configuration::Ramps ramps;
+    ramps.acceleration_time = base::Time::fromMilliseconds(2000);
+    ramps.deceleration_time = base::Time::fromMilliseconds(5100);
+    ramps.type = configuration::RAMP_S_CURVE;
+    EXPECT_MODBUS_WRITE(5, 100, 2);
+    driver.writeRampConfiguration(ramps);
+    ASSERT_EQ(2, driver.getSkippedConfigurationWriteCount());
+}
+
+TEST_F(ShadowRegistersTest, it_updates_the_shadow_registers_on_write) {
+    IODRIVERS_BASE_MOCK();
+    readConfiguration();
+
+    EXPECT_MODBUS_WRITE(5, 202, 1);
+    driver.writeControlType(configuration::CONTROL_SENSORLESS);
+    driver.writeControlType(configuration::CONTROL_SENSORLESS);
+    ASSERT_EQ(1, driver.getSkippedConfigurationWriteCount());
+}
+
+TEST_F(ShadowRegistersTest, it_only_writes_the_status_word_and_reference_on_prepare) {
+    IODRIVERS_BASE_MOCK();
+    readConfiguration();
+
+    EXPECT_MODBUS_WRITE_MULTIPLE(5, 682, { 0x90, 0 });
+    driver.prepare();
+    ASSERT_EQ(4, driver.getSkippedConfigurationWriteCount());
+}
+
+TEST_F(ShadowRegistersTest, it_always_writes_once_the_shadow_registers_are_cleared) {
+    IODRIVERS_BASE_MOCK();
+    readConfiguration();
+    driver.clearConfigurationRegisters();
+
+    EXPECT_MODBUS_WRITE(5, 202, 2);
+    driver.writeControlType(configuration::CONTROL_ENCODER);
+    ASSERT_EQ(0, driver.getSkippedConfigurationWriteCount());
+}
@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include <motors_weg_cvw300/EncoderTracker.hpp>
+
+using namespace motors_weg_cvw300;
+using base::Time;
+
+TEST(EncoderTrackerTest, it_starts_the_tick_count_at_the_first_counter_value) {
+    EncoderTracker tracker;
+    tracker.update(1000, Time::fromSeconds(1));
+    ASSERT_TRUE(tracker.isInitialized());
+    ASSERT_EQ(1000, tracker.getTicks());
+    ASSERT_FALSE(tracker.hasVelocity());
+}
+
+TEST(EncoderTrackerTest, it_unwraps_a_forward_counter_overflow) {
+    EncoderTracker tracker;
+    tracker.update(65500, Time::fromSeconds(1));
+    tracker.update(100, Time::fromSeconds(1.1));
+    ASSERT_EQ(65636, tracker.getTicks());
+    ASSERT_NEAR(1360, tracker.getVelocity(), 1e-6);
+}
+
+TEST(EncoderTrackerTest, it_unwraps_a_backward_counter_underflow) {
+    EncoderTracker tracker;
+    tracker.update(100, Time::fromSeconds(1));
+    tracker.update(65500, Time::fromSeconds(1.5));
+    ASSERT_EQ(-36, tracker.getTicks());
+    ASSERT_NEAR(-272, tracker.getVelocity(), 1e-6);
+}
+
+TEST(EncoderTrackerTest, it_resolves_a_single_tick_at_low_speed) {
+    EncoderTracker tracker;
+    tracker.update(10, Time::fromSeconds(1));
+    tracker.update(11, Time::fromSeconds(1.05));
+    ASSERT_NEAR(20, tracker.getVelocity(), 1e-6);
+}
+
+TEST(EncoderTrackerTest, it_ignores_readings_older_than_the_last_one) {
+    EncoderTracker tracker;
+    tracker.update(10, Time::fromSeconds(2));
+    ASSERT_FALSE(tracker.update(20, Time::fromSeconds(1)));
+    ASSERT_EQ(10, tracker.getTicks());
+}
+
+TEST(EncoderTrackerTest, it_restarts_from_the_counter_value_after_a_reset) {
+    EncoderTracker tracker;
+    tracker.update(10, Time::fromSeconds(1));
+    tracker.update(20, Time::fromSeconds(2));
+    tracker.reset();
+    tracker.update(5, Time::fromSeconds(3));
+    ASSERT_EQ(5, tracker.getTicks());
+    ASSERT_FALSE(tracker.hasVelocity());
+}
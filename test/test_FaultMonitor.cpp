@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <iodrivers_base/FixtureGTest.hpp>
+#include <motors_weg_cvw300/Driver.hpp>
+#include <motors_weg_cvw300/FaultMonitor.hpp>
+#include "Helpers.hpp"
+
+using namespace motors_weg_cvw300;
+
+struct FaultMonitorDriver : public Driver {
+    FaultMonitorDriver()
+        : Driver(5) {
+    }
+};
+
+struct FaultMonitorTest : public testing::Test,
+                          public iodrivers_base::Fixture<FaultMonitorDriver>,
+                          public Helpers<FaultMonitorTest> {
+    FaultMonitor monitor;
+
+    FaultMonitorTest()
+        : Helpers<FaultMonitorTest>(*this)
+        , monitor(driver) {
+        MotorRatings ratings;
+        ratings.torque = 42;
+        driver.setMotorRatings(ratings);
+        driver.setTelemetryProfile(TELEMETRY_PROFILE_MOTION | TELEMETRY_STATUS |
+                                   TELEMETRY_FAULT);
+    }
+
+    CurrentState readState(uint16_t status, uint16_t fault) {
+        std::vector<uint16_t> values(8, 0);
+        values[6 - 2] = status;
+        EXPECT_MODBUS_READ(5, false, 2, values);
+        EXPECT_MODBUS_READ(5, false, 48, { 0, fault });
+        return driver.readCurrentState();
+    }
+
+    void EXPECT_FAULT_STATE_READ(uint16_t fault) {
+        std::vector<uint16_t> values(95 - 49 + 1, 0);
+        values[0] = fault;
+        EXPECT_MODBUS_READ(5, false, 49, values);
+    }
+};
+
+TEST_F(FaultMonitorTest, it_reads_the_fault_state_on_the_first_update) {
+    IODRIVERS_BASE_MOCK();
+
+    auto state = readState(STATUS_RUN, 0);
+    ASSERT_EQ(0, state.current_fault);
+    ASSERT_EQ(0, state.current_alarm);
+    EXPECT_FAULT_STATE_READ(0);
+    ASSERT_TRUE(monitor.update(state));
+    ASSERT_TRUE(monitor.hasFaultState());
+    ASSERT_EQ(1, monitor.getFaultStateReadCount());
+}
+
+TEST_F(FaultMonitorTest, it_does_not_read_the_fault_state_while_nothing_changes) {
+    IODRIVERS_BASE_MOCK();
+
+    auto state = readState(STATUS_RUN, 0);
+    EXPECT_FAULT_STATE_READ(0);
+    monitor.update(state);
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_FALSE(monitor.update(readState(STATUS_RUN, 0)));
+    }
+    ASSERT_EQ(1, monitor.getFaultStateReadCount());
+}
+
+TEST_F(FaultMonitorTest, it_reads_the_fault_state_when_the_fault_code_changes) {
+    IODRIVERS_BASE_MOCK();
+
+    auto state = readState(STATUS_FAULT, 0);
+    EXPECT_FAULT_STATE_READ(0);
+    monitor.update(state);
+
+    state = readState(STATUS_FAULT, 12);
+    EXPECT_FAULT_STATE_READ(12);
+    ASSERT_TRUE(monitor.update(state));
+    ASSERT_EQ(12, monitor.getFaultState().current_fault);
+}
+
+TEST_F(FaultMonitorTest, it_reads_the_fault_state_when_the_status_changes) {
+    IODRIVERS_BASE_MOCK();
+
+    auto state = readState(STATUS_RUN, 0);
+    EXPECT_FAULT_STATE_READ(0);
+    monitor.update(state);
+
+    state = readState(STATUS_FAULT, 0);
+    EXPECT_FAULT_STATE_READ(0);
+    ASSERT_TRUE(monitor.update(state));
+    ASSERT_EQ(2, monitor.getFaultStateReadCount());
+}
+
+TEST_F(FaultMonitorTest, it_retries_the_fault_state_read_after_a_failure) {
+    IODRIVERS_BASE_MOCK();
+
+    auto state = readState(STATUS_RUN, 0);
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 49, 95 - 49 + 1, 4);
+    ASSERT_THROW(monitor.update(state), modbus::RequestException);
+
+    EXPECT_FAULT_STATE_READ(0);
+    ASSERT_TRUE(monitor.update(state));
+}
+
+TEST_F(FaultMonitorTest, it_rejects_states_read_without_the_fault_codes) {
+    ASSERT_THROW(monitor.update(CurrentState()), std::invalid_argument);
+}
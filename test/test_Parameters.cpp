@@ -0,0 +1,328 @@
+#include <gtest/gtest.h>
+#include <iodrivers_base/FixtureGTest.hpp>
+#include <motors_weg_cvw300/Driver.hpp>
+#include <motors_weg_cvw300/Parameters.hpp>
+#include <sstream>
+#include "Helpers.hpp"
+
+using namespace motors_weg_cvw300;
+
+struct ParametersDriver : public Driver {
+    ParametersDriver()
+        : Driver(5) {
+    }
+};
+
+struct ParametersTest : public testing::Test,
+                        public iodrivers_base::Fixture<ParametersDriver>,
+                        public Helpers<ParametersTest> {
+    ParametersTest()
+        : Helpers<ParametersTest>(*this) {
+    }
+
+    /** Expect a write to the controller, and answer with a corrupted reply */
+    void EXPECT_MODBUS_WRITE_INVALID_CRC(int register_id, uint16_t value) {
+        uint8_t frame[256];
+        uint8_t* end = modbus::RTU::formatWriteRegister(frame, 5, register_id, value);
+        std::vector<uint8_t> request(frame, end);
+        std::vector<uint8_t> invalid_reply(request);
+        invalid_reply.back() ^= 0xFF;
+        EXPECT_REPLY(request, invalid_reply);
+    }
+};
+
+static parameters::DumpSettings dumpRange(int first, int last) {
+    parameters::DumpSettings settings;
+    settings.first = first;
+    settings.last = last;
+    return settings;
+}
+
+TEST_F(ParametersTest, it_dumps_the_parameters_in_a_single_block) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_READ(5, false, 98, { 1, 2, 3, 4 });
+    auto result = parameters::dump(driver, dumpRange(98, 101));
+
+    ASSERT_EQ(4, result.parameters.size());
+    ASSERT_EQ(98, result.parameters[0].id);
+    ASSERT_EQ(1, result.parameters[0].value);
+    ASSERT_EQ(101, result.parameters[3].id);
+    ASSERT_EQ(4, result.parameters[3].value);
+    ASSERT_TRUE(result.invalid.empty());
+}
+
+TEST_F(ParametersTest, it_accesses_the_controller_through_the_driver) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 98, 2, 2);
+    EXPECT_MODBUS_READ(5, false, 98, { 1 });
+    EXPECT_MODBUS_READ(5, false, 99, { 2 });
+    parameters::dump(driver, dumpRange(98, 99));
+
+    auto statistics = driver.getStatistics();
+    ASSERT_EQ(3, statistics.total.frames);
+    ASSERT_EQ(1, statistics.total.exceptions);
+    ASSERT_EQ(OPERATION_READ_REGISTERS, statistics.operations[0].operation);
+    ASSERT_EQ(3, statistics.operations[0].calls);
+}
+
+TEST_F(ParametersTest, it_takes_the_access_mode_from_the_register_table) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_READ(5, false, 99, { 1, 2 });
+    auto result = parameters::dump(driver, dumpRange(99, 100));
+
+    ASSERT_EQ(parameters::ACCESS_RO, result.parameters[0].access);
+    ASSERT_EQ(parameters::ACCESS_RW, result.parameters[1].access);
+    ASSERT_EQ(std::vector<int>{ 99 }, result.unclassified);
+}
+
+TEST_F(ParametersTest, it_takes_the_access_mode_of_unknown_parameters_from_the_reference) {
+    IODRIVERS_BASE_MOCK();
+
+    auto settings = dumpRange(98, 100);
+    std::istringstream in("98 0 rw\n99 0 ro\n100 0 ro\n");
+    settings.reference = parameters::parse(in);
+    EXPECT_MODBUS_READ(5, false, 98, { 1, 2, 3 });
+    auto result = parameters::dump(driver, settings);
+
+    ASSERT_EQ(parameters::ACCESS_RW, result.parameters[0].access);
+    ASSERT_EQ(parameters::ACCESS_RO, result.parameters[1].access);
+    // The register table has precedence
+    ASSERT_EQ(parameters::ACCESS_RW, result.parameters[2].access);
+    ASSERT_TRUE(result.unclassified.empty());
+}
+
+TEST_F(ParametersTest, it_probes_the_access_mode_of_unknown_parameters_only_if_asked) {
+    IODRIVERS_BASE_MOCK();
+
+    auto settings = dumpRange(98, 100);
+    settings.probe_access = true;
+    EXPECT_MODBUS_READ(5, false, 98, { 1, 2, 3 });
+    EXPECT_MODBUS_WRITE_EXCEPTION(5, 98, 1, 2);
+    EXPECT_MODBUS_WRITE(5, 99, 2);
+    auto result = parameters::dump(driver, settings);
+
+    ASSERT_EQ(parameters::ACCESS_RO, result.parameters[0].access);
+    ASSERT_EQ(parameters::ACCESS_RW, result.parameters[1].access);
+    ASSERT_EQ(parameters::ACCESS_RW, result.parameters[2].access);
+    ASSERT_TRUE(result.unclassified.empty());
+}
+
+TEST_F(ParametersTest, it_splits_the_dump_in_blocks_of_at_most_125_registers) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_READ(5, false, 100, std::vector<uint16_t>(125, 0));
+    EXPECT_MODBUS_READ(5, false, 225, { 0 });
+    auto result = parameters::dump(driver, dumpRange(100, 225));
+    ASSERT_EQ(126, result.parameters.size());
+}
+
+TEST_F(ParametersTest, it_bisects_blocks_refused_by_the_controller) {
+    IODRIVERS_BASE_MOCK();
+
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 100, 4, 2);
+    EXPECT_MODBUS_READ(5, false, 100, { 1, 2 });
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 102, 2, 2);
+    EXPECT_MODBUS_READ(5, false, 102, { 3 });
+    EXPECT_MODBUS_READ_EXCEPTION(5, false, 103, 1, 2);
+    auto result = parameters::dump(driver, dumpRange(100, 103));
+
+    ASSERT_EQ(3, result.parameters.size());
+    ASSERT_EQ(102, result.parameters[2].id);
+    ASSERT_EQ(3, result.parameters[2].value);
+    ASSERT_EQ(std::vector<int>{ 103 }, result.invalid);
+}
+
+TEST_F(ParametersTest, it_parses_a_dump_file) {
+    std::istringstream in("100 1 rw\n101 2 ro\n");
+    auto params = parameters::parse(in);
+    ASSERT_EQ(2, params.size());
+    ASSERT_EQ(100, params[0].id);
+    ASSERT_EQ(1, params[0].value);
+    ASSERT_EQ(parameters::ACCESS_RW, params[0].access);
+    ASSERT_EQ(parameters::ACCESS_RO, params[1].access);
+}
+
+TEST_F(ParametersTest, it_throws_on_an_unexpected_access_mode) {
+    std::istringstream in("100 1 rw\n101 2 wo\n");
+    ASSERT_THROW(parameters::parse(in), std::invalid_argument);
+}
+
+TEST_F(ParametersTest, it_loads_contiguous_read_write_parameters_in_a_single_frame) {
+    IODRIVERS_BASE_MOCK();
+
+    std::istringstream in("100 1 rw\n101 2 rw\n102 3 rw\n103 4 ro\n105 5 rw\n");
+    auto params = parameters::parse(in);
+
+    EXPECT_MODBUS_WRITE_MULTIPLE(5, 100, { 1, 2, 3 });
+    EXPECT_MODBUS_WRITE(5, 105, 5);
+    auto result = parameters::load(driver, params);
+    ASSERT_EQ(2, result.frames);
+    ASSERT_EQ(4, result.written.size());
+    ASSERT_TRUE(result.refused.empty());
+}
+
+TEST_F(ParametersTest, it_writes_the_parameters_one_by_one_if_a_block_is_refused) {
+    IODRIVERS_BASE_MOCK();
+
+    std::istringstream in("100 1 rw\n101 2 rw\n");
+    auto params = parameters::parse(in);
+
+    EXPECT_MODBUS_WRITE_MULTIPLE_EXCEPTION(5, 100, { 1, 2 }, 4);
+    EXPECT_MODBUS_WRITE(5, 100, 1);
+    EXPECT_MODBUS_WRITE(5, 101, 2);
+
+    auto result = parameters::load(driver, params);
+    ASSERT_EQ(3, result.frames);
+}
+
+TEST_F(ParametersTest, it_resends_a_write_that_got_no_valid_reply) {
+    IODRIVERS_BASE_MOCK();
+
+    std::istringstream in("100 1 rw\n");
+    auto params = parameters::parse(in);
+
+    EXPECT_MODBUS_WRITE_INVALID_CRC(100, 1);
+    EXPECT_MODBUS_WRITE(5, 100, 1);
+    auto result = parameters::load(driver, params);
+    ASSERT_EQ(2, result.frames);
+    ASSERT_EQ(std::vector<int>{ 100 }, result.written);
+    ASSERT_TRUE(result.failed.empty());
+}
+
+TEST_F(ParametersTest, it_reports_the_writes_that_failed_and_continues) {
+    IODRIVERS_BASE_MOCK();
+
+    std::istringstream in("100 1 rw\n102 2 rw\n");
+    auto params = parameters::parse(in);
+
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_MODBUS_WRITE_INVALID_CRC(100, 1);
+    }
+    EXPECT_MODBUS_WRITE(5, 102, 2);
+    auto result = parameters::load(driver, params);
+    ASSERT_EQ(4, result.frames);
+    ASSERT_EQ(std::vector<int>{ 100 }, result.failed);
+    ASSERT_EQ(std::vector<int>{ 102 }, result.written);
+    ASSERT_TRUE(result.refused.empty());
+}
+
+TEST_F(ParametersTest, it_does_not_load_the_command_parameters) {
+    IODRIVERS_BASE_MOCK();
+
+    std::istringstream in("302 1 rw\n303 1 rw\n682 3 rw\n683 4096 rw\n");
+    auto params = parameters::parse(in);
+
+    EXPECT_MODBUS_WRITE(5, 302, 1);
+    auto result = parameters::load(driver, params);
+    ASSERT_EQ(1, result.frames);
+}
+
+TEST_F(ParametersTest, it_does_not_probe_the_parameters_of_the_register_table) {
+    IODRIVERS_BASE_MOCK();
+
+    auto settings = dumpRange(682, 683);
+    settings.probe_access = true;
+    EXPECT_MODBUS_READ(5, false, 682, { 3, 4096 });
+    auto result = parameters::dump(driver, settings);
+    ASSERT_EQ(2, result.parameters.size());
+}
+
+TEST_F(ParametersTest, it_verifies_the_read_write_parameters_with_block_reads) {
+    IODRIVERS_BASE_MOCK();
+
+    std::istringstream in("100 1 rw\n101 2 ro\n102 3 rw\n");
+    auto params = parameters::parse(in);
+
+    EXPECT_MODBUS_READ(5, false, 100, { 1, 0, 4 });
+    auto result = parameters::verify(driver, params);
+    ASSERT_EQ(1, result.mismatches.size());
+    ASSERT_EQ(102, result.mismatches[0].id);
+    ASSERT_EQ(3, result.mismatches[0].expected);
+    ASSERT_EQ(4, result.mismatches[0].actual);
+}
+
+TEST_F(ParametersTest, it_does_not_verify_across_parameters_missing_from_the_dump) {
+    IODRIVERS_BASE_MOCK();
+
+    std::istringstream in("100 1 rw\n102 3 rw\n");
+    auto params = parameters::parse(in);
+
+    EXPECT_MODBUS_READ(5, false, 100, { 1 });
+    EXPECT_MODBUS_READ(5, false, 102, { 3 });
+    auto result = parameters::verify(driver, params);
+    ASSERT_TRUE(result.mismatches.empty());
+}
+
+TEST_F(ParametersTest, it_saves_and_loads_a_digest) {
+    std::istringstream in("100 1 rw\n101 2 ro\n102 3 rw\n");
+    auto digest = parameters::computeDigest(parameters::parse(in), 100, 102);
+
+    std::stringstream io;
+    parameters::writeDigest(io, digest);
+    auto loaded = parameters::parseDigest(io);
+    ASSERT_EQ(1, loaded.size());
+    ASSERT_EQ(100, loaded[0].start);
+    ASSERT_EQ(3, loaded[0].length);
+    ASSERT_EQ(digest[0].hash, loaded[0].hash);
+}
+
+TEST_F(ParametersTest, it_only_covers_dumped_parameters_in_the_digest_blocks) {
+    std::istringstream in("100 1 rw\n102 3 rw\n");
+    auto digest = parameters::computeDigest(parameters::parse(in), 100, 102);
+    ASSERT_EQ(2, digest.size());
+    ASSERT_EQ(100, digest[0].start);
+    ASSERT_EQ(1, digest[0].length);
+    ASSERT_EQ(102, digest[1].start);
+    ASSERT_EQ(1, digest[1].length);
+}
+
+TEST_F(ParametersTest, it_ignores_read_only_parameters_in_the_digest) {
+    std::istringstream a("98 1 ro\n100 1 rw\n");
+    std::istringstream b("98 2 ro\n100 1 rw\n");
+    auto digest_a = parameters::computeDigest(parameters::parse(a), 98, 100);
+    auto digest_b = parameters::computeDigest(parameters::parse(b), 98, 100);
+    ASSERT_EQ(digest_a[0].hash, digest_b[0].hash);
+}
+
+TEST_F(ParametersTest, it_ignores_the_command_parameters_in_the_digest) {
+    std::istringstream a("682 1 rw\n683 0 rw\n684 1 rw\n");
+    std::istringstream b("682 3 rw\n683 4096 rw\n684 1 rw\n");
+    auto digest_a = parameters::computeDigest(parameters::parse(a), 682, 684);
+    auto digest_b = parameters::computeDigest(parameters::parse(b), 682, 684);
+    ASSERT_EQ(1, digest_a.size());
+    ASSERT_EQ(684, digest_a[0].start);
+    ASSERT_EQ(digest_a[0].hash, digest_b[0].hash);
+}
+
+TEST_F(ParametersTest, it_reads_each_digest_block_once_if_the_configuration_matches) {
+    IODRIVERS_BASE_MOCK();
+
+    std::istringstream in("100 1 rw\n101 2 ro\n102 3 rw\n");
+    auto params = parameters::parse(in);
+    auto digest = parameters::computeDigest(params, 100, 102);
+
+    EXPECT_MODBUS_READ(5, false, 100, { 1, 5, 3 });
+    auto result = parameters::diff(driver, params, digest);
+    ASSERT_EQ(1, result.frames);
+    ASSERT_TRUE(result.changed_blocks.empty());
+    ASSERT_TRUE(result.mismatches.empty());
+}
+
+TEST_F(ParametersTest, it_reports_the_mismatches_of_the_blocks_that_differ) {
+    IODRIVERS_BASE_MOCK();
+
+    std::istringstream in("100 1 rw\n101 2 ro\n102 3 rw\n");
+    auto params = parameters::parse(in);
+    auto digest = parameters::computeDigest(params, 100, 102);
+
+    EXPECT_MODBUS_READ(5, false, 100, { 1, 2, 4 });
+    auto result = parameters::diff(driver, params, digest);
+    ASSERT_EQ(1, result.changed_blocks.size());
+    ASSERT_EQ(1, result.mismatches.size());
+    ASSERT_EQ(102, result.mismatches[0].id);
+    ASSERT_EQ(3, result.mismatches[0].expected);
+    ASSERT_EQ(4, result.mismatches[0].actual);
+}
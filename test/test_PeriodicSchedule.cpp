@@ -0,0 +1,31 @@
+#include <gtest/gtest.h>
+#include <motors_weg_cvw300/PeriodicSchedule.hpp>
+
+using namespace motors_weg_cvw300;
+using base::Time;
+
+TEST(PeriodicScheduleTest, it_schedules_the_cycles_on_absolute_deadlines) {
+    PeriodicSchedule schedule(Time::fromMilliseconds(10), 1000);
+    ASSERT_EQ(1000, schedule.getDeadline());
+    ASSERT_EQ(0, schedule.next(1000 + 9999999));
+    ASSERT_EQ(1, schedule.getCycle());
+    ASSERT_EQ(10001000, schedule.getDeadline());
+}
+
+TEST(PeriodicScheduleTest, it_skips_the_cycles_whose_deadline_has_passed) {
+    PeriodicSchedule schedule(Time::fromMilliseconds(10), 0);
+    ASSERT_EQ(2, schedule.next(25000000));
+    ASSERT_EQ(3, schedule.getCycle());
+    ASSERT_EQ(30000000, schedule.getDeadline());
+}
+
+TEST(PeriodicScheduleTest, it_sleeps_until_the_deadline) {
+    PeriodicSchedule schedule(Time::fromMilliseconds(10));
+    schedule.next(schedule.getStart());
+    int64_t wakeup = schedule.waitDeadline();
+    ASSERT_GE(wakeup, schedule.getDeadline());
+}
+
+TEST(PeriodicScheduleTest, it_refuses_a_null_period) {
+    ASSERT_THROW(PeriodicSchedule{ Time() }, std::invalid_argument);
+}
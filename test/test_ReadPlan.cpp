@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <motors_weg_cvw300/ReadPlan.hpp>
+
+using namespace motors_weg_cvw300;
+
+struct ReadPlanTest : public testing::Test {
+    BusCostModel model;
+    ReadPlan plan;
+
+    ReadPlanTest() {
+        model.baud_rate = 19200;
+        model.interframe_delay = base::Time::fromMilliseconds(20);
+    }
+};
+
+TEST_F(ReadPlanTest, it_computes_the_gap_that_is_cheaper_to_read_than_a_new_frame) {
+    ASSERT_EQ(23, model.maxMergeableGap());
+    model.baud_rate = 57600;
+    ASSERT_EQ(59, model.maxMergeableGap());
+}
+
+TEST_F(ReadPlanTest, it_returns_no_blocks_if_empty) {
+    plan.compile(model);
+    ASSERT_TRUE(plan.getBlocks().empty());
+}
+
+TEST_F(ReadPlanTest, it_merges_contiguous_registers) {
+    plan.add(10, 3);
+    plan.add(13);
+    plan.compile(model);
+
+    auto blocks = plan.getBlocks();
+    ASSERT_EQ(1, blocks.size());
+    ASSERT_EQ(10, blocks[0].start);
+    ASSERT_EQ(4, blocks[0].length);
+}
+
+TEST_F(ReadPlanTest, it_ignores_the_declaration_order_and_duplicates) {
+    plan.add(13);
+    plan.add(10);
+    plan.add(13);
+    plan.compile(model);
+
+    auto blocks = plan.getBlocks();
+    ASSERT_EQ(1, blocks.size());
+    ASSERT_EQ(10, blocks[0].start);
+    ASSERT_EQ(4, blocks[0].length);
+}
+
+TEST_F(ReadPlanTest, it_reads_gaps_that_are_cheaper_than_a_new_frame) {
+    plan.add(10);
+    plan.add(34);
+    plan.compile(model);
+
+    auto blocks = plan.getBlocks();
+    ASSERT_EQ(1, blocks.size());
+    ASSERT_EQ(10, blocks[0].start);
+    ASSERT_EQ(25, blocks[0].length);
+}
+
+TEST_F(ReadPlanTest, it_splits_on_gaps_that_are_more_expensive_than_a_new_frame) {
+    plan.add(10);
+    plan.add(35);
+    plan.compile(model);
+
+    auto blocks = plan.getBlocks();
+    ASSERT_EQ(2, blocks.size());
+    ASSERT_EQ(10, blocks[0].start);
+    ASSERT_EQ(1, blocks[0].length);
+    ASSERT_EQ(35, blocks[1].start);
+    ASSERT_EQ(1, blocks[1].length);
+}
+
+TEST_F(ReadPlanTest, it_does_not_merge_across_excluded_registers) {
+    plan.add(10);
+    plan.add(20);
+    plan.exclude(15);
+    plan.compile(model);
+
+    auto blocks = plan.getBlocks();
+    ASSERT_EQ(2, blocks.size());
+    ASSERT_EQ(10, blocks[0].start);
+    ASSERT_EQ(1, blocks[0].length);
+    ASSERT_EQ(20, blocks[1].start);
+    ASSERT_EQ(1, blocks[1].length);
+}
+
+TEST_F(ReadPlanTest, it_reads_excluded_registers_that_are_in_the_plan) {
+    plan.add(10, 3);
+    plan.exclude(11);
+    plan.compile(model);
+
+    auto blocks = plan.getBlocks();
+    ASSERT_EQ(1, blocks.size());
+    ASSERT_EQ(10, blocks[0].start);
+    ASSERT_EQ(3, blocks[0].length);
+}
+
+TEST_F(ReadPlanTest, it_does_not_create_blocks_bigger_than_the_modbus_limit) {
+    plan.add(0, 200);
+    plan.compile(model);
+
+    auto blocks = plan.getBlocks();
+    ASSERT_EQ(2, blocks.size());
+    ASSERT_EQ(0, blocks[0].start);
+    ASSERT_EQ(125, blocks[0].length);
+    ASSERT_EQ(125, blocks[1].start);
+    ASSERT_EQ(75, blocks[1].length);
+}
+
+TEST_F(ReadPlanTest, it_gives_access_to_the_read_values) {
+    plan.add(10);
+    plan.add(12);
+    plan.add(50);
+    plan.compile(model);
+
+    auto blocks = plan.getBlocks();
+    uint16_t* first = plan.getBlockBuffer(blocks[0]);
+    first[0] = 1;
+    first[1] = 2;
+    first[2] = 3;
+    plan.getBlockBuffer(blocks[1])[0] = 4;
+
+    ASSERT_EQ(1, plan.get(10));
+    ASSERT_EQ(2, plan.get(11));
+    ASSERT_EQ(3, plan.get(12));
+    ASSERT_EQ(4, plan.get(50));
+    ASSERT_THROW(plan.get(13), std::out_of_range);
+}
@@ -0,0 +1,36 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <motors_weg_cvw300/Registers.hpp>
+
+using namespace motors_weg_cvw300;
+using namespace motors_weg_cvw300::registers;
+
+static_assert(decode<int>(CURRENT_ALARM, 12) == 12, "decode must be constexpr");
+static_assert(encode(SERIAL_WATCHDOG, 15.4) == 154, "encode must be constexpr");
+static_assert(spanOf({ MOTOR_TORQUE, MOTOR_SPEED }).start == 2, "");
+static_assert(spanOf({ MOTOR_TORQUE, MOTOR_SPEED }).length == 8, "");
+
+TEST(RegistersTest, it_decodes_signed_registers) {
+    ASSERT_FLOAT_EQ(-0.5, decode(INVERTER_OUTPUT_CURRENT, 0xFFFB));
+}
+
+TEST(RegistersTest, it_decodes_unsigned_registers) {
+    ASSERT_EQ(0xFFFB, decode<int>(ENCODER_PULSE_COUNTER, 0xFFFB));
+}
+
+TEST(RegistersTest, it_converts_rpm_into_rad_per_second) {
+    ASSERT_FLOAT_EQ(2 * M_PI, decode(MOTOR_SPEED, 60));
+    ASSERT_EQ(60, encode(MAX_SPEED_REFERENCE, 2 * M_PI));
+}
+
+TEST(RegistersTest, it_encodes_negative_values_in_twos_complement) {
+    ASSERT_EQ(0xFFFB, encode(INVERTER_OUTPUT_CURRENT, -0.5));
+}
+
+TEST(RegistersTest, it_decodes_a_register_read_by_a_plan) {
+    ReadPlan plan;
+    plan.add(TEMPERATURE_AIR.id);
+    plan.compile(BusCostModel());
+    *plan.getBlockBuffer(plan.getBlocks()[0]) = 253;
+    ASSERT_FLOAT_EQ(25.3, decode(TEMPERATURE_AIR, plan));
+}
@@ -0,0 +1,250 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <modbus/RTU.hpp>
+#include <motors_weg_cvw300/Configuration.hpp>
+#include <motors_weg_cvw300/InverterStatus.hpp>
+#include <motors_weg_cvw300/Simulator.hpp>
+#include <poll.h>
+#include <unistd.h>
+
+using namespace motors_weg_cvw300;
+using base::Time;
+
+struct SimulatorTest : public testing::Test {
+    SimulatorSettings settings;
+    Time now = Time::fromSeconds(1000);
+
+    SimulatorTest() {
+        settings.address = 5;
+        settings.baud_rate = 0;
+        settings.response_delay = Time();
+    }
+
+    std::vector<uint8_t> frame(int address, int function,
+                               std::vector<uint8_t> const& payload) {
+        uint8_t buffer[256];
+        uint8_t* end = modbus::RTU::formatFrame(
+            buffer, address, function, payload.data(), payload.data() + payload.size()
+        );
+        return std::vector<uint8_t>(buffer, end);
+    }
+
+    std::vector<uint8_t> readRequest(int start, int length) {
+        return frame(5, 3, { uint8_t(start >> 8), uint8_t(start),
+                             uint8_t(length >> 8), uint8_t(length) });
+    }
+
+    std::vector<uint8_t> writeRequest(int reg, uint16_t value) {
+        return frame(5, 6, { uint8_t(reg >> 8), uint8_t(reg),
+                             uint8_t(value >> 8), uint8_t(value) });
+    }
+
+    std::vector<uint8_t> writeMultipleRequest(int start,
+                                              std::vector<uint16_t> const& values) {
+        std::vector<uint8_t> payload = {
+            uint8_t(start >> 8), uint8_t(start), 0, uint8_t(values.size()),
+            uint8_t(values.size() * 2)
+        };
+        for (auto v : values) {
+            payload.push_back(v >> 8);
+            payload.push_back(v & 0xFF);
+        }
+        return frame(5, 16, payload);
+    }
+
+    std::vector<uint16_t> read(Simulator& simulator, int start, int length,
+                               Time const& time) {
+        auto reply = simulator.processFrame(readRequest(start, length), time);
+        EXPECT_EQ(5 + 2 * length, reply.size());
+        EXPECT_EQ(3, reply[1]);
+        std::vector<uint16_t> values;
+        for (int i = 0; i < length; ++i) {
+            values.push_back(reply[3 + 2 * i] << 8 | reply[4 + 2 * i]);
+        }
+        return values;
+    }
+};
+
+TEST_F(SimulatorTest, it_answers_reads_of_the_motor_ratings) {
+    Simulator simulator(settings);
+    auto values = read(simulator, 401, 5, now);
+    ASSERT_EQ(100, values[0]);
+    ASSERT_EQ(3000, values[1]);
+    ASSERT_EQ(1, values[3]);
+    ASSERT_EQ(1024, values[4]);
+}
+
+TEST_F(SimulatorTest, it_echoes_single_register_writes) {
+    Simulator simulator(settings);
+    auto request = writeRequest(100, 10);
+    ASSERT_EQ(request, simulator.processFrame(request, now));
+    ASSERT_EQ(10, simulator.getRegister(100));
+}
+
+TEST_F(SimulatorTest, it_handles_write_multiple_registers) {
+    Simulator simulator(settings);
+    auto reply = simulator.processFrame(writeMultipleRequest(161, { 1, 2, 3 }), now);
+    ASSERT_EQ(frame(5, 16, { 0, 161, 0, 3 }), reply);
+    ASSERT_EQ((std::vector<uint16_t>{ 1, 2, 3 }), read(simulator, 161, 3, now));
+}
+
+TEST_F(SimulatorTest, it_refuses_to_write_read_only_registers) {
+    Simulator simulator(settings);
+    auto reply = simulator.processFrame(writeRequest(2, 10), now);
+    ASSERT_EQ(frame(5, 0x86, { Simulator::ILLEGAL_DATA_ADDRESS }), reply);
+    ASSERT_EQ(1, simulator.getStatistics().exceptions);
+}
+
+TEST_F(SimulatorTest, it_refuses_to_read_the_invalid_registers) {
+    settings.invalid_registers = { 12 };
+    Simulator simulator(settings);
+    auto reply = simulator.processFrame(readRequest(10, 5), now);
+    ASSERT_EQ(frame(5, 0x83, { Simulator::ILLEGAL_DATA_ADDRESS }), reply);
+}
+
+TEST_F(SimulatorTest, it_refuses_unsupported_functions) {
+    Simulator simulator(settings);
+    auto reply = simulator.processFrame(frame(5, 0x2B, { 0x0E, 1, 0 }), now);
+    ASSERT_EQ(frame(5, 0xAB, { Simulator::ILLEGAL_FUNCTION }), reply);
+}
+
+TEST_F(SimulatorTest, it_ignores_frames_for_other_addresses) {
+    Simulator simulator(settings);
+    auto reply = simulator.processFrame(frame(6, 3, { 0, 2, 0, 1 }), now);
+    ASSERT_TRUE(reply.empty());
+    ASSERT_EQ(0, simulator.getStatistics().requests);
+}
+
+TEST_F(SimulatorTest, it_drops_frames_with_an_invalid_crc) {
+    Simulator simulator(settings);
+    auto request = readRequest(2, 1);
+    request.back() ^= 0xFF;
+    ASSERT_TRUE(simulator.processFrame(request, now).empty());
+    ASSERT_EQ(1, simulator.getStatistics().invalid_frames);
+}
+
+TEST_F(SimulatorTest, it_ramps_the_motor_speed_to_the_reference) {
+    Simulator simulator(settings);
+    uint16_t control = configuration::SERIAL_CONTROL_ON |
+                       configuration::SERIAL_GENERAL |
+                       configuration::SERIAL_DIRECTION_POSITIVE |
+                       configuration::SERIAL_MODE_REMOTE;
+    // Half the rated speed (3000 rpm), reached in 2.5s with the default ramps
+    simulator.processFrame(writeMultipleRequest(682, { control, 4096 }), now);
+
+    auto state = read(simulator, 2, 8, now + Time::fromSeconds(1));
+    ASSERT_NEAR(600, state[0], 1);
+    ASSERT_EQ(STATUS_RUN, state[4]);
+    ASSERT_GT(static_cast<int16_t>(state[7]), 0);
+
+    state = read(simulator, 2, 8, now + Time::fromSeconds(5));
+    ASSERT_NEAR(1500, state[0], 1);
+}
+
+TEST_F(SimulatorTest, it_reports_a_negative_speed_through_the_current_and_torque_signs) {
+    Simulator simulator(settings);
+    uint16_t control = configuration::SERIAL_CONTROL_ON |
+                       configuration::SERIAL_GENERAL |
+                       configuration::SERIAL_DIRECTION_POSITIVE |
+                       configuration::SERIAL_MODE_REMOTE;
+    simulator.processFrame(writeMultipleRequest(682, { control, uint16_t(-4096) }), now);
+
+    auto state = read(simulator, 2, 8, now + Time::fromSeconds(5));
+    ASSERT_NEAR(1500, state[0], 1);
+    ASSERT_LT(static_cast<int16_t>(state[1]) * static_cast<int16_t>(state[7]), 0);
+}
+
+TEST_F(SimulatorTest, it_advances_the_encoder_counter) {
+    Simulator simulator(settings);
+    simulator.setRegister(100, 0);
+    uint16_t control = configuration::SERIAL_CONTROL_ON |
+                       configuration::SERIAL_GENERAL |
+                       configuration::SERIAL_DIRECTION_POSITIVE |
+                       configuration::SERIAL_MODE_REMOTE;
+    // 60 rpm, i.e. one turn per second
+    simulator.processFrame(writeMultipleRequest(682, { control, 164 }), now);
+    auto encoder = read(simulator, 38, 2, now + Time::fromSeconds(2));
+    ASSERT_NEAR(60, encoder[0], 1);
+    ASSERT_NEAR(2048, encoder[1], 30);
+}
+
+TEST_F(SimulatorTest, it_stops_and_raises_an_alarm_when_the_serial_watchdog_triggers) {
+    Simulator simulator(settings);
+    simulator.processFrame(writeRequest(313, configuration::STOP_WITH_RAMP), now);
+    simulator.processFrame(writeRequest(314, 5), now); // 0.5s
+    uint16_t control = configuration::SERIAL_CONTROL_ON |
+                       configuration::SERIAL_GENERAL |
+                       configuration::SERIAL_DIRECTION_POSITIVE |
+                       configuration::SERIAL_MODE_REMOTE;
+    simulator.processFrame(writeMultipleRequest(682, { control, 4096 }), now);
+
+    auto alarm = read(simulator, 48, 1, now + Time::fromSeconds(1));
+    ASSERT_EQ(Simulator::ALARM_SERIAL_TIMEOUT, alarm[0]);
+    auto state = read(simulator, 2, 8, now + Time::fromSeconds(1));
+    ASSERT_EQ(STATUS_READY, state[4]);
+}
+
+TEST_F(SimulatorTest, it_records_injected_faults_in_the_history) {
+    Simulator simulator(settings);
+    simulator.injectFault(21);
+    simulator.injectFault(22);
+
+    auto faults = read(simulator, 49, 6, now);
+    ASSERT_EQ(22, faults[0]);
+    ASSERT_EQ(22, faults[1]);
+    ASSERT_EQ(21, faults[5]);
+    ASSERT_EQ(STATUS_FAULT, read(simulator, 6, 1, now)[0]);
+
+    simulator.processFrame(writeRequest(682, configuration::SERIAL_RESET_FAULT), now);
+    ASSERT_EQ(0, read(simulator, 49, 1, now)[0]);
+    ASSERT_EQ(STATUS_READY, read(simulator, 6, 1, now)[0]);
+}
+
+TEST_F(SimulatorTest, it_injects_timeouts) {
+    settings.timeout_probability = 1;
+    Simulator simulator(settings);
+    ASSERT_TRUE(simulator.processFrame(readRequest(2, 1), now).empty());
+    ASSERT_EQ(1, simulator.getStatistics().injected_timeouts);
+}
+
+TEST_F(SimulatorTest, it_injects_exceptions) {
+    settings.exception_probability = 1;
+    Simulator simulator(settings);
+    auto reply = simulator.processFrame(readRequest(2, 1), now);
+    ASSERT_EQ(frame(5, 0x83, { Simulator::SLAVE_DEVICE_FAILURE }), reply);
+}
+
+TEST_F(SimulatorTest, it_injects_crc_errors) {
+    settings.crc_error_probability = 1;
+    Simulator simulator(settings);
+    auto reply = simulator.processFrame(readRequest(2, 1), now);
+    auto expected = frame(5, 3, { 2, reply[3], reply[4] });
+    ASSERT_EQ(expected.size(), reply.size());
+    ASSERT_NE(expected, reply);
+}
+
+TEST_F(SimulatorTest, it_answers_on_the_pseudo_terminal) {
+    Simulator simulator(settings);
+    simulator.start();
+
+    int fd = ::open(simulator.getPTYPath().c_str(), O_RDWR | O_NOCTTY);
+    ASSERT_GE(fd, 0);
+    auto request = readRequest(401, 5);
+    ASSERT_EQ(request.size(), ::write(fd, request.data(), request.size()));
+
+    std::vector<uint8_t> reply;
+    auto deadline = Time::now() + Time::fromSeconds(1);
+    while (reply.size() < 15 && Time::now() < deadline) {
+        pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) > 0) {
+            uint8_t buffer[256];
+            ssize_t size = ::read(fd, buffer, sizeof(buffer));
+            reply.insert(reply.end(), buffer, buffer + std::max<ssize_t>(size, 0));
+        }
+    }
+    ::close(fd);
+    simulator.stop();
+
+    ASSERT_EQ(15, reply.size());
+    ASSERT_EQ(simulator.processFrame(request), reply);
+}
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+#include <motors_weg_cvw300/SpeedProfile.hpp>
+#include <sstream>
+
+using namespace motors_weg_cvw300;
+using base::Time;
+
+static SpeedProfile parse(std::string const& text) {
+    std::istringstream in(text);
+    return SpeedProfile::parse(in);
+}
+
+TEST(SpeedProfileTest, it_parses_the_points_ignoring_comments_and_empty_lines) {
+    auto profile = parse("# step test\n"
+                         "0 0\n"
+                         "\n"
+                         "1.5 10 # ramp\n"
+                         "  2 -5\n");
+    ASSERT_EQ(3, profile.points.size());
+    ASSERT_EQ(Time::fromMilliseconds(1500), profile.points[1].time);
+    ASSERT_FLOAT_EQ(10, profile.points[1].speed);
+    ASSERT_EQ(Time::fromSeconds(2), profile.getDuration());
+    ASSERT_FLOAT_EQ(-5, profile.points[2].speed);
+}
+
+TEST(SpeedProfileTest, it_rejects_malformed_lines) {
+    ASSERT_THROW(parse("0 0\n1\n"), std::invalid_argument);
+    ASSERT_THROW(parse("0 0\n1 2 3\n"), std::invalid_argument);
+    ASSERT_THROW(parse("0 0\nfoo 2\n"), std::invalid_argument);
+}
+
+TEST(SpeedProfileTest, it_rejects_decreasing_or_negative_times) {
+    ASSERT_THROW(parse("1 0\n0.5 2\n"), std::invalid_argument);
+    ASSERT_THROW(parse("-1 0\n"), std::invalid_argument);
+}
+
+TEST(SpeedProfileTest, it_interpolates_linearly_between_the_points) {
+    auto profile = parse("1 0\n3 10\n");
+    ASSERT_FLOAT_EQ(0, profile.getSpeed(Time::fromSeconds(0)));
+    ASSERT_FLOAT_EQ(2.5, profile.getSpeed(Time::fromSeconds(1.5)));
+    ASSERT_FLOAT_EQ(10, profile.getSpeed(Time::fromSeconds(5)));
+}
+
+TEST(SpeedProfileTest, it_handles_steps) {
+    auto profile = parse("0 0\n1 0\n1 10\n2 10\n");
+    ASSERT_FLOAT_EQ(0, profile.getSpeed(Time::fromMilliseconds(999)));
+    ASSERT_FLOAT_EQ(10, profile.getSpeed(Time::fromSeconds(1)));
+}
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <motors_weg_cvw300/Statistics.hpp>
+
+using namespace motors_weg_cvw300;
+using base::Time;
+
+TEST(LatencyHistogramTest, it_has_one_bucket_per_microsecond_below_four) {
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_EQ(i, LatencyHistogram::bucketOf(Time::fromMicroseconds(i)));
+    }
+}
+
+TEST(LatencyHistogramTest, it_splits_powers_of_two_in_four_buckets) {
+    ASSERT_EQ(4, LatencyHistogram::bucketOf(Time::fromMicroseconds(4)));
+    ASSERT_EQ(7, LatencyHistogram::bucketOf(Time::fromMicroseconds(7)));
+    ASSERT_EQ(8, LatencyHistogram::bucketOf(Time::fromMicroseconds(8)));
+    ASSERT_EQ(8, LatencyHistogram::bucketOf(Time::fromMicroseconds(9)));
+    ASSERT_EQ(9, LatencyHistogram::bucketOf(Time::fromMicroseconds(10)));
+
+    for (int bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT - 1; ++bucket) {
+        Time lower = LatencyHistogram::getBucketLowerBound(bucket);
+        Time upper = LatencyHistogram::getBucketUpperBound(bucket);
+        ASSERT_EQ(bucket, LatencyHistogram::bucketOf(lower));
+        ASSERT_EQ(bucket, LatencyHistogram::bucketOf(upper - Time::fromMicroseconds(1)));
+        ASSERT_EQ(bucket + 1, LatencyHistogram::bucketOf(upper));
+    }
+}
+
+TEST(LatencyHistogramTest, it_counts_long_durations_in_the_last_bucket) {
+    ASSERT_EQ(LatencyHistogram::BUCKET_COUNT - 1,
+              LatencyHistogram::bucketOf(Time::fromSeconds(3600)));
+}
+
+TEST(LatencyHistogramTest, it_estimates_percentiles_with_the_bucket_upper_bound) {
+    LatencyHistogram histogram;
+    ASSERT_TRUE(histogram.getPercentile(0.5).isNull());
+
+    for (int i = 0; i < 99; ++i) {
+        histogram.add(Time::fromMilliseconds(10));
+    }
+    histogram.add(Time::fromMilliseconds(100));
+    ASSERT_EQ(100, histogram.getCount());
+
+    Time p50 = histogram.getPercentile(0.5);
+    ASSERT_GT(p50, Time::fromMilliseconds(10));
+    ASSERT_LE(p50, Time::fromMilliseconds(12.5));
+    ASSERT_EQ(p50, histogram.getPercentile(0.99));
+    ASSERT_GT(histogram.getPercentile(1), Time::fromMilliseconds(100));
+}
+
+TEST(StatisticsRecorderTest, it_counts_the_transactions_per_outcome) {
+    StatisticsRecorder recorder;
+    Time latency = Time::fromMilliseconds(10);
+    recorder.recordTransaction(OPERATION_READ_CURRENT_STATE, false, 2, 8,
+                               StatisticsRecorder::SUCCESS, latency);
+    recorder.recordTransaction(OPERATION_READ_CURRENT_STATE, false, 2, 8,
+                               StatisticsRecorder::TIMEOUT, latency, true);
+    recorder.recordTransaction(OPERATION_READ_CURRENT_STATE, false, 2, 8,
+                               StatisticsRecorder::CRC_ERROR, latency);
+    recorder.recordTransaction(OPERATION_READ_CURRENT_STATE, false, 2, 8,
+                               StatisticsRecorder::EXCEPTION, latency);
+    recorder.recordTransaction(OPERATION_READ_CURRENT_STATE, false, 2, 8,
+                               StatisticsRecorder::OTHER_ERROR, latency);
+
+    auto total = recorder.get().total;
+    ASSERT_EQ(5, total.frames);
+    ASSERT_EQ(1, total.retries);
+    ASSERT_EQ(1, total.timeouts);
+    ASSERT_EQ(1, total.crc_errors);
+    ASSERT_EQ(1, total.exceptions);
+    ASSERT_EQ(1, total.errors);
+    // Only the transactions that got a reply have a latency
+    ASSERT_EQ(3, total.latency.getCount());
+}
+
+TEST(StatisticsRecorderTest, it_separates_the_statistics_per_operation_and_block) {
+    StatisticsRecorder recorder;
+    Time latency = Time::fromMilliseconds(10);
+    recorder.recordTransaction(OPERATION_READ_CURRENT_STATE, false, 2, 8,
+                               StatisticsRecorder::SUCCESS, latency);
+    recorder.recordTransaction(OPERATION_READ_CURRENT_STATE, false, 37, 1,
+                               StatisticsRecorder::SUCCESS, latency);
+    recorder.recordTransaction(OPERATION_ENABLE, true, 682, 1,
+                               StatisticsRecorder::TIMEOUT, latency);
+    recorder.recordCall(OPERATION_READ_CURRENT_STATE, false, latency * 2);
+    recorder.recordCall(OPERATION_ENABLE, true, latency);
+
+    auto statistics = recorder.get();
+    ASSERT_EQ(2, statistics.operations.size());
+    auto const& enable = statistics.operations[0];
+    ASSERT_EQ(OPERATION_ENABLE, enable.operation);
+    ASSERT_EQ(1, enable.calls);
+    ASSERT_EQ(1, enable.failures);
+    ASSERT_EQ(1, enable.transactions.timeouts);
+    auto const& state = statistics.operations[1];
+    ASSERT_EQ(OPERATION_READ_CURRENT_STATE, state.operation);
+    ASSERT_EQ(2, state.transactions.frames);
+    ASSERT_EQ(1, state.duration.getCount());
+
+    ASSERT_EQ(3, statistics.blocks.size());
+    ASSERT_EQ(2, statistics.blocks[0].start);
+    ASSERT_EQ(8, statistics.blocks[0].length);
+    ASSERT_FALSE(statistics.blocks[0].write);
+    ASSERT_EQ(37, statistics.blocks[1].start);
+    ASSERT_EQ(682, statistics.blocks[2].start);
+    ASSERT_TRUE(statistics.blocks[2].write);
+    ASSERT_EQ(1, statistics.blocks[2].transactions.timeouts);
+}
+
+TEST(StatisticsRecorderTest, it_counts_the_transactions_on_blocks_it_cannot_track) {
+    StatisticsRecorder recorder;
+    for (int i = 0; i < StatisticsRecorder::MAX_BLOCKS + 2; ++i) {
+        recorder.recordTransaction(OPERATION_COUNT, false, i, 1,
+                                   StatisticsRecorder::SUCCESS, Time());
+    }
+
+    auto statistics = recorder.get();
+    ASSERT_EQ(StatisticsRecorder::MAX_BLOCKS, statistics.blocks.size());
+    ASSERT_EQ(2, statistics.untracked_block_transactions);
+    ASSERT_EQ(StatisticsRecorder::MAX_BLOCKS + 2, statistics.total.frames);
+    ASSERT_TRUE(statistics.operations.empty());
+}
+
+TEST(StatisticsRecorderTest, it_resets_the_statistics) {
+    StatisticsRecorder recorder;
+    recorder.recordTransaction(OPERATION_ENABLE, true, 682, 1,
+                               StatisticsRecorder::SUCCESS, Time());
+    recorder.recordCall(OPERATION_ENABLE, false, Time());
+    recorder.reset();
+
+    auto statistics = recorder.get();
+    ASSERT_EQ(0, statistics.total.frames);
+    ASSERT_TRUE(statistics.operations.empty());
+    ASSERT_TRUE(statistics.blocks.empty());
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <motors_weg_cvw300/Trace.hpp>
+#include <sstream>
+
+using namespace motors_weg_cvw300;
+using namespace motors_weg_cvw300::trace;
+
+struct TraceTest : public testing::Test {
+    std::string path = testing::TempDir() + "motors_weg_cvw300_test.trace";
+
+    TraceTest() {
+        std::remove(path.c_str());
+    }
+
+    ~TraceTest() {
+        std::remove(path.c_str());
+    }
+
+    void write(Writer& writer, Direction direction, std::vector<uint8_t> const& data) {
+        if (direction == REQUEST) {
+            writer.writeData(data.data(), data.size());
+        }
+        else {
+            writer.readData(data.data(), data.size());
+        }
+    }
+};
+
+TEST_F(TraceTest, it_reads_back_the_captured_frames) {
+    uint64_t start = trace::now();
+    {
+        Writer writer(path);
+        write(writer, REQUEST, { 1, 3, 0, 2, 0, 1 });
+        write(writer, REPLY, { 1, 3, 2, 0, 42 });
+    }
+
+    auto records = trace::read(path);
+    ASSERT_EQ(2, records.size());
+    ASSERT_EQ(REQUEST, records[0].direction);
+    ASSERT_EQ((std::vector<uint8_t>{ 1, 3, 0, 2, 0, 1 }), records[0].data);
+    ASSERT_EQ(REPLY, records[1].direction);
+    ASSERT_EQ((std::vector<uint8_t>{ 1, 3, 2, 0, 42 }), records[1].data);
+    ASSERT_LE(start, records[0].time);
+    ASSERT_LE(records[0].time, records[1].time);
+    ASSERT_LE(records[1].time, trace::now());
+}
+
+TEST_F(TraceTest, it_appends_to_an_existing_trace) {
+    {
+        Writer writer(path);
+        write(writer, REQUEST, { 1 });
+    }
+    {
+        Writer writer(path);
+        write(writer, REQUEST, { 2 });
+    }
+
+    auto records = trace::read(path);
+    ASSERT_EQ(2, records.size());
+    ASSERT_EQ(std::vector<uint8_t>{ 2 }, records[1].data);
+}
+
+TEST_F(TraceTest, it_ignores_a_truncated_record) {
+    {
+        Writer writer(path);
+        write(writer, REQUEST, { 1, 2, 3 });
+        write(writer, REPLY, { 4, 5, 6 });
+    }
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    std::istringstream truncated(data.substr(0, data.size() - 1));
+
+    auto records = trace::read(truncated);
+    ASSERT_EQ(1, records.size());
+}
+
+TEST_F(TraceTest, it_recovers_the_runs_appended_after_a_truncated_record) {
+    {
+        Writer writer(path);
+        write(writer, REQUEST, { 1, 2, 3 });
+        write(writer, REPLY, { 4, 5, 6 });
+    }
+    std::string data;
+    {
+        std::ifstream in(path, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << data.substr(0, data.size() - 1);
+    }
+    {
+        Writer writer(path);
+        write(writer, REQUEST, { 7 });
+        write(writer, REPLY, { 8 });
+    }
+
+    auto records = trace::read(path);
+    ASSERT_EQ(3, records.size());
+    ASSERT_EQ(0, records[0].run);
+    ASSERT_EQ(std::vector<uint8_t>{ 7 }, records[1].data);
+    ASSERT_EQ(1, records[1].run);
+    ASSERT_EQ(std::vector<uint8_t>{ 8 }, records[2].data);
+    ASSERT_EQ(1, records[2].run);
+}
+
+TEST_F(TraceTest, it_rejects_a_file_that_is_not_a_trace) {
+    std::istringstream in("not a trace at all");
+    ASSERT_THROW(trace::read(in), std::invalid_argument);
+}
+
+TEST_F(TraceTest, it_groups_the_records_into_transactions) {
+    std::vector<Record> records = {
+        { REQUEST, 100, { 1 } },
+        { REPLY, 200, { 2, 3 } },
+        { REPLY, 250, { 4 } },
+        { REQUEST, 300, { 5 } },
+        { REQUEST, 400, { 6 } },
+        { REPLY, 500, { 7 } }
+    };
+
+    auto transactions = toTransactions(records);
+    ASSERT_EQ(3, transactions.size());
+    ASSERT_EQ((std::vector<uint8_t>{ 2, 3, 4 }), transactions[0].reply);
+    ASSERT_EQ(100, transactions[0].request_time);
+    ASSERT_EQ(250, transactions[0].reply_time);
+    ASSERT_TRUE(transactions[1].reply.empty());
+    ASSERT_EQ(300, transactions[1].reply_time);
+    ASSERT_EQ(std::vector<uint8_t>{ 6 }, transactions[2].request);
+    ASSERT_EQ(std::vector<uint8_t>{ 7 }, transactions[2].reply);
+}
+
+TEST_F(TraceTest, it_does_not_associate_a_request_with_the_replies_of_another_run) {
+    std::vector<Record> records = {
+        { REQUEST, 100, { 1 }, 0 },
+        { REPLY, 50, { 2 }, 1 }
+    };
+
+    auto transactions = toTransactions(records);
+    ASSERT_EQ(1, transactions.size());
+    ASSERT_TRUE(transactions[0].reply.empty());
+}
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+#include <motors_weg_cvw300/TripleBuffer.hpp>
+#include <thread>
+
+using namespace motors_weg_cvw300;
+
+TEST(TripleBufferTest, it_returns_the_last_published_value) {
+    TripleBuffer<int> buffer;
+    buffer.write(1);
+    buffer.write(2);
+    ASSERT_EQ(2, buffer.read());
+}
+
+TEST(TripleBufferTest, it_returns_the_same_value_if_nothing_new_was_published) {
+    TripleBuffer<int> buffer;
+    buffer.write(1);
+    ASSERT_EQ(1, buffer.read());
+    ASSERT_EQ(1, buffer.read());
+    buffer.write(2);
+    ASSERT_EQ(2, buffer.read());
+    ASSERT_EQ(2, buffer.read());
+}
+
+TEST(TripleBufferTest, it_never_returns_a_torn_value) {
+    struct Value {
+        int a = 0;
+        int b = 0;
+    };
+    TripleBuffer<Value> buffer;
+
+    std::thread writer([&buffer] {
+        for (int i = 1; i <= 100000; ++i) {
+            Value& v = buffer.getWriteBuffer();
+            v.a = i;
+            v.b = -i;
+            buffer.publish();
+        }
+    });
+
+    int last = 0;
+    while (last != 100000) {
+        Value v = buffer.read();
+        ASSERT_EQ(v.a, -v.b);
+        ASSERT_GE(v.a, last);
+        last = v.a;
+    }
+    writer.join();
+}